@@ -24,6 +24,9 @@
 #include <ray/scene/bvh/StaticBvh.h>
 #include <ray/scene/bvh/StaticBvhObjectMedianPartitioner.h>
 #include <ray/scene/bvh/StaticBvhObjectMeanPartitioner.h>
+#include <ray/scene/bvh/StaticBvhObjectSahPartitioner.h>
+#include <ray/scene/bvh/StaticBvhTraversal.h>
+#include <ray/scene/bvh/StaticFlatBvh.h>
 #include <ray/scene/object/SceneObject.h>
 #include <ray/scene/object/SceneObjectBlob.h>
 
@@ -48,14 +51,22 @@
 #include <ray/shape/Sphere.h>
 #include <ray/shape/TransformedShape3.h>
 
+#include <ray/utility/ThreadPool.h>
+
 #include <ray/Camera.h>
 #include <ray/Image.h>
+#include <ray/ProgressiveRenderSession.h>
 #include <ray/Raytracer.h>
+#include <ray/TileScheduler.h>
 
 #include <chrono>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <string>
 #include <random>
+#include <thread>
 
 using namespace ray;
 
@@ -129,44 +140,44 @@ RawTriangleMesh createRawIcosahedron(const Vec3f& offset, float radius)
     return mesh;
 }
 
-ClosedTriangleMesh createIcosahedron(const Vec3f& offset, float radius, const SurfaceMaterial* surface, const MediumMaterial* medium)
+std::unique_ptr<ClosedTriangleMesh> createIcosahedron(const Vec3f& offset, float radius, const SurfaceMaterial* surface, const MediumMaterial* medium)
 {
     RawTriangleMesh basicMesh = createRawIcosahedron(offset, radius);
 
-    ClosedTriangleMesh mesh(medium);
+    auto mesh = std::make_unique<ClosedTriangleMesh>(medium);
 
     for (const Index3& face : basicMesh.faces)
     {
         Vec3f centerOffset = (basicMesh.vertices[face.i].asVector() + basicMesh.vertices[face.j].asVector() + basicMesh.vertices[face.k].asVector()) * 0.333333333333f;
         Normal3f normal(centerOffset.normalized());
-        mesh.addVertex(ClosedTriangleMeshVertex{ basicMesh.vertices[face.i] + offset, normal, {} });
-        mesh.addVertex(ClosedTriangleMeshVertex{ basicMesh.vertices[face.j] + offset, normal, {} });
-        mesh.addVertex(ClosedTriangleMeshVertex{ basicMesh.vertices[face.k] + offset, normal, {} });
+        mesh->addVertex(ClosedTriangleMeshVertex{ basicMesh.vertices[face.i] + offset, normal, {} });
+        mesh->addVertex(ClosedTriangleMeshVertex{ basicMesh.vertices[face.j] + offset, normal, {} });
+        mesh->addVertex(ClosedTriangleMeshVertex{ basicMesh.vertices[face.k] + offset, normal, {} });
     }
 
     for (int i = 0; i < basicMesh.faces.size(); ++i)
     {
-        mesh.addFace(3*i, 3*i+1, 3*i+2, surface);
+        mesh->addFace(3*i, 3*i+1, 3*i+2, surface);
     }
 
     return mesh;
 }
 
-ClosedTriangleMesh createSmoothIcosahedron(const Vec3f& offset, float radius, const SurfaceMaterial* surface, const MediumMaterial* medium)
+std::unique_ptr<ClosedTriangleMesh> createSmoothIcosahedron(const Vec3f& offset, float radius, const SurfaceMaterial* surface, const MediumMaterial* medium)
 {
     RawTriangleMesh basicMesh = createRawIcosahedron(offset, radius);
 
-    ClosedTriangleMesh mesh(medium);
+    auto mesh = std::make_unique<ClosedTriangleMesh>(medium);
 
     for (const Point3f& vertex : basicMesh.vertices)
     {
         Normal3f normal(Vec3f(vertex).normalized());
-        mesh.addVertex(ClosedTriangleMeshVertex{ vertex + offset, normal, {} });
+        mesh->addVertex(ClosedTriangleMeshVertex{ vertex + offset, normal, {} });
     }
 
     for (const Index3& face : basicMesh.faces)
     {
-        mesh.addFace(face.i, face.j, face.k, surface);
+        mesh->addFace(face.i, face.j, face.k, surface);
     }
 
     return mesh;
@@ -215,6 +226,106 @@ void matrixTests()
     std::cout << (r2 * r2.inverse()).isAlmostIdentity() << '\n';
 }
 
+template <typename BvhT>
+void benchmarkBvhTraversal(const std::string& name, const BvhT& bvh, const Camera& camera)
+{
+    std::vector<LightHandle> lights;
+    bvh.gatherLights(lights);
+
+    std::vector<Point3f> shadowRayOrigins;
+    auto t0 = std::chrono::high_resolution_clock().now();
+    camera.forEachPixelRay([&](const Ray& ray, int x, int y) {
+        ResolvableRaycastHit hit;
+        hit.dist = std::numeric_limits<float>::max();
+        if (bvh.queryNearest(ray, hit))
+        {
+            shadowRayOrigins.emplace_back(hit.point + hit.normal * 0.002f);
+        }
+    });
+    auto t1 = std::chrono::high_resolution_clock().now();
+    for (const Point3f& origin : shadowRayOrigins)
+    {
+        for (const LightHandle& light : lights)
+        {
+            ResolvableRaycastHit hit;
+            hit.dist = std::numeric_limits<float>::max();
+            (void)bvh.queryNearest(Ray::between(origin, light.center()), hit);
+        }
+    }
+    auto t2 = std::chrono::high_resolution_clock().now();
+
+    const double numPrimaryRays = static_cast<double>(camera.width()) * camera.height();
+    const double numShadowRays = static_cast<double>(shadowRayOrigins.size()) * lights.size();
+    const double primaryTime = static_cast<double>((t1 - t0).count()) / 1e9;
+    const double shadowTime = static_cast<double>((t2 - t1).count()) / 1e9;
+    std::cout
+        << name << ": "
+        << "primary " << primaryTime << "s (" << numPrimaryRays / primaryTime / 1e6 << " Mrays/s), "
+        << "shadow " << shadowTime << "s (" << numShadowRays / shadowTime / 1e6 << " Mrays/s)\n";
+}
+
+// Compares priority queue and stack traversal of both bvh layouts on the same scene.
+template <typename ShapesT>
+void benchmarkBvhTraversal(const std::string& sceneName, const RawSceneObjectBlob<ShapesT>& shapes, const Camera& camera, int partitionerOrder)
+{
+    using PartitionerType = StaticBvhObjectMeanPartitioner;
+    using BvhParamsType = BvhParams<ShapesT, Box3, PackedSceneObjectStorageProvider>;
+
+    benchmarkBvhTraversal(sceneName + ", StaticBvh, queue", StaticBvh<BvhParamsType, PartitionerType, StaticBvhPriorityQueueTraversal>(shapes, partitionerOrder), camera);
+    benchmarkBvhTraversal(sceneName + ", StaticBvh, stack", StaticBvh<BvhParamsType, PartitionerType, StaticBvhStackTraversal>(shapes, partitionerOrder), camera);
+    benchmarkBvhTraversal(sceneName + ", StaticFlatBvh, queue", StaticFlatBvh<BvhParamsType, PartitionerType, StaticBvhPriorityQueueTraversal>(shapes, partitionerOrder), camera);
+    benchmarkBvhTraversal(sceneName + ", StaticFlatBvh, stack", StaticFlatBvh<BvhParamsType, PartitionerType, StaticBvhStackTraversal>(shapes, partitionerOrder), camera);
+}
+
+// Renders the same image with 1, 2, 4, ... pool threads up to the hardware concurrency.
+// The calling thread also renders tiles while it waits for them.
+template <typename SamplerT>
+void benchmarkRenderScaling(const Raytracer& raytracer, const Camera& camera, const SamplerT& sampler)
+{
+    const int maxNumThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    double singleThreadTime = 0.0;
+    for (int numThreads = 1;; numThreads = std::min(numThreads * 2, maxNumThreads))
+    {
+        ThreadPool pool(numThreads);
+        TileScheduler scheduler(pool);
+
+        auto t0 = std::chrono::high_resolution_clock().now();
+        (void)raytracer.capture(camera, sampler, scheduler);
+        auto t1 = std::chrono::high_resolution_clock().now();
+
+        const double time = static_cast<double>((t1 - t0).count()) / 1e9;
+        if (numThreads == 1)
+        {
+            singleThreadTime = time;
+        }
+        std::cout << numThreads << " pool thread(s): " << time << "s, speedup " << singleThreadTime / time << "\n";
+
+        if (numThreads == maxNumThreads)
+        {
+            break;
+        }
+    }
+}
+
+RawSceneObjectBlob<Shapes<Sphere>> createRandomSpheres(int count, const SurfaceMaterial* surface, const MediumMaterial* medium, const SurfaceMaterial* lightSurface)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dx(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> dy(-4.0f, 40.0f);
+    std::uniform_real_distribution<float> dz(-150.0f, -10.0f);
+    std::uniform_real_distribution<float> dr(0.05f, 0.5f);
+
+    std::vector<SceneObject<Sphere>> spheres;
+    spheres.reserve(count + 1);
+    for (int i = 0; i < count; ++i)
+    {
+        spheres.emplace_back(SceneObject<Sphere>(Sphere(Point3f(dx(rng), dy(rng), dz(rng)), dr(rng)), { { surface }, { medium } }));
+    }
+    spheres.emplace_back(SceneObject<Sphere>(Sphere(Point3f(0.0, 60, -30), 3), { { lightSurface }, { medium } }));
+
+    return RawSceneObjectBlob<Shapes<Sphere>>(std::move(spheres));
+}
+
 int __cdecl main()
 {
     constexpr int width = 1920;
@@ -284,8 +395,8 @@ int __cdecl main()
     std::vector<SceneObject<ClippedSdf<Sphere>>> sdfs;
     std::vector<SceneObject<TransformedShape3<AffineTransformation4f, Sphere>>> trSpheres;
 
-    //ClosedTriangleMesh mesh = createSmoothIcosahedron(Vec3f(0, 0, -7), 3.5f/2.0f, &m7);
-    ClosedTriangleMesh mesh = createIcosahedron(Vec3f(0, 0, -7), 3.5f / 2.0f, &m7s, &m7m);
+    //auto mesh = createSmoothIcosahedron(Vec3f(0, 0, -7), 3.5f/2.0f, &m7);
+    auto mesh = createIcosahedron(Vec3f(0, 0, -7), 3.5f / 2.0f, &m7s, &m7m);
 
     //spheres.emplace_back(SceneObject<ShapeT>(Sphere(Point3f(0.0, -10004, -20), 10000), { &m1 }));
     //planes.emplace_back(SceneObject<Plane>(Plane(UnitVec3f(0.0, -1.0, 0.0), 4), { &m1 }));
@@ -296,9 +407,9 @@ int __cdecl main()
     spheres.emplace_back(SceneObject<ShapeT>(Sphere(Point3f(-5.5, 0, -15), 3), { { &m5s }, { &m5m } })); // this sphere looks weird, is it right?
     spheres.emplace_back(SceneObject<ShapeT>(Sphere(Point3f(0.0, 20, -30), 3), { { &m6s }, { &m6m } }));
     //spheres.emplace_back(SceneObject<ShapeT>(Sphere(Point3f(0.0, 0, -7), 3.5), { { &m7s }, { &m7m } }));
-    for (int i = 0; i < mesh.numFaces(); ++i)
+    for (int i = 0; i < mesh->numFaces(); ++i)
     {
-        //closedTris.emplace_back(SceneObject<ClosedTriangleMeshFace>(mesh.face(i), mesh.material(i)));
+        //closedTris.emplace_back(SceneObject<ClosedTriangleMeshFace>(mesh->face(i), mesh->material(i)));
     }
     //spheres.emplace_back(SceneObject<ShapeT>(Sphere(Point3f(0.0, 0, -7), 1.5), { &m1 }));
     //spheres.emplace_back(SceneObject<ShapeT>(Sphere(Point3f(-3.0, 0, -7), 1.5), { &m1 }));
@@ -439,9 +550,13 @@ int __cdecl main()
 
     using ShapesT = Shapes<AnyBoundedShape, ShapeT, ClippedSdf<Sphere>, Plane, Box3, Triangle3, ClosedTriangleMeshFace, CsgShape, Disc3, Cylinder, Capsule, OrientedBox3, TransformedShape3<AffineTransformation4f, Sphere>>;
     using PartitionerType = StaticBvhObjectMeanPartitioner;
+    //using PartitionerType = StaticBvhObjectSahPartitioner;
     using BvhParamsType = BvhParams<ShapesT, Box3, PackedSceneObjectStorageProvider>;
     RawSceneObjectBlob<ShapesT> shapes(std::move(anyBoundedShapes), std::move(sdfs), std::move(trSpheres), std::move(obbs), std::move(spheres), std::move(planes), std::move(boxes), std::move(tris), std::move(closedTris), std::move(csgs), std::move(discs), std::move(cylinders), std::move(capsules));
     StaticScene<StaticBvh<BvhParamsType, PartitionerType>> scene(shapes, 3);
+    //StaticScene<StaticFlatBvh<BvhParamsType, PartitionerType>> scene(shapes, 3);
+    //ThreadPool constructionPool;
+    //StaticScene<StaticBvh<BvhParamsType, PartitionerType>> scene(shapes, constructionPool, 3);
     //StaticScene<PackedSceneObjectBlob<ShapesT>> scene(shapes);
     //*/
 
@@ -504,12 +619,40 @@ int __cdecl main()
     //auto sampler = PruningAdaptiveMultisampler(0.05f, UniformGridMultisampler(3));
     //auto sampler = InterpolatingSampler(UniformGridMultisampler(3));
     auto sampler = Sampler{};
+
+    /*
+    benchmarkBvhTraversal("ray.cpp scene", shapes, camera, 3);
+    benchmarkBvhTraversal("100k spheres", createRandomSpheres(100000, &m2s, &m2m, &m6s), camera, 1);
+    benchmarkBvhTraversal("100k spheres", createRandomSpheres(100000, &m2s, &m2m, &m6s), camera, 2);
+    return 0;
+    */
+
+    /*
+    benchmarkRenderScaling(raytracer, camera, sampler);
+    return 0;
+    */
+
+#if defined(RAY_GATHER_PERF_STATS)
+    //perf::gGlobalPerfStats.recordTraceEvents(100000, 64);
+#endif
+
     Image img = raytracer.capture(camera, sampler);
     //Image img = raytracer.capture(camera);
+    //Image img = raytracer.captureWavefront(camera, sampler, std::execution::par_unseq);
+
+#if defined(RAY_GATHER_PERF_STATS)
+    /*
+    // shows where the time is spent instead of the render
+    perf::PixelCostMap costs(width, height);
+    img = raytracer.capture(camera, sampler, std::execution::par_unseq, costs);
+    img = costs.falseColor(perf::PixelCostChannel::Time, true);
+    */
+#endif
 
 #if defined(RAY_GATHER_PERF_STATS)
     perf::gGlobalPerfStats.collect(); // threads are in a pool, may not have ended
     std::cout << perf::gGlobalPerfStats.summary();
+    //std::ofstream("trace.json") << perf::gGlobalPerfStats.chromeTrace(); // open in chrome://tracing
 #else
     auto t1 = std::chrono::high_resolution_clock().now();
     auto diff = t1 - t0;
@@ -538,6 +681,28 @@ int __cdecl main()
     std::cout << raycast(Ray(O, UnitVec3f(0, 0, -1)), Sphere(O, 6.0f)).value().point.z;
     */
 
+    /*
+    ProgressiveRenderSession session(raytracer, camera);
+    ProgressiveRenderSession::Budget budget;
+    budget.maxNumSamples = 64;
+    budget.maxTime = std::chrono::milliseconds(30);
+    for (;;)
+    {
+        sf::Event e;
+        while (window.pollEvent(e));
+
+        if (!session.isFinished(budget))
+        {
+            (void)session.render(budget);
+            texture.loadFromImage(session.image().toSfImage());
+        }
+
+        window.clear();
+        window.draw(sprite);
+        window.display();
+    }
+    */
+
     for (;;)
     {
         sf::Event e;
@@ -5,6 +5,8 @@
 #include <ray/math/Vec2.h>
 #include <ray/math/Vec3.h>
 
+#include <ray/utility/IntRange2.h>
+
 #include <ray/Viewport.h>
 
 #include <algorithm>
@@ -60,7 +62,7 @@ namespace ray
             auto range = IntRange2(Point2i(vp.widthPixels, vp.heightPixels));
             std::for_each(exec, range.begin(), range.end(), [&](const Point2i& xyi) {
                 auto[x, y] = xyi;
-                func(vp.rayAt(static_cast<float>(x), static_cast<float>(y)), x, y);
+                func(vp.rayAt(Point2f(static_cast<float>(x), static_cast<float>(y))), x, y);
             });
         }
 
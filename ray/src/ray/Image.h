@@ -4,7 +4,9 @@
 
 #include <ray/utility/Array2.h>
 
+#if !defined(RAY_NO_SFML)
 #include <SFML/Graphics/Image.hpp>
+#endif
 
 #include <cstdint>
 #include <vector>
@@ -31,6 +33,7 @@ namespace ray
             return m_pixelColors(x, y);
         }
 
+#if !defined(RAY_NO_SFML)
         [[nodiscard]] sf::Image toSfImage() const
         {
             auto pixels = rawRGBAi();
@@ -40,6 +43,7 @@ namespace ray
 
             return img;
         }
+#endif
 
         [[nodiscard]] std::vector<std::uint8_t> rawRGBAi() const
         {
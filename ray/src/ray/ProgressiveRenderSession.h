@@ -0,0 +1,183 @@
+#pragma once
+
+#if defined(RAY_GATHER_PERF_STATS)
+#include <ray/perf/PerformanceStats.h>
+#endif
+
+#include <ray/material/Color.h>
+
+#include <ray/math/Vec2.h>
+
+#include <ray/utility/Array2.h>
+
+#include <ray/Camera.h>
+#include <ray/Image.h>
+#include <ray/Raytracer.h>
+#include <ray/TileScheduler.h>
+
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <limits>
+
+namespace ray
+{
+    // Renders an image incrementally, one sample per pixel per pass.
+    // Passes are summed in an accumulation buffer so the image can be polled at any time.
+    // The first pass samples pixel centers, later passes are jittered within the pixel.
+    struct ProgressiveRenderSession
+    {
+        struct Budget
+        {
+            Budget() {}
+
+            // total number of samples per pixel after which no more passes are rendered
+            int maxNumSamples = std::numeric_limits<int>::max();
+
+            // time available for a single call to render
+            std::chrono::nanoseconds maxTime = std::chrono::nanoseconds::max();
+        };
+
+        ProgressiveRenderSession(const Raytracer& raytracer, const Camera& camera, std::uint64_t seed = 0) :
+            m_raytracer(&raytracer),
+            m_camera(camera),
+            m_accumulated(camera.width(), camera.height(), ColorRGBf{}),
+            m_numSamples(0),
+            m_seed(seed)
+        {
+        }
+
+        // Discards all accumulated samples.
+        void reset()
+        {
+            m_accumulated = Array2<ColorRGBf>(m_camera.width(), m_camera.height(), ColorRGBf{});
+            m_numSamples = 0;
+        }
+
+        void reset(const Camera& camera)
+        {
+            m_camera = camera;
+            reset();
+        }
+
+        // exec is either a standard execution policy or a TileScheduler.
+        template <typename ExecT = std::execution::parallel_unsequenced_policy>
+        void renderPass(ExecT exec = ExecT{})
+        {
+
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t0 = std::chrono::high_resolution_clock().now();
+#endif
+
+            const Viewport vp = m_camera.viewport();
+            const std::uint64_t pass = static_cast<std::uint64_t>(m_numSamples);
+
+            forEachPixel(exec, Point2i(vp.widthPixels, vp.heightPixels), [&](const Point2i& xyi) {
+                auto[xi, yi] = xyi;
+                const Point2f xyf(static_cast<float>(xi), static_cast<float>(yi));
+                const Vec2f offset = pass == 0 ? Vec2f(0.0f, 0.0f) : chooseOffset(xyi, pass);
+                m_accumulated(xi, yi) += m_raytracer->tracePrimary(vp.rayAt(xyf + offset));
+            });
+
+            ++m_numSamples;
+
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t1 = std::chrono::high_resolution_clock().now();
+            perf::gThreadLocalPerfStats.addTraceTime(t1 - t0);
+#endif
+        }
+
+        // Renders passes until the budget is exhausted, returns the number of passes rendered.
+        // A pass is not started if judging by the previous one it would not fit in the time left,
+        // but unless the sample budget is already reached at least one pass is always rendered.
+        template <typename ExecT = std::execution::parallel_unsequenced_policy>
+        int render(const Budget& budget, ExecT exec = ExecT{})
+        {
+            const auto start = std::chrono::steady_clock::now();
+            std::chrono::nanoseconds lastPassTime(0);
+            int numPasses = 0;
+            while (!isFinished(budget))
+            {
+                const auto passStart = std::chrono::steady_clock::now();
+                if (numPasses > 0 && (passStart - start) + lastPassTime > budget.maxTime)
+                {
+                    break;
+                }
+
+                renderPass(exec);
+                ++numPasses;
+
+                lastPassTime = std::chrono::steady_clock::now() - passStart;
+            }
+
+            return numPasses;
+        }
+
+        [[nodiscard]] bool isFinished(const Budget& budget) const
+        {
+            return m_numSamples >= budget.maxNumSamples;
+        }
+
+        [[nodiscard]] int numSamples() const
+        {
+            return m_numSamples;
+        }
+
+        [[nodiscard]] const Camera& camera() const
+        {
+            return m_camera;
+        }
+
+        // Average of the accumulated samples, gamma corrected the same way as Raytracer::capture.
+        [[nodiscard]] Image image() const
+        {
+            const int w = m_accumulated.width();
+            const int h = m_accumulated.height();
+            Image img(w, h);
+            if (m_numSamples == 0)
+            {
+                return img;
+            }
+
+            const float gamma = m_raytracer->options().gamma;
+            const float invNumSamples = 1.0f / static_cast<float>(m_numSamples);
+            for (int x = 0; x < w; ++x)
+            {
+                for (int y = 0; y < h; ++y)
+                {
+                    img(x, y) = ColorRGBi((m_accumulated(x, y) * invNumSamples) ^ gamma);
+                }
+            }
+
+            return img;
+        }
+
+    private:
+        const Raytracer* m_raytracer;
+        Camera m_camera;
+        Array2<ColorRGBf> m_accumulated;
+        int m_numSamples;
+        std::uint64_t m_seed;
+
+        [[nodiscard]] static float toOffset(std::uint64_t idx)
+        {
+            idx = (idx ^ (idx >> 30)) * 0xbf58476d1ce4e5b9ull;
+            idx = (idx ^ (idx >> 27)) * 0x94d049bb133111ebull;
+            idx = idx ^ (idx >> 31);
+
+            // top 24 bits mapped to [-0.5, 0.5)
+            return static_cast<float>(idx >> 40) * (1.0f / static_cast<float>(1 << 24)) - 0.5f;
+        }
+
+        [[nodiscard]] Vec2f chooseOffset(const Point2i& pixel, std::uint64_t pass) const
+        {
+            const std::uint64_t x = static_cast<std::uint64_t>(pixel.x) & 0xFFFFFu;
+            const std::uint64_t y = static_cast<std::uint64_t>(pixel.y) & 0xFFFFFu;
+            const std::uint64_t idx = (((pass << 20u) | x) << 20u | y) ^ m_seed;
+            return Vec2f(
+                toOffset(idx),
+                toOffset(~idx)
+            );
+        }
+    };
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <ray/material/Color.h>
+
+#include <ray/math/Ray.h>
+#include <ray/math/Vec3.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ray
+{
+    struct HomogeneousSceneObjectCollection;
+    struct LightHandle;
+
+    // A ray waiting to be traced by the wavefront tracer
+    // together with everything needed to continue the path it is a part of.
+    struct QueuedRay
+    {
+        Ray ray;
+
+        // What the color found by the ray is multiplied by before being added to the sample.
+        ColorRGBf weight;
+
+        // Same as the one passed down by the recursive tracer, used for pruning.
+        // Doesn't include surface colors so it's not the same as the weight.
+        ColorRGBf contribution;
+
+        // The object the ray was spawned from, for local continuation.
+        const HomogeneousSceneObjectCollection* prevOwner;
+        int prevShapeNo;
+
+        int pixelNo; // in the tile, the color is added there
+        int depth;
+        bool isInside;
+        bool isPrevLocallyContinuable;
+    };
+
+    // Ray from a hit point towards the center of a light.
+    struct QueuedShadowRay
+    {
+        Ray ray;
+
+        // Already includes the cosine term.
+        ColorRGBf weight;
+
+        const LightHandle* light;
+        int pixelNo; // in the tile, the color is added there
+        int depth;
+    };
+
+    enum struct RaySorting
+    {
+        None,
+
+        // by direction octant
+        Octant,
+
+        // by direction octant and then by the morton code of the origin
+        OctantMorton
+    };
+
+    // Index of the octant the direction points to, rays in the same octant
+    // visit bvh nodes in the same order.
+    [[nodiscard]] inline int directionOctant(const UnitVec3f& direction)
+    {
+        return
+            (direction.x < 0.0f ? 1 : 0)
+            | (direction.y < 0.0f ? 2 : 0)
+            | (direction.z < 0.0f ? 4 : 0);
+    }
+
+    // Spreads the lower 10 bits so that there are 2 zero bits between each.
+    [[nodiscard]] inline std::uint32_t spreadBits3(std::uint32_t v)
+    {
+        v &= 0x3FF;
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    // 30 bit morton code of a point in [0, 1024)^3.
+    [[nodiscard]] inline std::uint32_t mortonCode(std::uint32_t x, std::uint32_t y, std::uint32_t z)
+    {
+        return spreadBits3(x) | (spreadBits3(y) << 1) | (spreadBits3(z) << 2);
+    }
+
+    // Groups rays with similar directions, and with OctantMorton also nearby origins, together
+    // so that consecutive rays traverse similar parts of the scene.
+    // Order within a group is kept.
+    template <typename QueuedRayT>
+    void sortForCoherence(std::vector<QueuedRayT>& rays, RaySorting sorting)
+    {
+        if (sorting == RaySorting::None || rays.size() < 2) return;
+
+        if (sorting == RaySorting::Octant)
+        {
+            std::stable_sort(rays.begin(), rays.end(), [](const QueuedRayT& lhs, const QueuedRayT& rhs) {
+                return directionOctant(lhs.ray.direction()) < directionOctant(rhs.ray.direction());
+            });
+            return;
+        }
+
+        // Origins are quantized to a 1024^3 grid over their bounds.
+        Point3f min = rays.front().ray.origin();
+        Point3f max = min;
+        for (const QueuedRayT& r : rays)
+        {
+            min = Point3f::blend(min, r.ray.origin(), r.ray.origin() < min);
+            max = Point3f::blend(max, r.ray.origin(), r.ray.origin() > max);
+        }
+        const Vec3f extent = max - min;
+        auto scale = [](float e) {
+            return e > 0.0f ? 1023.0f / e : 0.0f;
+        };
+        const Vec3f invCellSize(scale(extent.x), scale(extent.y), scale(extent.z));
+
+        // octant in the 3 bits above the 30 bit morton code, 33 bits in total
+        std::vector<std::pair<std::uint64_t, int>> keys;
+        keys.reserve(rays.size());
+        for (int i = 0; i < static_cast<int>(rays.size()); ++i)
+        {
+            const Vec3f cell = (rays[i].ray.origin() - min) * invCellSize;
+            const std::uint64_t key =
+                (static_cast<std::uint64_t>(directionOctant(rays[i].ray.direction())) << 30)
+                | mortonCode(static_cast<std::uint32_t>(cell.x), static_cast<std::uint32_t>(cell.y), static_cast<std::uint32_t>(cell.z));
+            keys.emplace_back(key, i);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<QueuedRayT> sorted;
+        sorted.reserve(rays.size());
+        for (const auto& key : keys)
+        {
+            sorted.emplace_back(std::move(rays[key.second]));
+        }
+        rays = std::move(sorted);
+    }
+
+    // Rays of one wavefront, each kind is intersected and shaded in bulk.
+    struct RayQueues
+    {
+        std::vector<QueuedRay> primary;
+        std::vector<QueuedRay> reflection;
+        std::vector<QueuedRay> refraction;
+        std::vector<QueuedShadowRay> shadow;
+
+        [[nodiscard]] bool empty() const
+        {
+            return primary.empty() && reflection.empty() && refraction.empty() && shadow.empty();
+        }
+
+        void clear()
+        {
+            primary.clear();
+            reflection.clear();
+            refraction.clear();
+            shadow.clear();
+        }
+    };
+}
@@ -2,14 +2,19 @@
 
 #if defined(RAY_GATHER_PERF_STATS)
 #include <ray/perf/PerformanceStats.h>
+#include <ray/perf/PixelCostMap.h>
 #endif
 
+#include <ray/math/Float4.h>
+#include <ray/math/RayPacket4.h>
+#include <ray/math/Raycast.h>
 #include <ray/math/Vec2.h>
 #include <ray/math/Vec3.h>
 
 #include <ray/sampler/Sampler.h>
 
 #include <ray/scene/LightHandle.h>
+#include <ray/scene/LightTree.h>
 #include <ray/scene/Scene.h>
 #include <ray/scene/SceneRaycastHit.h>
 
@@ -17,43 +22,96 @@
 
 #include <ray/Camera.h>
 #include <ray/Image.h>
+#include <ray/RayQueue.h>
+#include <ray/TileScheduler.h>
+#include <ray/Viewport.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace ray
 {
-    struct Raytracer
+    namespace detail
     {
-        struct Options
-        {
-            Options() {}
-
-            // Used to ensure for example that the hit point is
-            // not considered obstructed by the shape it is on
-            // due to floating point inaccuracies
-            float paddingDistance = 0.002f;
-            int maxRayDepth = 5;
-            
-            // smallest transparenct that is not considered zero
-            float transparencyThreshold = 0.01f;
-            
-            // smallest reflectivity that is still considered reflective
-            float reflectivityThreshold = 0.01f;
-            
-            // smallest diffuse that makes it trace shadow ray
-            float diffuseThreshold = 0.0f;
-            
-            // if raytrace is known to result in less contribution to the final
-            // result then the raytrace may be pruned
-            float contributionThreshold = 0.01f;
-
-            // not sure if it should be used
-            float gamma = 0.43f;
-
-            // if true allows local continuation of tracing
-            // when inside a volumetric shape
-            bool assumeNoVolumeIntersections = false;
-        };
-
-        Raytracer(const Scene& scene, const Options& options = {}) noexcept :
+        template <typename SamplerT, typename = void>
+        struct SupportsPacketSampling : std::false_type {};
+
+        template <typename SamplerT>
+        struct SupportsPacketSampling<
+            SamplerT,
+            std::void_t<decltype(std::declval<const SamplerT&>().forEachSamplePacket(
+                std::declval<const Camera&>(),
+                std::declval<std::array<ColorRGBf, RayPacket4::numRays>(*)(const RayPacket4&, std::uint8_t)>(),
+                std::declval<void(*)(const Point2i&, const ColorRGBf&)>()
+            ))>
+        > : std::true_type {};
+    }
+
+    struct RaytracerOptions
+    {
+        RaytracerOptions() {}
+
+        // Used to ensure for example that the hit point is
+        // not considered obstructed by the shape it is on
+        // due to floating point inaccuracies
+        float paddingDistance = 0.002f;
+        int maxRayDepth = 5;
+        
+        // smallest transparenct that is not considered zero
+        float transparencyThreshold = 0.01f;
+        
+        // smallest reflectivity that is still considered reflective
+        float reflectivityThreshold = 0.01f;
+        
+        // smallest diffuse that makes it trace shadow ray
+        float diffuseThreshold = 0.0f;
+        
+        // if raytrace is known to result in less contribution to the final
+        // result then the raytrace may be pruned
+        float contributionThreshold = 0.01f;
+
+        // if true lights are not traced while the sum of their possible contributions
+        // stays below contributionThreshold, so the skipped lights together
+        // change the color by at most contributionThreshold
+        bool cullDimLights = false;
+
+        // if true reflection and refraction rays below contributionThreshold are not always pruned
+        // but survive with probability proportional to their contribution
+        // survivors are weighted up so that on average the color is the same as without pruning
+        // the decision is a hash of the ray so renders are repeatable
+        bool useRussianRoulette = false;
+
+        // not sure if it should be used
+        float gamma = 0.43f;
+
+        // if true allows local continuation of tracing
+        // when inside a volumetric shape
+        bool assumeNoVolumeIntersections = false;
+
+        // if true primary rays are traced in packets of 4 when the sampler supports it
+        // secondary rays are always traced one by one
+        // captureWavefront always uses packets
+        bool usePrimaryRayPackets = false;
+
+        // how captureWavefront orders secondary and shadow rays before tracing them
+        // primary rays are traced in tile order
+        RaySorting secondaryRaySorting = RaySorting::OctantMorton;
+    };
+
+    // SceneT is either Scene, then all scene queries are virtual calls,
+    // or a concrete scene type, then they can be inlined into trace.
+    template <typename SceneT>
+    struct BasicRaytracer
+    {
+        using Options = RaytracerOptions;
+
+        BasicRaytracer(const SceneT& scene, const Options& options = {}) noexcept :
             m_scene(&scene),
             m_options(options)
         {
@@ -61,6 +119,145 @@ namespace ray
 
         template <typename SamplerT = Sampler>
         [[nodiscard]] Image capture(const Camera& camera, const SamplerT& sampler = SamplerT{}) const
+        {
+            return capture(camera, sampler, std::execution::par_unseq);
+        }
+
+        // exec is either a standard execution policy or a TileScheduler.
+        template <typename SamplerT, typename ExecT>
+        [[nodiscard]] Image capture(const Camera& camera, const SamplerT& sampler, ExecT exec) const
+        {
+            auto traceFunc = [&](const Ray& ray) {
+                return trace(ray, ColorRGBf(1.0f, 1.0f, 1.0f));
+            };
+            auto tracePacketFunc = [&](const RayPacket4& rays, std::uint8_t activeMask) {
+                return tracePacket(rays, activeMask);
+            };
+
+            return captureWith(camera, sampler, exec, traceFunc, tracePacketFunc);
+        }
+
+#if defined(RAY_GATHER_PERF_STATS)
+        // Same as capture, additionally the work done for each primary ray
+        // is attributed to the pixel of costs it passes through.
+        template <typename SamplerT, typename ExecT>
+        [[nodiscard]] Image capture(const Camera& camera, const SamplerT& sampler, ExecT exec, perf::PixelCostMap& costs) const
+        {
+            const Viewport vp = camera.viewport();
+
+            auto traceFunc = [&](const Ray& ray) {
+                const perf::WorkCounters work = perf::gThreadLocalPerfStats.workCounters();
+                const auto t0 = std::chrono::high_resolution_clock().now();
+                const ColorRGBf color = trace(ray, ColorRGBf(1.0f, 1.0f, 1.0f));
+                const auto t1 = std::chrono::high_resolution_clock().now();
+                costs.add(vp, &ray, 1, perf::gThreadLocalPerfStats.workCounters() - work, t1 - t0);
+                return color;
+            };
+            auto tracePacketFunc = [&](const RayPacket4& rays, std::uint8_t activeMask) {
+                const perf::WorkCounters work = perf::gThreadLocalPerfStats.workCounters();
+                const auto t0 = std::chrono::high_resolution_clock().now();
+                const auto colors = tracePacket(rays, activeMask);
+                const auto t1 = std::chrono::high_resolution_clock().now();
+                // active lanes are moved to the front
+                std::array<Ray, RayPacket4::numRays> lanes = { rays.ray(0), rays.ray(1), rays.ray(2), rays.ray(3) };
+                int numActive = 0;
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    if (activeMask & (1 << lane))
+                    {
+                        lanes[numActive++] = rays.ray(lane);
+                    }
+                }
+                costs.add(vp, lanes.data(), numActive, perf::gThreadLocalPerfStats.workCounters() - work, t1 - t0);
+                return colors;
+            };
+
+            return captureWith(camera, sampler, exec, traceFunc, tracePacketFunc);
+        }
+#endif
+
+        // Same result as capture, up to rounding, but instead of following each path recursively
+        // all rays of a tile at the same depth are traced together.
+        // The colors along a path are summed in a different order, pixels can differ by an 8 bit step or two.
+        // Rays are intersected in bulk, in packets of 4, after secondary rays
+        // are sorted according to Options::secondaryRaySorting.
+        // Then all hits are shaded, which produces the rays for the next depth.
+        // Needs a sampler with fixed sample offsets, adaptive samplers can't be used.
+        // exec is either a standard execution policy or a TileScheduler.
+        template <typename SamplerT, typename ExecT>
+        [[nodiscard]] Image captureWavefront(const Camera& camera, const SamplerT& sampler, ExecT exec) const
+        {
+            Image img(camera.width(), camera.height());
+            const Viewport vp = camera.viewport();
+
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t0 = std::chrono::high_resolution_clock().now();
+#endif
+
+            forEachTile(exec, Point2i(vp.widthPixels, vp.heightPixels), [&](const Tile& tile) {
+                const int tileHeight = tile.max.y - tile.min.y;
+                std::vector<ColorRGBf> colors((tile.max.x - tile.min.x) * tileHeight);
+
+                RayQueues queues;
+                for (int x = tile.min.x; x < tile.max.x; ++x)
+                {
+                    for (int y = tile.min.y; y < tile.max.y; ++y)
+                    {
+                        const Point2f xyf(static_cast<float>(x), static_cast<float>(y));
+                        const int pixelNo = (x - tile.min.x) * tileHeight + (y - tile.min.y);
+                        sampler.forEachSampleOffset(Point2i(x, y), [&](const Vec2f& offset, float c) {
+                            queues.primary.push_back(QueuedRay{
+                                vp.rayAt(xyf + offset),
+                                ColorRGBf(c, c, c),
+                                ColorRGBf(1.0f, 1.0f, 1.0f),
+                                nullptr,
+                                0,
+                                pixelNo,
+                                0,
+                                false,
+                                false
+                            });
+                        });
+                    }
+                }
+
+                traceWavefront(queues, colors);
+
+                for (int x = tile.min.x; x < tile.max.x; ++x)
+                {
+                    for (int y = tile.min.y; y < tile.max.y; ++y)
+                    {
+                        const int pixelNo = (x - tile.min.x) * tileHeight + (y - tile.min.y);
+                        img(x, y) = ColorRGBi(colors[pixelNo] ^ m_options.gamma);
+                    }
+                }
+            });
+
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t1 = std::chrono::high_resolution_clock().now();
+            perf::gThreadLocalPerfStats.addTraceTime(t1 - t0);
+#endif
+
+            return img;
+        }
+
+        // Traces a single primary ray, for rendering driven from outside of capture.
+        [[nodiscard]] ColorRGBf tracePrimary(const Ray& ray) const
+        {
+            return trace(ray, ColorRGBf(1.0f, 1.0f, 1.0f));
+        }
+
+        [[nodiscard]] const Options& options() const
+        {
+            return m_options;
+        }
+
+    private:
+        const SceneT* m_scene;
+        Options m_options;
+
+        template <typename SamplerT, typename ExecT, typename TraceFuncT, typename TracePacketFuncT>
+        [[nodiscard]] Image captureWith(const Camera& camera, const SamplerT& sampler, ExecT exec, TraceFuncT&& traceFunc, TracePacketFuncT&& tracePacketFunc) const
         {
             Image img(camera.width(), camera.height());
 
@@ -73,16 +270,25 @@ namespace ray
                 img(x, y) = ColorRGBi(trace(ray, ColorRGBf(1.0f, 1.0f, 1.0f)) ^ m_options.gamma);
                 }, std::execution::par_unseq);
                 */
-            sampler.forEachSample(
-                camera,
-                [&](const Ray& ray) {
-                    return trace(ray, ColorRGBf(1.0f, 1.0f, 1.0f));
-                },
-                [&](const Point2i& imgCoords, const ColorRGBf& color) {
-                    img(imgCoords.x, imgCoords.y) = ColorRGBi(color ^ m_options.gamma);
-                },
-                std::execution::par_unseq
-            );
+            auto storeFunc = [&](const Point2i& imgCoords, const ColorRGBf& color) {
+                img(imgCoords.x, imgCoords.y) = ColorRGBi(color ^ m_options.gamma);
+            };
+
+            if constexpr (detail::SupportsPacketSampling<SamplerT>::value)
+            {
+                if (m_options.usePrimaryRayPackets)
+                {
+                    sampler.forEachSamplePacket(camera, tracePacketFunc, storeFunc, exec);
+                }
+                else
+                {
+                    sampler.forEachSample(camera, traceFunc, storeFunc, exec);
+                }
+            }
+            else
+            {
+                sampler.forEachSample(camera, traceFunc, storeFunc, exec);
+            }
 
 #if defined(RAY_GATHER_PERF_STATS)
             auto t1 = std::chrono::high_resolution_clock().now();
@@ -93,10 +299,6 @@ namespace ray
             return img;
         }
 
-    private:
-        const Scene* m_scene;
-        Options m_options;
-
         [[nodiscard]] ColorRGBf trace(const Ray& ray, const ColorRGBf& contribution, int depth = 0, const ResolvedRaycastHit* prevHit = nullptr, bool isInside = false) const
         {
 
@@ -127,18 +329,65 @@ namespace ray
             }
             if (!anyHit)
             {
-                const MediumMaterial* medium = m_scene->mediumMaterial();
-                if (medium)
+                return missColor();
+            }
+
+            return shade(ray, rhit, contribution, depth, prevHit, isInside);
+        }
+
+        // Traces primary rays of the packet together.
+        // Secondary rays spawned from the hits are traced one by one.
+        // Lanes not in activeMask only pad the packet, they are not shaded and their colors are unspecified.
+        [[nodiscard]] std::array<ColorRGBf, RayPacket4::numRays> tracePacket(const RayPacket4& rays, std::uint8_t activeMask) const
+        {
+
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::gThreadLocalPerfStats.addTrace(0, numLanes(activeMask));
+#endif
+
+            ResolvableRaycastHitPacket4 hits;
+            for (auto& hit : hits.hits)
+            {
+                hit.dist = std::numeric_limits<float>::max();
+            }
+            const std::uint8_t hitMask = m_scene->queryNearest(rays, activeMask, hits);
+
+            std::array<ColorRGBf, RayPacket4::numRays> colors{};
+            for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+            {
+                if ((activeMask & (1 << lane)) == 0) continue;
+
+                if (hitMask & (1 << lane))
                 {
-                    return m_scene->backgroundColor() * exp(-medium->absorbtion * m_scene->backgroundDistance());
+                    colors[lane] = shade(rays.ray(lane), hits[lane], ColorRGBf(1.0f, 1.0f, 1.0f), 0, nullptr, false);
                 }
                 else
                 {
-                    return m_scene->backgroundColor();
+                    colors[lane] = missColor();
                 }
             }
 
+            return colors;
+        }
+
+        [[nodiscard]] ColorRGBf missColor() const
+        {
+            const MediumMaterial* medium = m_scene->mediumMaterial();
+            if (medium)
+            {
+                return m_scene->backgroundColor() * exp(-medium->absorbtion * m_scene->backgroundDistance());
+            }
+            else
+            {
+                return m_scene->backgroundColor();
+            }
+        }
+
+        [[nodiscard]] ColorRGBf shade(const Ray& ray, const ResolvableRaycastHit& rhit, const ColorRGBf& contribution, int depth, const ResolvedRaycastHit* prevHit, bool isInside) const
+        {
+
 #if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Shading);
             perf::gThreadLocalPerfStats.addTraceHit(depth);
             perf::gThreadLocalPerfStats.addTraceResolved(depth);
 #endif
@@ -147,21 +396,7 @@ namespace ray
 
             const float reflectionContribution = fresnelReflectAmount(ray, hit);
             const float refractionContribution = ((1.0f - reflectionContribution) * hit.transparency);
-
-            ColorRGBf unabsorbed(1.0f, 1.0f, 1.0f);
-            if (isInside && prevHit && hit.mediumMaterial)
-            {
-                unabsorbed = exp(-hit.mediumMaterial->absorbtion * hit.dist);
-            }
-            else if (!isInside)
-            {
-                const MediumMaterial* airMedium = m_scene->mediumMaterial();
-                if (airMedium)
-                {
-                    // we're going through air
-                    unabsorbed = exp(-airMedium->absorbtion * hit.dist);
-                }
-            }
+            const ColorRGBf unabsorbed = unabsorbedAlong(hit, isInside, prevHit != nullptr);
 
             const ColorRGBf refractionColor = computeRefractionColor(ray, contribution * unabsorbed * refractionContribution, prevHit, hit, depth);
             const ColorRGBf reflectionColor = computeReflectionColor(ray, contribution * unabsorbed * reflectionContribution, prevHit, hit, depth);
@@ -177,6 +412,33 @@ namespace ray
             return color * unabsorbed;
         }
 
+        // Fraction of the light that is not absorbed by the medium on the way to the hit.
+        [[nodiscard]] ColorRGBf unabsorbedAlong(const ResolvedRaycastHit& hit, bool isInside, bool hasPrevHit) const
+        {
+            if (isInside && hasPrevHit && hit.mediumMaterial)
+            {
+                return exp(-hit.mediumMaterial->absorbtion * hit.dist);
+            }
+            else if (!isInside)
+            {
+                return unabsorbedByAir(hit);
+            }
+
+            return ColorRGBf(1.0f, 1.0f, 1.0f);
+        }
+
+        [[nodiscard]] ColorRGBf unabsorbedByAir(const ResolvedRaycastHit& hit) const
+        {
+            const MediumMaterial* airMedium = m_scene->mediumMaterial();
+            if (airMedium)
+            {
+                // we're going through air
+                return exp(-airMedium->absorbtion * hit.dist);
+            }
+
+            return ColorRGBf(1.0f, 1.0f, 1.0f);
+        }
+
         [[nodiscard]] ColorRGBf combine(
             const ResolvedRaycastHit& hit, 
             const ColorRGBf& refractionColor, 
@@ -200,8 +462,10 @@ namespace ray
             if (hit.isInside) std::swap(n1, n2);
 
             // Schlick aproximation
+            // Normals are not always exactly unit length, for example interpolated ones,
+            // which could put the cosine, and the returned amount, outside of [0, 1].
             const float r0 = sqr((n1 - n2) / (n1 + n2));
-            float cosX = dot(hit.normal, ray.direction());
+            float cosX = std::clamp(dot(hit.normal, ray.direction()), -1.0f, 1.0f);
             if (n1 > n2)
             {
                 const float n = n1 / n2;
@@ -231,64 +495,218 @@ namespace ray
 
             if (contribution.max() < m_options.contributionThreshold) return {};
 
-            const auto& lights = m_scene->lights();
-            const Point3f point = hit.point + hit.normal * m_options.paddingDistance;
-
 #if defined(RAY_GATHER_PERF_STATS)
-            perf::gThreadLocalPerfStats.addTrace(depth, lights.size());
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::ShadowRays);
 #endif
 
+            const Point3f point = shadowRayOrigin(hit);
+            const ColorRGBf unabsorbed = unabsorbedByAir(hit);
+
+            // Shadow rays towards up to 4 lights are tested for occlusion together.
             ColorRGBf color{};
-            ResolvableRaycastHit rhit;
-            rhit.dist = std::numeric_limits<float>::max();
-            const MediumMaterial* airMedium = m_scene->mediumMaterial();
-            for (const auto& light : lights)
+            std::array<const LightHandle*, RayPacket4::numRays> packetLights;
+            int numPacketLights = 0;
+            auto flush = [&]() {
+                // lanes past the last light repeat it
+                auto shadowRay = [&](int i) {
+                    return Ray::between(point, packetLights[std::min(i, numPacketLights - 1)]->center());
+                };
+                const RayPacket4 rays(shadowRay(0), shadowRay(1), shadowRay(2), shadowRay(3));
+                const auto emissions = traceShadowRays(rays, packetLights.data(), numPacketLights, depth);
+                for (int lane = 0; lane < numPacketLights; ++lane)
+                {
+                    color += emissions[lane] * std::max(0.0f, dot(hit.normal, rays.ray(lane).direction()));
+                }
+                numPacketLights = 0;
+            };
+            forEachContributingLight(contribution, hit, unabsorbed, point, [&](const LightHandle& light) {
+                packetLights[numPacketLights++] = &light;
+                if (numPacketLights == RayPacket4::numRays)
+                {
+                    flush();
+                }
+            });
+            if (numPacketLights > 0)
             {
-                const Ray ray = Ray::between(point, light.center());
-                if (!m_scene->queryNearest(ray, rhit)) continue;
+                flush();
+            }
+
+            return color * unabsorbed * hit.diffuse;
+        }
 
+        [[nodiscard]] Point3f shadowRayOrigin(const ResolvedRaycastHit& hit) const
+        {
+            return hit.point + hit.normal * m_options.paddingDistance;
+        }
+
+        // Lights entirely behind the surface are skipped, they can't contribute.
+        // With Options::cullDimLights lights are also skipped while the sum of their upper bounds
+        // on the contribution to the final color stays below contributionThreshold.
+        // The bounds ignore occlusion, it can only make the contribution smaller.
+        template <typename FuncT>
+        void forEachContributingLight(const ColorRGBf& contribution, const ResolvedRaycastHit& hit, const ColorRGBf& unabsorbed, const Point3f& point, FuncT&& func) const
+        {
+            const float maxScale = contribution.max() * hit.diffuse * unabsorbed.max();
+            if (maxScale <= 0.0f) return;
+
+            const float maxCulledEmission = m_options.cullDimLights ? m_options.contributionThreshold / maxScale : 0.0f;
+            m_scene->lightTree().forEachLight(point, hit.normal, maxCulledEmission, std::forward<FuncT>(func));
+        }
+
+        // Emission reaching the origins of the first numRays rays from the lights they point to,
+        // zero for lights that are occluded or missed.
+        // A light is visible if nothing is hit before reaching the light object itself.
+        [[nodiscard]] std::array<ColorRGBf, RayPacket4::numRays> traceShadowRays(const RayPacket4& rays, const LightHandle* const* lights, int numRays, int depth) const
+        {
 #if defined(RAY_GATHER_PERF_STATS)
-                perf::gThreadLocalPerfStats.addTraceHit(depth);
+            perf::gThreadLocalPerfStats.addTrace(depth, numRays);
 #endif
 
-                if (rhit.objectId() != light.id()) continue;
+            std::array<ResolvableRaycastHit, RayPacket4::numRays> lightHits;
+            Float4 maxDists{};
+            std::uint8_t lightHitMask = 0;
+            std::uint8_t queryMask = 0;
+            for (int lane = 0; lane < numRays; ++lane)
+            {
+                lightHits[lane].dist = std::numeric_limits<float>::max();
+                if (!lights[lane]->raycast(rays.ray(lane), lightHits[lane])) continue;
+
+                lightHitMask |= 1 << lane;
+                maxDists.v[lane] = lightHits[lane].dist - m_options.paddingDistance;
+                if (maxDists.v[lane] > 0.0f)
+                {
+                    queryMask |= 1 << lane;
+                }
+            }
 
 #if defined(RAY_GATHER_PERF_STATS)
-                perf::gThreadLocalPerfStats.addTraceResolved(depth);
+            for (int lane = 0; lane < numRays; ++lane)
+            {
+                if (lightHitMask & (1 << lane)) perf::gThreadLocalPerfStats.addTraceHit(depth);
+            }
 #endif
 
-                ColorRGBf unabsorbed(1.0f, 1.0f, 1.0f);
-                if (airMedium)
+            std::uint8_t occludedMask = 0;
+            if (numLanes(queryMask) <= 1)
+            {
+                // at most one lane, a packet would only add overhead
+                for (int lane = 0; lane < numRays; ++lane)
                 {
-                    // we're going through air
-                    unabsorbed = exp(-airMedium->absorbtion * hit.dist);
+                    if ((queryMask & (1 << lane)) && m_scene->queryAny(rays.ray(lane), maxDists.v[lane]))
+                    {
+                        occludedMask |= 1 << lane;
+                    }
                 }
-                auto lightHit = rhit.resolve();
-                color += lightHit.emissionColor * std::max(0.0f, dot(hit.normal, ray.direction())) * unabsorbed;
+            }
+            else
+            {
+                occludedMask = m_scene->queryAny(rays, queryMask, maxDists);
+            }
+
+            std::array<ColorRGBf, RayPacket4::numRays> emissions{};
+            const std::uint8_t visibleMask = lightHitMask & ~occludedMask;
+            for (int lane = 0; lane < numRays; ++lane)
+            {
+                if ((visibleMask & (1 << lane)) == 0) continue;
+
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::gThreadLocalPerfStats.addTraceResolved(depth);
+#endif
+
+                emissions[lane] = lightHits[lane].resolve().emissionColor;
             }
 
-            return color * hit.diffuse;
+            return emissions;
         }
 
         [[nodiscard]] ColorRGBf computeReflectionColor(const Ray& ray, const ColorRGBf& contribution, const ResolvedRaycastHit* prevHit, const ResolvedRaycastHit& hit, int depth) const
         {
-            if (!isReflective(hit) || depth > m_options.maxRayDepth)
-                return {};
+            if (!isReflective(hit)) return {};
 
-            if (contribution.max() < m_options.contributionThreshold) return {};
+            const Ray nextRay = reflectionRay(ray, hit);
+            const float weight = branchWeight(nextRay, hit, contribution, depth);
+            if (weight == 0.0f) return {};
 
-            const UnitVec3f reflectionDirection = reflection(ray.direction(), hit.normal);
-            const Ray nextRay(hit.point + reflectionDirection * m_options.paddingDistance, reflectionDirection);
-            return trace(nextRay, contribution, depth + 1, &hit, hit.isInside);
+            return trace(nextRay, contribution * weight, depth + 1, &hit, hit.isInside) * weight;
         }
 
         [[nodiscard]] ColorRGBf computeRefractionColor(const Ray& ray, const ColorRGBf& contribution, const ResolvedRaycastHit* prevHit, const ResolvedRaycastHit& hit, int depth) const
         {
-            if (!isTransparent(hit) || depth > m_options.maxRayDepth)
-                return {};
+            if (!isTransparent(hit)) return {};
 
-            if (contribution.max() < m_options.contributionThreshold) return {};
+            bool isInside = hit.isInside;
+            const Ray nextRay = refractionRay(ray, hit, isInside);
+            const float weight = branchWeight(nextRay, hit, contribution, depth);
+            if (weight == 0.0f) return {};
 
+            return trace(nextRay, contribution * weight, depth + 1, &hit, isInside) * weight;
+        }
+
+        // Whether a reflection or refraction ray spawned at a hit at the given depth is traced.
+        // Returns the weight of the branch, 0 if it's not traced.
+        [[nodiscard]] float branchWeight(const Ray& nextRay, const ResolvedRaycastHit& hit, const ColorRGBf& contribution, int depth) const
+        {
+            const int maxDepth = hit.mediumMaterial ? std::min(m_options.maxRayDepth, hit.mediumMaterial->maxRayDepth) : m_options.maxRayDepth;
+            if (depth > maxDepth)
+            {
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::gThreadLocalPerfStats.addDepthCappedBranch(depth + 1);
+#endif
+                return 0.0f;
+            }
+
+            const float c = contribution.max();
+            if (c >= m_options.contributionThreshold) return 1.0f;
+
+            if (m_options.useRussianRoulette && c > 0.0f)
+            {
+                const float survivalProbability = c / m_options.contributionThreshold;
+                if (rouletteSample(nextRay) < survivalProbability) return 1.0f / survivalProbability;
+
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::gThreadLocalPerfStats.addRouletteKill(depth + 1);
+#endif
+                return 0.0f;
+            }
+
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::gThreadLocalPerfStats.addPrunedBranch(depth + 1);
+#endif
+            return 0.0f;
+        }
+
+        // Uniform in [0, 1), the same for the same ray.
+        [[nodiscard]] static float rouletteSample(const Ray& ray)
+        {
+            const float values[] = {
+                ray.origin().x, ray.origin().y, ray.origin().z,
+                ray.direction().x, ray.direction().y, ray.direction().z
+            };
+
+            // FNV-1a over the bits followed by a final mix
+            std::uint32_t hash = 0x811c9dc5u;
+            for (float value : values)
+            {
+                std::uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                hash = (hash ^ bits) * 0x01000193u;
+            }
+            hash ^= hash >> 16;
+            hash *= 0x85ebca6bu;
+            hash ^= hash >> 13;
+
+            return static_cast<float>(hash >> 8) * (1.0f / 16777216.0f);
+        }
+
+        [[nodiscard]] Ray reflectionRay(const Ray& ray, const ResolvedRaycastHit& hit) const
+        {
+            const UnitVec3f reflectionDirection = reflection(ray.direction(), hit.normal);
+            return Ray(hit.point + reflectionDirection * m_options.paddingDistance, reflectionDirection);
+        }
+
+        // isInside is updated to whether the refracted ray is inside of the shape.
+        [[nodiscard]] Ray refractionRay(const Ray& ray, const ResolvedRaycastHit& hit, bool& isInside) const
+        {
             // outside->inside
             if (hit.mediumMaterial)
             {
@@ -299,14 +717,217 @@ namespace ray
 
                 // do outside->inside refraction
                 const UnitVec3f refractionDirection = refraction(ray.direction(), hit.normal, eta);
-                const Ray nextRay(hit.point + refractionDirection * m_options.paddingDistance, refractionDirection);
-                return trace(nextRay, contribution, depth + 1, &hit, hit.hasVolume ? !hit.isInside : hit.isInside);
+                if (hit.hasVolume) isInside = !hit.isInside;
+                return Ray(hit.point + refractionDirection * m_options.paddingDistance, refractionDirection);
             }
             else
             {
                 // if the shape doesn't have volume we don't have to bother with refracting the ray
-                const Ray nextRay = ray.translated(ray.direction() * m_options.paddingDistance);
-                return trace(nextRay, contribution, depth + 1, &hit, hit.isInside);
+                return ray.translated(ray.direction() * m_options.paddingDistance);
+            }
+        }
+
+        // Traces all rays in the queues until no new rays are produced.
+        // Colors found are added to the pixels of the rays.
+        void traceWavefront(RayQueues& queues, std::vector<ColorRGBf>& colors) const
+        {
+            RayQueues next;
+            while (!queues.empty())
+            {
+                sortForCoherence(queues.reflection, m_options.secondaryRaySorting);
+                sortForCoherence(queues.refraction, m_options.secondaryRaySorting);
+                traceQueue(queues.primary, next, colors);
+                traceQueue(queues.reflection, next, colors);
+                traceQueue(queues.refraction, next, colors);
+
+                sortForCoherence(next.shadow, m_options.secondaryRaySorting);
+                traceShadowQueue(next.shadow, colors);
+                next.shadow.clear();
+
+                // reuses the memory of the queues
+                std::swap(queues, next);
+                next.clear();
+            }
+        }
+
+        void traceQueue(std::vector<QueuedRay>& rays, RayQueues& next, std::vector<ColorRGBf>& colors) const
+        {
+            if (rays.empty()) return;
+
+            const int numRays = static_cast<int>(rays.size());
+            std::vector<ResolvableRaycastHit> hits(numRays);
+            std::vector<char> isHit(numRays, false);
+            std::vector<int> fullQueries;
+            fullQueries.reserve(numRays);
+            for (int i = 0; i < numRays; ++i)
+            {
+                QueuedRay& qray = rays[i];
+
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::gThreadLocalPerfStats.addTrace(qray.depth);
+#endif
+
+                hits[i].dist = std::numeric_limits<float>::max();
+                if (qray.isInside && m_options.assumeNoVolumeIntersections && qray.prevOwner && qray.isPrevLocallyContinuable)
+                {
+                    // same as in trace
+                    isHit[i] = qray.prevOwner->queryLocal(qray.ray, qray.prevShapeNo, hits[i]);
+                    if (!isHit[i])
+                    {
+                        qray.isInside = false;
+                    }
+                }
+
+                if (!isHit[i])
+                {
+                    fullQueries.push_back(i);
+                }
+            }
+
+            // Rays in full packets are intersected together, the rest one by one.
+            const int numFullQueries = static_cast<int>(fullQueries.size());
+            const int numPacketQueries = numFullQueries - numFullQueries % RayPacket4::numRays;
+            for (int first = 0; first < numPacketQueries; first += RayPacket4::numRays)
+            {
+                const int* ids = &fullQueries[first];
+                const RayPacket4 packet(rays[ids[0]].ray, rays[ids[1]].ray, rays[ids[2]].ray, rays[ids[3]].ray);
+                ResolvableRaycastHitPacket4 packetHits;
+                for (auto& hit : packetHits.hits)
+                {
+                    hit.dist = std::numeric_limits<float>::max();
+                }
+                const std::uint8_t hitMask = m_scene->queryNearest(packet, RayPacket4::allLanes, packetHits);
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    hits[ids[lane]] = packetHits[lane];
+                    isHit[ids[lane]] = (hitMask & (1 << lane)) != 0;
+                }
+            }
+            for (int j = numPacketQueries; j < numFullQueries; ++j)
+            {
+                const int i = fullQueries[j];
+                isHit[i] = m_scene->queryNearest(rays[i].ray, hits[i]);
+            }
+
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Shading);
+#endif
+
+            for (int i = 0; i < numRays; ++i)
+            {
+                const QueuedRay& qray = rays[i];
+                if (isHit[i])
+                {
+                    shadeQueued(qray, hits[i], next, colors);
+                }
+                else
+                {
+                    colors[qray.pixelNo] += qray.weight * missColor();
+                }
+            }
+        }
+
+        // Same as shade, but instead of tracing the spawned rays they are put into the queues.
+        void shadeQueued(const QueuedRay& qray, const ResolvableRaycastHit& rhit, RayQueues& next, std::vector<ColorRGBf>& colors) const
+        {
+
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::gThreadLocalPerfStats.addTraceHit(qray.depth);
+            perf::gThreadLocalPerfStats.addTraceResolved(qray.depth);
+#endif
+
+            const ResolvedRaycastHit hit = rhit.resolve();
+
+            const float reflectionContribution = fresnelReflectAmount(qray.ray, hit);
+            const float refractionContribution = ((1.0f - reflectionContribution) * hit.transparency);
+            const ColorRGBf unabsorbed = unabsorbedAlong(hit, qray.isInside, qray.depth > 0);
+
+            const ColorRGBf contribution = qray.contribution * unabsorbed;
+            const ColorRGBf weight = qray.weight * unabsorbed;
+            const ColorRGBf surfaceWeight = weight * hit.surfaceColor;
+            colors[qray.pixelNo] += weight * hit.emissionColor;
+
+            const int depth = qray.depth;
+            auto queue = [&](std::vector<QueuedRay>& queue, const Ray& ray, float amount, bool isInside) {
+                const float weight = branchWeight(ray, hit, contribution * amount, depth);
+                if (weight == 0.0f) return;
+
+                // Weights are multiplied top-down, so unlike in trace an overflow isn't
+                // cancelled by a black surface further down. inf * 0 would make the pixel NaN.
+                const ColorRGBf rayWeight = surfaceWeight * (amount * weight);
+                if (!isFinite(rayWeight)) return;
+
+                queue.push_back(QueuedRay{
+                    ray,
+                    rayWeight,
+                    contribution * (amount * weight),
+                    hit.owner,
+                    hit.shapeNo,
+                    qray.pixelNo,
+                    depth + 1,
+                    isInside,
+                    hit.isLocallyContinuable
+                });
+            };
+
+            if (isTransparent(hit))
+            {
+                bool isInside = hit.isInside;
+                const Ray nextRay = refractionRay(qray.ray, hit, isInside);
+                queue(next.refraction, nextRay, refractionContribution, isInside);
+            }
+
+            if (isReflective(hit))
+            {
+                queue(next.reflection, reflectionRay(qray.ray, hit), reflectionContribution, hit.isInside);
+            }
+
+            if ((isDiffusive(hit) || hit.isInside) && contribution.max() >= m_options.contributionThreshold)
+            {
+                const Point3f point = shadowRayOrigin(hit);
+                const ColorRGBf airUnabsorbed = unabsorbedByAir(hit);
+                const ColorRGBf lightWeight = surfaceWeight * airUnabsorbed * hit.diffuse;
+                forEachContributingLight(contribution, hit, airUnabsorbed, point, [&](const LightHandle& light) {
+                    const Ray ray = Ray::between(point, light.center());
+                    next.shadow.push_back(QueuedShadowRay{
+                        ray,
+                        lightWeight * std::max(0.0f, dot(hit.normal, ray.direction())),
+                        &light,
+                        qray.pixelNo,
+                        depth
+                    });
+                });
+            }
+        }
+
+        void traceShadowQueue(std::vector<QueuedShadowRay>& rays, std::vector<ColorRGBf>& colors) const
+        {
+            if (rays.empty()) return;
+
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::ShadowRays);
+#endif
+
+            const int numRays = static_cast<int>(rays.size());
+            for (int first = 0; first < numRays; first += RayPacket4::numRays)
+            {
+                const int numPacketRays = std::min(numRays - first, RayPacket4::numRays);
+
+                // lanes past the last ray repeat it
+                auto laneRay = [&](int lane) -> const QueuedShadowRay& {
+                    return rays[first + std::min(lane, numPacketRays - 1)];
+                };
+                const RayPacket4 packet(laneRay(0).ray, laneRay(1).ray, laneRay(2).ray, laneRay(3).ray);
+                const std::array<const LightHandle*, RayPacket4::numRays> lights = {
+                    laneRay(0).light, laneRay(1).light, laneRay(2).light, laneRay(3).light
+                };
+
+                // all rays of a wavefront are at the same depth
+                const auto emissions = traceShadowRays(packet, lights.data(), numPacketRays, laneRay(0).depth);
+                for (int lane = 0; lane < numPacketRays; ++lane)
+                {
+                    colors[laneRay(lane).pixelNo] += laneRay(lane).weight * emissions[lane];
+                }
             }
         }
 
@@ -330,4 +951,6 @@ namespace ray
             return hit.diffuse >= m_options.diffuseThreshold;
         }
     };
-}
\ No newline at end of file
+
+    using Raytracer = BasicRaytracer<Scene>;
+}
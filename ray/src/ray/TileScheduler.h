@@ -0,0 +1,139 @@
+#pragma once
+
+#if defined(RAY_GATHER_PERF_STATS)
+#include <ray/perf/PerformanceStats.h>
+#endif
+
+#include <ray/math/Vec2.h>
+
+#include <ray/utility/IntRange2.h>
+#include <ray/utility/ThreadPool.h>
+#include <ray/utility/Util.h>
+
+#include <algorithm>
+#include <chrono>
+#include <execution>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ray
+{
+    // Pixels in [min, max).
+    struct Tile
+    {
+        Point2i min;
+        Point2i max;
+    };
+
+    // Splits the image into square tiles, each tile is a separate task on a work stealing thread pool.
+    // Tiles and pixels within a tile are visited column by column, same as the layout of Array2,
+    // so each column of a tile is written to a contiguous range of memory.
+    struct TileScheduler
+    {
+        static constexpr int defaultTileSize = 16;
+
+        explicit TileScheduler(ThreadPool& pool, int tileSize = defaultTileSize) noexcept :
+            m_pool(&pool),
+            m_tileSize(tileSize)
+        {
+        }
+
+        // Waits for all tiles to finish.
+        template <typename FuncT>
+        void forEachTile(const Point2i& size, FuncT&& func) const
+        {
+            const int numTilesX = (size.x + m_tileSize - 1) / m_tileSize;
+            const int numTilesY = (size.y + m_tileSize - 1) / m_tileSize;
+            const int numTiles = numTilesX * numTilesY;
+
+            m_pool->parallelFor(0, numTiles, numTiles, [&](int i) {
+#if defined(RAY_GATHER_PERF_STATS)
+                auto t0 = std::chrono::high_resolution_clock().now();
+#endif
+
+                const Point2i min((i / numTilesY) * m_tileSize, (i % numTilesY) * m_tileSize);
+                const Point2i max(std::min(min.x + m_tileSize, size.x), std::min(min.y + m_tileSize, size.y));
+                func(Tile{ min, max });
+
+#if defined(RAY_GATHER_PERF_STATS)
+                auto t1 = std::chrono::high_resolution_clock().now();
+                perf::gThreadLocalPerfStats.addTileRenderTime(t1 - t0);
+#endif
+            });
+        }
+
+        template <typename FuncT>
+        void forEachPixel(const Point2i& size, FuncT&& func) const
+        {
+            forEachTile(size, [&](const Tile& tile) {
+                for (int x = tile.min.x; x < tile.max.x; ++x)
+                {
+                    for (int y = tile.min.y; y < tile.max.y; ++y)
+                    {
+#if defined(RAY_GATHER_PERF_STATS)
+                        perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Pixel);
+#endif
+
+                        func(Point2i(x, y));
+                    }
+                }
+            });
+        }
+
+        [[nodiscard]] int tileSize() const
+        {
+            return m_tileSize;
+        }
+
+    private:
+        ThreadPool* m_pool;
+        int m_tileSize;
+    };
+
+    // Calls func for each pixel of an image of the given size.
+    // exec is either a standard execution policy or a TileScheduler.
+    template <typename ExecT, typename FuncT, typename = std::enable_if_t<std::is_execution_policy_v<remove_cvref_t<ExecT>>>>
+    void forEachPixel(ExecT&& exec, const Point2i& size, FuncT&& func)
+    {
+        auto range = IntRange2(size);
+#if defined(RAY_GATHER_PERF_STATS)
+        std::for_each(std::forward<ExecT>(exec), range.begin(), range.end(), [&func](const auto& xy) {
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Pixel);
+            func(xy);
+        });
+#else
+        std::for_each(std::forward<ExecT>(exec), range.begin(), range.end(), std::forward<FuncT>(func));
+#endif
+    }
+
+    template <typename FuncT>
+    void forEachPixel(const TileScheduler& scheduler, const Point2i& size, FuncT&& func)
+    {
+        scheduler.forEachPixel(size, std::forward<FuncT>(func));
+    }
+
+    // Calls func for each tile of an image of the given size.
+    // With a standard execution policy tiles are of TileScheduler::defaultTileSize.
+    template <typename ExecT, typename FuncT, typename = std::enable_if_t<std::is_execution_policy_v<remove_cvref_t<ExecT>>>>
+    void forEachTile(ExecT&& exec, const Point2i& size, FuncT&& func)
+    {
+        constexpr int tileSize = TileScheduler::defaultTileSize;
+        std::vector<Tile> tiles;
+        for (int x = 0; x < size.x; x += tileSize)
+        {
+            for (int y = 0; y < size.y; y += tileSize)
+            {
+                tiles.push_back(Tile{ Point2i(x, y), Point2i(std::min(x + tileSize, size.x), std::min(y + tileSize, size.y)) });
+            }
+        }
+
+        std::for_each(std::forward<ExecT>(exec), tiles.begin(), tiles.end(), std::forward<FuncT>(func));
+    }
+
+    template <typename FuncT>
+    void forEachTile(const TileScheduler& scheduler, const Point2i& size, FuncT&& func)
+    {
+        scheduler.forEachTile(size, std::forward<FuncT>(func));
+    }
+}
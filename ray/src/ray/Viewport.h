@@ -2,6 +2,7 @@
 
 #include <ray/math/Ray.h>
 #include <ray/math/Vec2.h>
+#include <ray/math/Vec3.h>
 
 namespace ray
 {
@@ -35,5 +36,17 @@ namespace ray
         {
             return Ray(origin, directionAt(coords));
         }
+
+        // Inverse of rayAt, coords where the ray crosses the viewport plane.
+        [[nodiscard]] Point2f coordsOf(const Ray& ray) const
+        {
+            const Vec3f normal = center - origin;
+            const float t = dot(normal, normal) / dot(Vec3f(ray.direction()), normal);
+            const Vec3f offset = (ray.origin() + Vec3f(ray.direction()) * t) - topLeft;
+            return Point2f(
+                dot(offset, Vec3f(right)) / pixelWidth,
+                dot(offset, Vec3f(down)) / pixelHeight
+            );
+        }
     };
 }
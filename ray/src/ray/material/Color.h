@@ -122,6 +122,11 @@ namespace ray
         );
     }
 
+    [[nodiscard]] inline bool isFinite(const ColorRGBf& c)
+    {
+        return std::isfinite(c.r) && std::isfinite(c.g) && std::isfinite(c.b);
+    }
+
     struct ColorRGBi
     {
         constexpr ColorRGBi() noexcept :
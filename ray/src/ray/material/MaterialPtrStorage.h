@@ -2,6 +2,7 @@
 
 #include "Material.h"
 
+#include <algorithm>
 #include <array>
 #include <utility>
 #include <iostream>
@@ -109,6 +110,18 @@ namespace ray
             return false;
         }
 
+        // Brightest component of the emission color of any surface material.
+        [[nodiscard]] float maxEmission() const
+        {
+            float emission = 0.0f;
+            for (const auto& mat : m_surfaceMaterials)
+            {
+                emission = std::max(emission, mat->emissionColor.max());
+            }
+
+            return emission;
+        }
+
     private:
         SurfaceMaterialStorage m_surfaceMaterials;
         MediumMaterialStorage m_mediumMaterials;
@@ -147,6 +160,18 @@ namespace ray
             return false;
         }
 
+        // Brightest component of the emission color of any surface material.
+        [[nodiscard]] float maxEmission() const
+        {
+            float emission = 0.0f;
+            for (const auto& mat : m_surfaceMaterials)
+            {
+                emission = std::max(emission, mat->emissionColor.max());
+            }
+
+            return emission;
+        }
+
     private:
         SurfaceMaterialStorage m_surfaceMaterials;
     };
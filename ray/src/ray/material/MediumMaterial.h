@@ -4,6 +4,8 @@
 #include "TexCoords.h"
 #include "Texture.h"
 
+#include <limits>
+
 namespace ray
 {
     struct MediumMaterial
@@ -11,18 +13,25 @@ namespace ray
         ColorRGBf absorbtion;
         float refractiveIndex;
 
+        // Reflection and refraction rays are not spawned from hits on the object
+        // past this depth, even if Raytracer::Options allows it.
+        int maxRayDepth;
+
         MediumMaterial() noexcept :
             absorbtion{},
-            refractiveIndex(1.0f)
+            refractiveIndex(1.0f),
+            maxRayDepth(std::numeric_limits<int>::max())
         {
         }
 
         MediumMaterial(
             const ColorRGBf& absorbtion,
-            float refractiveIndex
+            float refractiveIndex,
+            int maxRayDepth = std::numeric_limits<int>::max()
         ) noexcept :
             absorbtion(absorbtion),
-            refractiveIndex(refractiveIndex)
+            refractiveIndex(refractiveIndex),
+            maxRayDepth(maxRayDepth)
         {
         }
 
@@ -42,5 +51,11 @@ namespace ray
             absorbtion = color;
             return *this;
         }
+
+        MediumMaterial& withMaxRayDepth(int depth)
+        {
+            maxRayDepth = depth;
+            return *this;
+        }
     };
 }
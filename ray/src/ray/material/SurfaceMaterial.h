@@ -1,5 +1,9 @@
 #pragma once
 
+#if defined(RAY_GATHER_PERF_STATS)
+#include <ray/perf/PerformanceStats.h>
+#endif
+
 #include "Color.h"
 #include "TexCoords.h"
 #include "Texture.h"
@@ -87,6 +91,10 @@ namespace ray
         {
             if (!texture) return ColorRGBf(1.0f, 1.0f, 1.0f);
 
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::TextureSampling);
+#endif
+
             return texture->sample(coords);
         }
     };
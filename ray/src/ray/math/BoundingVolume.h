@@ -8,6 +8,7 @@
 #include <ray/shape/OrientedBox3.h>
 #include <ray/shape/Sdf.h>
 #include <ray/shape/ShapeTags.h>
+#include <ray/shape/SharedShape.h>
 #include <ray/shape/Sphere.h>
 #include <ray/shape/TransformedShape3.h>
 #include <ray/shape/Triangle3.h>
@@ -125,11 +126,10 @@ namespace ray
         template <typename TransformT, typename ShapeT>
         [[nodiscard]] static Box3 get(const TransformedShape3<TransformT, ShapeT>& sh)
         {
-            auto vs = get(sh.shape).vertices();
-            const auto localToWorld = sh.worldToLocal.inverse();
+            auto vs = get(sh.shape()).vertices();
             for (auto& p : vs)
             {
-                p = localToWorld * p;
+                p = sh.localToWorld() * p;
             }
 
             Point3f a = vs[0];
@@ -143,6 +143,12 @@ namespace ray
             return Box3(a, b);
         }
 
+        template <typename ShapeT>
+        [[nodiscard]] static Box3 get(const SharedShape<ShapeT>& sh)
+        {
+            return get(sh.shape());
+        }
+
         template <typename ClippingShapeT>
         [[nodiscard]] static Box3 get(const ClippedSdf<ClippingShapeT>& sh)
         {
@@ -213,22 +213,22 @@ namespace ray
 
     [[nodiscard]] inline Float4Mask operator<=(const Float4& lhs, const Float4& rhs) noexcept
     {
-        return Float4Mask(m128::cmpeq(lhs.xmm, rhs.xmm));
+        return Float4Mask(m128::cmple(lhs.xmm, rhs.xmm));
     }
 
     [[nodiscard]] inline Float4Mask operator<=(const Float4& lhs, float rhs) noexcept
     {
-        return Float4Mask(m128::cmpeq(lhs.xmm, rhs));
+        return Float4Mask(m128::cmple(lhs.xmm, rhs));
     }
 
     [[nodiscard]] inline Float4Mask operator>=(const Float4& lhs, const Float4& rhs) noexcept
     {
-        return Float4Mask(m128::cmpeq(rhs.xmm, lhs.xmm));
+        return Float4Mask(m128::cmple(rhs.xmm, lhs.xmm));
     }
 
     [[nodiscard]] inline Float4Mask operator>=(const Float4& lhs, float rhs) noexcept
     {
-        return Float4Mask(m128::cmpeq(rhs, lhs.xmm));
+        return Float4Mask(m128::cmple(rhs, lhs.xmm));
     }
 
     [[nodiscard]] inline Float4 sqrt(const Float4& f)
@@ -5,7 +5,7 @@
 
 namespace ray
 {
-    struct AssumeOrthogonal;
+    struct AssumeOrthogonal {};
 
     template <typename T>
     struct OrthonormalBasis3
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Float4.h"
+#include "Ray.h"
+#include "Vec3.h"
+#include "Vec3x4.h"
+
+#include <array>
+#include <cstdint>
+
+namespace ray
+{
+    // Four rays traced together.
+    // Origins and directions are stored in SoA layout for the packet kernels,
+    // the rays themselves are kept for finalizing hits and for per lane fallbacks.
+    struct RayPacket4
+    {
+        static constexpr int numRays = 4;
+        static constexpr std::uint8_t allLanes = 0b1111;
+
+        RayPacket4(const Ray& r0, const Ray& r1, const Ray& r2, const Ray& r3) noexcept :
+            m_rays{ r0, r1, r2, r3 },
+            m_origin(r0.origin().asVector(), r1.origin().asVector(), r2.origin().asVector(), r3.origin().asVector()),
+            m_direction(r0.direction(), r1.direction(), r2.direction(), r3.direction()),
+            m_invDirection(r0.invDirection(), r1.invDirection(), r2.invDirection(), r3.invDirection())
+        {
+        }
+
+        explicit RayPacket4(const std::array<Ray, numRays>& rays) noexcept :
+            RayPacket4(rays[0], rays[1], rays[2], rays[3])
+        {
+        }
+
+        [[nodiscard]] const Ray& ray(int i) const
+        {
+            return m_rays[i];
+        }
+
+        [[nodiscard]] const Vec3x4<float>& origin() const
+        {
+            return m_origin;
+        }
+
+        [[nodiscard]] const Vec3x4<float>& direction() const
+        {
+            return m_direction;
+        }
+
+        [[nodiscard]] const Vec3x4<float>& invDirection() const
+        {
+            return m_invDirection;
+        }
+
+    private:
+        std::array<Ray, numRays> m_rays;
+        Vec3x4<float> m_origin;
+        Vec3x4<float> m_direction;
+        Vec3x4<float> m_invDirection;
+    };
+}
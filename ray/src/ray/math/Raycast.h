@@ -7,26 +7,36 @@
 #include "BoundingVolume.h"
 #include "Interval.h"
 #include "Ray.h"
+#include "RayPacket4.h"
 #include "RaycastHit.h"
 #include "Vec3.h"
+#include "Vec3x4.h"
+#include "WatertightRaycast.h"
 
 #include <ray/material/Material.h>
 
 #include <ray/shape/Box3.h>
+#include <ray/shape/Box3Pack4.h>
 #include <ray/shape/ClosedTriangleMesh.h>
 #include <ray/shape/Capsule.h>
 #include <ray/shape/Cylinder.h>
 #include <ray/shape/Disc3.h>
+#include <ray/shape/IndexedTriangleMesh.h>
 #include <ray/shape/OrientedBox3.h>
 #include <ray/shape/Triangle3.h>
+#include <ray/shape/Triangle3Pack4.h>
 #include <ray/shape/Plane.h>
 #include <ray/shape/HalfSphere.h>
 #include <ray/shape/Sdf.h>
+#include <ray/shape/SharedShape.h>
 #include <ray/shape/Sphere.h>
+#include <ray/shape/SpherePack4.h>
 #include <ray/shape/TransformedShape3.h>
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <limits>
 #include <optional>
 #include <iostream>
 
@@ -116,6 +126,99 @@ namespace ray
         //*/
     }
 
+    // Index of the lane with the smallest t among the ones set in mask, mask must be non-zero.
+    [[nodiscard]] inline int nearestLane(const Float4& t, std::uint8_t mask)
+    {
+        int best = -1;
+        for (int i = 0; i < 4; ++i)
+        {
+            if ((mask & (1 << i)) == 0) continue;
+            if (best == -1 || t.v[i] < t.v[best]) best = i;
+        }
+        return best;
+    }
+
+    [[nodiscard]] inline int numLanes(std::uint8_t mask)
+    {
+        return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+    }
+
+    // Distances to the nearest hits found so far for each lane of a packet.
+    template <typename HitPacketT>
+    [[nodiscard]] inline Float4 nearestDistances(const HitPacketT& hits)
+    {
+        return Float4(hits[0].dist, hits[1].dist, hits[2].dist, hits[3].dist);
+    }
+
+    // Slab test against all 4 boxes at once.
+    // Returns the number of boxes hit, hits are sorted by the entry distance.
+    [[nodiscard]] inline int raycastBv(const Ray& ray, const Box3Pack4& boxes, float tNearest, RaycastBvHit4& hit)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addBvRaycast<Box3Pack4>();
+#endif
+
+        const Vec3x4<float> origin = Vec3x4<float>::broadcast(ray.origin().asVector());
+        const Vec3x4<float> invDir = Vec3x4<float>::broadcast(ray.invDirection());
+        const Vec3x4<float> t0 = (boxes.min - origin) * invDir;
+        const Vec3x4<float> t1 = (boxes.max - origin) * invDir;
+
+        // Clamping to 0 handles both the origin being inside and the box being behind the ray.
+        const Float4 tmin = max(max(min(t0.x, t1.x), min(t0.y, t1.y)), max(min(t0.z, t1.z), Float4{}));
+        const Float4 tmax = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), max(t0.z, t1.z));
+
+        hit.mask = ((tmin <= tmax) & (tmin < tNearest)).packed();
+        hit.numHits = 0;
+        if (hit.mask == 0) return 0;
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addBvRaycastHit<Box3Pack4>();
+#endif
+
+        for (int i = 0; i < 4; ++i)
+        {
+            if ((hit.mask & (1 << i)) == 0) continue;
+
+            const float d = tmin.v[i];
+            int j = hit.numHits++;
+            while (j > 0 && hit.dist[j - 1] > d)
+            {
+                hit.dist[j] = hit.dist[j - 1];
+                hit.lanes[j] = hit.lanes[j - 1];
+                --j;
+            }
+            hit.dist[j] = d;
+            hit.lanes[j] = i;
+        }
+
+        return hit.numHits;
+    }
+
+    // Slab test of 4 rays against one box. Only lanes set in activeMask are considered.
+    // Returns the mask of lanes that hit the box closer than tNearest.
+    [[nodiscard]] inline std::uint8_t raycastBv(const RayPacket4& rays, const Box3& box, const Float4& tNearest, std::uint8_t activeMask, RaycastBvHitPacket4& hit)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addBvRaycast<Box3>(numLanes(activeMask));
+#endif
+
+        const Vec3x4<float> t0 = (Vec3x4<float>::broadcast(box.min.asVector()) - rays.origin()) * rays.invDirection();
+        const Vec3x4<float> t1 = (Vec3x4<float>::broadcast(box.max.asVector()) - rays.origin()) * rays.invDirection();
+
+        // Clamping to 0 handles both the origin being inside and the box being behind the ray.
+        const Float4 tmin = max(max(min(t0.x, t1.x), min(t0.y, t1.y)), max(min(t0.z, t1.z), Float4{}));
+        const Float4 tmax = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), max(t0.z, t1.z));
+
+        hit.dist = tmin;
+        hit.mask = activeMask & ((tmin <= tmax) & (tmin < tNearest)).packed();
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addBvRaycastHit<Box3>(numLanes(hit.mask));
+#endif
+
+        return hit.mask;
+    }
+
     [[nodiscard]] inline bool intersect(const Ray& ray, const Sphere& sphere)
     {
         const Point3f O = ray.origin();
@@ -249,7 +352,9 @@ namespace ray
 #endif
 
         const Point3f hitPoint = O + t * D;
-        Normal3f normal = Normal3f(((hitPoint - C) / R).assumeNormalized());
+        // Far from the origin the hit point is too imprecise for small spheres to assume unit length.
+        // Reflected rays would inherit the error and compound it with every bounce.
+        Normal3f normal = Normal3f(((hitPoint - C) / R).normalized());
         if (isInside) normal = -normal;
 
         hit.dist = t;
@@ -261,6 +366,107 @@ namespace ray
         return true;
     }
 
+    // Only shapes in lanes set in laneMask are considered.
+    [[nodiscard]] inline bool raycast(const Ray& ray, const SpherePack4& spheres, std::uint8_t laneMask, RaycastHit& hit)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycast<SpherePack4>(numLanes(laneMask));
+#endif
+
+        const Vec3x4<float> O = Vec3x4<float>::broadcast(ray.origin().asVector());
+        const Vec3x4<float> D = Vec3x4<float>::broadcast(ray.direction());
+
+        const Vec3x4<float> L = spheres.center - O;
+        const Float4 t_ca = dot(L, D);
+        const Float4 d2 = dot(L, L) - t_ca * t_ca;
+        const Float4 R2 = spheres.radius * spheres.radius;
+        const Float4 t_hc = sqrt(max(R2 - d2, Float4{}));
+
+        // same selection as for a single sphere, but without early exits
+        const Float4 t0 = t_ca - t_hc;
+        const Float4Mask isInside = t0 < 0.0f;
+        const Float4 t = Float4::blend(t0, t_ca + t_hc, isInside);
+        const std::uint8_t mask = laneMask & ((d2 <= R2) & (t >= 0.0f) & (t < hit.dist)).packed();
+        if (mask == 0) return false;
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycastHit<SpherePack4>();
+#endif
+
+        const int lane = nearestLane(t, mask);
+        const Point3f C(spheres.center.x.v[lane], spheres.center.y.v[lane], spheres.center.z.v[lane]);
+        const float R = spheres.radius.v[lane];
+        const bool isLaneInside = (isInside.packed() & (1 << lane)) != 0;
+
+        const Point3f hitPoint = ray.origin() + t.v[lane] * ray.direction();
+        Normal3f normal = Normal3f(((hitPoint - C) / R).normalized());
+        if (isLaneInside) normal = -normal;
+
+        hit.dist = t.v[lane];
+        hit.point = hitPoint;
+        hit.normal = normal;
+        hit.shapeInPackNo = lane;
+        hit.materialIndex = MaterialIndex(0, 0);
+        hit.isInside = isLaneInside;
+        return true;
+    }
+
+    [[nodiscard]] inline bool raycast(const Ray& ray, const SpherePack4& spheres, RaycastHit& hit)
+    {
+        return raycast(ray, spheres, 0b1111, hit);
+    }
+
+    // Tests 4 rays against one sphere. Only lanes set in activeMask are considered.
+    // Returns the mask of lanes for which the hit was updated.
+    template <typename HitPacketT>
+    [[nodiscard]] inline std::uint8_t raycast(const RayPacket4& rays, const Sphere& sphere, std::uint8_t activeMask, HitPacketT& hits)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycast<Sphere>(numLanes(activeMask));
+#endif
+
+        const Point3f C = sphere.center();
+        const float R = sphere.radius();
+        const float R2 = R * R;
+
+        const Vec3x4<float> L = Vec3x4<float>::broadcast(C.asVector()) - rays.origin();
+        const Float4 t_ca = dot(L, rays.direction());
+        const Float4 d2 = dot(L, L) - t_ca * t_ca;
+        const Float4 t_hc = sqrt(max(Float4::broadcast(R2) - d2, Float4{}));
+
+        const Float4 t0 = t_ca - t_hc;
+        const Float4Mask isInside = t0 < 0.0f;
+        const Float4 t = Float4::blend(t0, t_ca + t_hc, isInside);
+        const std::uint8_t mask = activeMask & ((d2 <= R2) & (t >= 0.0f) & (t < nearestDistances(hits))).packed();
+        if (mask == 0) return 0;
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycastHit<Sphere>(numLanes(mask));
+#endif
+
+        const std::uint8_t insideMask = isInside.packed();
+        for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+        {
+            if ((mask & (1 << lane)) == 0) continue;
+
+            const Ray& ray = rays.ray(lane);
+            const bool isLaneInside = (insideMask & (1 << lane)) != 0;
+            const Point3f hitPoint = ray.origin() + t.v[lane] * ray.direction();
+            Normal3f normal = Normal3f(((hitPoint - C) / R).normalized());
+            if (isLaneInside) normal = -normal;
+
+            RaycastHit& hit = hits[lane];
+            hit.dist = t.v[lane];
+            hit.point = hitPoint;
+            hit.normal = normal;
+            hit.shapeInPackNo = 0;
+            hit.materialIndex = MaterialIndex(0, 0);
+            hit.isInside = isLaneInside;
+        }
+
+        return mask;
+    }
+
 
     [[nodiscard]] inline bool raycast(const Ray& ray, const OrientedBox3& obb, RaycastHit& hit)
     {
@@ -476,6 +682,102 @@ namespace ray
         return true;
     }
 
+    // Only shapes in lanes set in laneMask are considered.
+    [[nodiscard]] inline bool raycast(const Ray& ray, const Box3Pack4& boxes, std::uint8_t laneMask, RaycastHit& hit)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycast<Box3Pack4>(numLanes(laneMask));
+#endif
+
+        const Vec3x4<float> origin = Vec3x4<float>::broadcast(ray.origin().asVector());
+        const Vec3x4<float> invDir = Vec3x4<float>::broadcast(ray.invDirection());
+        const Vec3x4<float> t0 = (boxes.min - origin) * invDir;
+        const Vec3x4<float> t1 = (boxes.max - origin) * invDir;
+
+        const Float4 tmin = max(max(min(t0.x, t1.x), min(t0.y, t1.y)), min(t0.z, t1.z));
+        const Float4 tmax = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), max(t0.z, t1.z));
+
+        const Float4Mask isInside = tmin < 0.0f;
+        const Float4 t = Float4::blend(tmin, tmax, isInside);
+        const std::uint8_t mask = laneMask & ((tmax >= 0.0f) & (tmin <= tmax) & (t < hit.dist)).packed();
+        if (mask == 0) return false;
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycastHit<Box3Pack4>();
+#endif
+
+        const int lane = nearestLane(t, mask);
+        const float tLane = t.v[lane];
+        const Vec3f t0Lane(t0.x.v[lane], t0.y.v[lane], t0.z.v[lane]);
+        const Vec3f t1Lane(t1.x.v[lane], t1.y.v[lane], t1.z.v[lane]);
+
+        Normal3f normal(AssumeNormalized{}, Vec3f::blend(0.0f, -1.0f, (t0Lane == tLane) | (t1Lane == tLane)));
+        normal.negate(ray.signs());
+
+        hit.dist = tLane;
+        hit.point = ray.origin() + ray.direction() * tLane;
+        hit.normal = normal;
+        hit.shapeInPackNo = lane;
+        hit.materialIndex = MaterialIndex(0, 0);
+        hit.isInside = (isInside.packed() & (1 << lane)) != 0;
+
+        return true;
+    }
+
+    [[nodiscard]] inline bool raycast(const Ray& ray, const Box3Pack4& boxes, RaycastHit& hit)
+    {
+        return raycast(ray, boxes, 0b1111, hit);
+    }
+
+    // Tests 4 rays against one box. Only lanes set in activeMask are considered.
+    // Returns the mask of lanes for which the hit was updated.
+    template <typename HitPacketT>
+    [[nodiscard]] inline std::uint8_t raycast(const RayPacket4& rays, const Box3& box, std::uint8_t activeMask, HitPacketT& hits)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycast<Box3>(numLanes(activeMask));
+#endif
+
+        const Vec3x4<float> t0 = (Vec3x4<float>::broadcast(box.min.asVector()) - rays.origin()) * rays.invDirection();
+        const Vec3x4<float> t1 = (Vec3x4<float>::broadcast(box.max.asVector()) - rays.origin()) * rays.invDirection();
+
+        const Float4 tmin = max(max(min(t0.x, t1.x), min(t0.y, t1.y)), min(t0.z, t1.z));
+        const Float4 tmax = min(min(max(t0.x, t1.x), max(t0.y, t1.y)), max(t0.z, t1.z));
+
+        const Float4Mask isInside = tmin < 0.0f;
+        const Float4 t = Float4::blend(tmin, tmax, isInside);
+        const std::uint8_t mask = activeMask & ((tmax >= 0.0f) & (tmin <= tmax) & (t < nearestDistances(hits))).packed();
+        if (mask == 0) return 0;
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycastHit<Box3>(numLanes(mask));
+#endif
+
+        const std::uint8_t insideMask = isInside.packed();
+        for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+        {
+            if ((mask & (1 << lane)) == 0) continue;
+
+            const Ray& ray = rays.ray(lane);
+            const float tLane = t.v[lane];
+            const Vec3f t0Lane(t0.x.v[lane], t0.y.v[lane], t0.z.v[lane]);
+            const Vec3f t1Lane(t1.x.v[lane], t1.y.v[lane], t1.z.v[lane]);
+
+            Normal3f normal(AssumeNormalized{}, Vec3f::blend(0.0f, -1.0f, (t0Lane == tLane) | (t1Lane == tLane)));
+            normal.negate(ray.signs());
+
+            RaycastHit& hit = hits[lane];
+            hit.dist = tLane;
+            hit.point = ray.origin() + ray.direction() * tLane;
+            hit.normal = normal;
+            hit.shapeInPackNo = 0;
+            hit.materialIndex = MaterialIndex(0, 0);
+            hit.isInside = (insideMask & (1 << lane)) != 0;
+        }
+
+        return mask;
+    }
+
     [[nodiscard]] inline bool raycast(const Ray& ray, const Cylinder& cyl, RaycastHit& hit)
     {
 #if defined(RAY_GATHER_PERF_STATS)
@@ -755,15 +1057,133 @@ namespace ray
         return true;
     }
 
+    // Only shapes in lanes set in laneMask are considered.
+    [[nodiscard]] inline bool raycast(const Ray& ray, const Triangle3Pack4& tris, std::uint8_t laneMask, RaycastHit& hit)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycast<Triangle3Pack4>(numLanes(laneMask));
+#endif
+
+        const Vec3x4<float> O = Vec3x4<float>::broadcast(ray.origin().asVector());
+        const Vec3x4<float> D = Vec3x4<float>::broadcast(ray.direction());
+
+        const Vec3x4<float> pvec = cross(D, tris.e02);
+        const Float4 det = dot(tris.e01, pvec);
+        const Float4 invDet = 1.0f / det;
+
+        const Vec3x4<float> tvec = O - tris.v0;
+        const Float4 v = dot(tvec, pvec) * invDet;
+
+        const Vec3x4<float> qvec = cross(tvec, tris.e01);
+        const Float4 w = dot(D, qvec) * invDet;
+        const Float4 wv = v + w;
+
+        const Float4 t = dot(tris.e02, qvec) * invDet;
+
+        // ray and triangle are parallel if det is close to 0
+        const std::uint8_t mask = laneMask & (
+            (abs(det) >= 0.00001f)
+            & (v >= 0.0f) & (v <= 1.0f)
+            & (w >= 0.0f) & (wv <= 1.0f)
+            & (t >= 0.0f) & (t < hit.dist)
+        ).packed();
+        if (mask == 0) return false;
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycastHit<Triangle3Pack4>();
+#endif
+
+        const int lane = nearestLane(t, mask);
+        const float vLane = v.v[lane];
+        const float wLane = w.v[lane];
+        const float uLane = 1.0f - wv.v[lane];
+        const auto& normals = tris.normals[lane];
+
+        hit.dist = t.v[lane];
+        hit.point = ray.origin() + ray.direction() * t.v[lane];
+        hit.normal = Normal3f((normals[0] * uLane + normals[1] * vLane + normals[2] * wLane).normalized());
+        if (det.v[lane] < 0.0f) hit.normal = -hit.normal;
+        hit.shapeInPackNo = lane;
+        hit.materialIndex = MaterialIndex(0);
+        hit.isInside = false;
+
+        return true;
+    }
+
+    [[nodiscard]] inline bool raycast(const Ray& ray, const Triangle3Pack4& tris, RaycastHit& hit)
+    {
+        return raycast(ray, tris, 0b1111, hit);
+    }
+
+    // Tests 4 rays against one triangle. Only lanes set in activeMask are considered.
+    // Returns the mask of lanes for which the hit was updated.
+    template <typename HitPacketT>
+    [[nodiscard]] inline std::uint8_t raycast(const RayPacket4& rays, const Triangle3& tri, std::uint8_t activeMask, HitPacketT& hits)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycast<Triangle3>(numLanes(activeMask));
+#endif
+
+        const Vec3x4<float> e01 = Vec3x4<float>::broadcast(tri.e01());
+        const Vec3x4<float> e02 = Vec3x4<float>::broadcast(tri.e02());
+
+        const Vec3x4<float> pvec = cross(rays.direction(), e02);
+        const Float4 det = dot(e01, pvec);
+        const Float4 invDet = 1.0f / det;
+
+        const Vec3x4<float> tvec = rays.origin() - Vec3x4<float>::broadcast(tri.v0().asVector());
+        const Float4 v = dot(tvec, pvec) * invDet;
+
+        const Vec3x4<float> qvec = cross(tvec, e01);
+        const Float4 w = dot(rays.direction(), qvec) * invDet;
+        const Float4 wv = v + w;
+
+        const Float4 t = dot(e02, qvec) * invDet;
+
+        // ray and triangle are parallel if det is close to 0
+        const std::uint8_t mask = activeMask & (
+            (abs(det) >= 0.00001f)
+            & (v >= 0.0f) & (v <= 1.0f)
+            & (w >= 0.0f) & (wv <= 1.0f)
+            & (t >= 0.0f) & (t < nearestDistances(hits))
+        ).packed();
+        if (mask == 0) return 0;
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycastHit<Triangle3>(numLanes(mask));
+#endif
+
+        for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+        {
+            if ((mask & (1 << lane)) == 0) continue;
+
+            const Ray& ray = rays.ray(lane);
+            const float vLane = v.v[lane];
+            const float wLane = w.v[lane];
+            const float uLane = 1.0f - wv.v[lane];
+
+            RaycastHit& hit = hits[lane];
+            hit.dist = t.v[lane];
+            hit.point = ray.origin() + ray.direction() * t.v[lane];
+            hit.normal = Normal3f((tri.normal(0) * uLane + tri.normal(1) * vLane + tri.normal(2) * wLane).normalized());
+            if (det.v[lane] < 0.0f) hit.normal = -hit.normal;
+            hit.shapeInPackNo = 0;
+            hit.materialIndex = MaterialIndex(0);
+            hit.isInside = false;
+        }
+
+        return mask;
+    }
+
     [[nodiscard]] inline bool raycast(const Ray& ray, const ClosedTriangleMeshFace& tri, RaycastHit& hit)
     {
 #if defined(RAY_GATHER_PERF_STATS)
         perf::gThreadLocalPerfStats.addObjectRaycast<ClosedTriangleMeshFace>();
 #endif
 
-        const Point3f v0 = tri.vertex(0).point;
-        const Vec3f e01 = tri.vertex(1).point - v0;
-        const Vec3f e02 = tri.vertex(2).point - v0;
+        const Point3f v0 = tri.v0();
+        const Vec3f e01 = tri.e01();
+        const Vec3f e02 = tri.e02();
         const Vec3f pvec = cross(ray.direction(), e02);
         const float det = dot(e01, pvec);
 
@@ -803,6 +1223,139 @@ namespace ray
         return true;
     }
 
+    // Slab test for the mesh's own bvh. tmax is enlarged by the bound of the slab test's rounding error [Ize 2013],
+    // otherwise rays going exactly through vertices on the boundary of a node could miss it and leak through the mesh.
+    [[nodiscard]] inline bool raycastBvConservative(const Ray& ray, const Box3& box, float tNearest, RaycastBvHit& hit)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addBvRaycast<Box3>();
+#endif
+
+        // 1 + 2 * gamma(3)
+        constexpr float tmaxScale = 1.0f + 2.0f * (3.0f * 0.5f * std::numeric_limits<float>::epsilon()) / (1.0f - 3.0f * 0.5f * std::numeric_limits<float>::epsilon());
+
+        const Vec3f invDir = ray.invDirection();
+        const Vec3f t0 = (box.min - ray.origin()) * invDir;
+        const Vec3f t1 = (box.max - ray.origin()) * invDir;
+        const float tmax = max(t0, t1).min() * tmaxScale;
+        if (tmax < 0.0f) return false;
+        const float tmin = std::max(min(t0, t1).max(), 0.0f);
+
+        if (tmin <= tmax && tmin < tNearest)
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::gThreadLocalPerfStats.addBvRaycastHit<Box3>();
+#endif
+            hit.dist = tmin;
+            return true;
+        }
+
+        return false;
+    }
+
+    [[nodiscard]] inline bool raycast(const Ray& ray, const IndexedTriangleMesh& mesh, RaycastHit& hit)
+    {
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycast<IndexedTriangleMesh>();
+#endif
+
+        if (mesh.numNodes() == 0) return false;
+
+        struct Entry
+        {
+            int nodeNo;
+            float dist;
+        };
+
+        RaycastBvHit bvHit;
+        if (!raycastBvConservative(ray, mesh.node(0).bounds, hit.dist, bvHit)) return false;
+
+        const WatertightRay wray(ray);
+
+        Entry stack[IndexedTriangleMesh::maxDepth];
+        int stackSize = 0;
+        stack[stackSize++] = { 0, bvHit.dist };
+
+        int hitFaceNo = -1;
+        float hitDet = 0.0f;
+        float hitU = 0.0f;
+        float hitV = 0.0f;
+        float hitW = 0.0f;
+        while (stackSize > 0)
+        {
+            const Entry entry = stack[--stackSize];
+            // the nearest hit could have changed since the node was pushed
+            if (entry.dist >= hit.dist) continue;
+
+            const IndexedTriangleMesh::Node& node = mesh.node(entry.nodeNo);
+            if (node.numFaces == 0)
+            {
+                // the far child is pushed first so the near one is visited first
+                const int firstChildNo = entry.nodeNo + 1;
+                const int secondChildNo = node.first;
+                RaycastBvHit firstHit;
+                RaycastBvHit secondHit;
+                const bool isFirstHit = raycastBvConservative(ray, mesh.node(firstChildNo).bounds, hit.dist, firstHit);
+                const bool isSecondHit = raycastBvConservative(ray, mesh.node(secondChildNo).bounds, hit.dist, secondHit);
+                if (isFirstHit && isSecondHit)
+                {
+                    if (firstHit.dist < secondHit.dist)
+                    {
+                        stack[stackSize++] = { secondChildNo, secondHit.dist };
+                        stack[stackSize++] = { firstChildNo, firstHit.dist };
+                    }
+                    else
+                    {
+                        stack[stackSize++] = { firstChildNo, firstHit.dist };
+                        stack[stackSize++] = { secondChildNo, secondHit.dist };
+                    }
+                }
+                else if (isFirstHit)
+                {
+                    stack[stackSize++] = { firstChildNo, firstHit.dist };
+                }
+                else if (isSecondHit)
+                {
+                    stack[stackSize++] = { secondChildNo, secondHit.dist };
+                }
+                continue;
+            }
+
+            for (int i = 0; i < node.numFaces; i += TriangleVertexPack8::numShapes)
+            {
+                const int numTriangles = std::min(node.numFaces - i, TriangleVertexPack8::numShapes);
+                TriangleVertexPack8Hit packHit;
+                packHit.dist = hit.dist;
+                if (!raycastWatertight(wray, mesh.pack(node.firstPack + i / TriangleVertexPack8::numShapes), numTriangles, packHit)) continue;
+
+                hit.dist = packHit.dist;
+                hitFaceNo = node.first + i + packHit.lane;
+                hitDet = packHit.det;
+                hitU = packHit.u;
+                hitV = packHit.v;
+                hitW = packHit.w;
+            }
+        }
+
+        if (hitFaceNo == -1) return false;
+
+#if defined(RAY_GATHER_PERF_STATS)
+        perf::gThreadLocalPerfStats.addObjectRaycastHit<IndexedTriangleMesh>();
+#endif
+        // normal and point are only computed for the nearest face
+        const IndexedTriangleMesh::Face& face = mesh.face(hitFaceNo);
+        const bool isInside = hitDet < 0.0f;
+        hit.point = ray.origin() + ray.direction() * hit.dist;
+        hit.normal = Normal3f((mesh.normal(face[0]) * hitU + mesh.normal(face[1]) * hitV + mesh.normal(face[2]) * hitW).normalized());
+        if (isInside) hit.normal = -hit.normal;
+        hit.shapeInPackNo = 0;
+        hit.materialIndex = MaterialIndex(0, 0);
+        hit.isInside = isInside;
+        hit.additionalData = static_cast<const void*>(&face);
+
+        return true;
+    }
+
     // Interval raycasts
 
     template <typename DataT>
@@ -1276,6 +1829,18 @@ namespace ray
         return sh.raycast(ray, hit);
     }
 
+    template <typename ShapeT>
+    [[nodiscard]] inline bool raycast(const Ray& ray, const SharedShape<ShapeT>& sh, RaycastHit& hit)
+    {
+        return raycast(ray, sh.shape(), hit);
+    }
+
+    template <typename ShapeT, typename DataT>
+    [[nodiscard]] inline bool raycastIntervals(const Ray& ray, const SharedShape<ShapeT>& sh, IntervalSet<DataT>& hitIntervals)
+    {
+        return raycastIntervals(ray, sh.shape(), hitIntervals);
+    }
+
     template <typename TransformT, typename ShapeT>
     [[nodiscard]] inline bool raycast(const Ray& ray, const TransformedShape3<TransformT, ShapeT>& sh, RaycastHit& hit)
     {
@@ -1290,32 +1855,54 @@ namespace ray
         //     - transform back to world
         //   - if not:
         //     - transform the previous hit's distance back
+        // Rigid transformations keep the direction unitary, so the distances don't change.
+        // The inverse is cached in the shape so a hit doesn't invert anything.
 
-        const Vec3f D = sh.worldToLocal.withoutTranslation() * ray.direction();
-        const float DLen = D.length();
-        Ray localRay(
-            sh.worldToLocal * ray.origin(),
-            D.normalized()
-        );
+        using TransformedShapeType = TransformedShape3<TransformT, ShapeT>;
 
-        const float oldHitDist = hit.dist;
-        hit.dist *= DLen;
-        if (raycast(localRay, sh.shape, hit))
+        if constexpr (TransformedShapeType::isRigid)
         {
-            auto inv = sh.worldToLocal.inverse();
+            Ray localRay(
+                sh.worldToLocal() * ray.origin(),
+                sh.worldToLocal().withoutTranslation() * ray.direction()
+            );
 
-            hit.dist /= DLen;
-            hit.point = inv * hit.point;
-            hit.normal = inv * hit.normal;
+            if (raycast(localRay, sh.shape(), hit))
+            {
+                hit.point = sh.localToWorld() * hit.point;
+                hit.normal = sh.normalToWorld(hit.normal);
 
-            return true;
+                return true;
+            }
+
+            return false;
         }
         else
         {
-            hit.dist = oldHitDist;
-        }
+            const Vec3f D = sh.worldToLocal().withoutTranslation() * ray.direction();
+            const float DLen = D.length();
+            Ray localRay(
+                sh.worldToLocal() * ray.origin(),
+                D.normalized()
+            );
+
+            const float oldHitDist = hit.dist;
+            hit.dist *= DLen;
+            if (raycast(localRay, sh.shape(), hit))
+            {
+                hit.dist /= DLen;
+                hit.point = sh.localToWorld() * hit.point;
+                hit.normal = sh.normalToWorld(hit.normal);
 
-        return false;
+                return true;
+            }
+            else
+            {
+                hit.dist = oldHitDist;
+            }
+
+            return false;
+        }
     }
 
     template <typename TransformT, typename ShapeT, typename DataT>
@@ -1332,20 +1919,52 @@ namespace ray
         //   - if not:
         //     - we don't have to do anything
 
-        const Vec3f D = sh.worldToLocal.withoutTranslation() * ray.direction();
-        const float DLen = D.length();
-        Ray localRay(
-            sh.worldToLocal * ray.origin(),
-            D.normalized()
-        );
+        using TransformedShapeType = TransformedShape3<TransformT, ShapeT>;
 
-        if (raycastIntervals(localRay, sh.shape, hitIntervals))
+        if constexpr (TransformedShapeType::isRigid)
         {
-            hitIntervals.positiveScale(1.0f / DLen);
+            Ray localRay(
+                sh.worldToLocal() * ray.origin(),
+                sh.worldToLocal().withoutTranslation() * ray.direction()
+            );
 
-            return true;
+            return raycastIntervals(localRay, sh.shape(), hitIntervals);
+        }
+        else
+        {
+            const Vec3f D = sh.worldToLocal().withoutTranslation() * ray.direction();
+            const float DLen = D.length();
+            Ray localRay(
+                sh.worldToLocal() * ray.origin(),
+                D.normalized()
+            );
+
+            if (raycastIntervals(localRay, sh.shape(), hitIntervals))
+            {
+                hitIntervals.positiveScale(1.0f / DLen);
+
+                return true;
+            }
+
+            return false;
         }
+    }
 
-        return false;
+    // Packet fallback for shapes without a packet kernel, the rays are tested one by one.
+    template <typename ShapeT, typename HitPacketT>
+    [[nodiscard]] inline std::uint8_t raycast(const RayPacket4& rays, const ShapeT& shape, std::uint8_t activeMask, HitPacketT& hits)
+    {
+        std::uint8_t mask = 0;
+        for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+        {
+            if ((activeMask & (1 << lane)) == 0) continue;
+
+            if (raycast(rays.ray(lane), shape, hits[lane]))
+            {
+                mask |= 1 << lane;
+            }
+        }
+
+        return mask;
     }
 }
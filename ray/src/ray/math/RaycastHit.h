@@ -1,7 +1,11 @@
 #pragma once
 
+#include "Float4.h"
+
 #include <ray/material/Material.h>
 
+#include <cstdint>
+
 namespace ray
 {
     // for bounding volumes we don't need that much information
@@ -10,6 +14,25 @@ namespace ray
         float dist;
     };
 
+    // Result of testing 4 bounding volumes at once.
+    // Only the first numHits entries of dist and lanes are valid,
+    // they are ordered by increasing distance.
+    struct RaycastBvHit4
+    {
+        float dist[4];
+        int lanes[4]; // which of the 4 volumes was hit
+        int numHits;
+        std::uint8_t mask;
+    };
+
+    // Result of testing the 4 rays of a packet against one bounding volume.
+    // dist is only valid for lanes set in mask.
+    struct RaycastBvHitPacket4
+    {
+        Float4 dist;
+        std::uint8_t mask;
+    };
+
     struct RaycastHit
     {
         Point3f point;
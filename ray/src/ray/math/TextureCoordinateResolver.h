@@ -12,9 +12,11 @@
 #include <ray/shape/Cylinder.h>
 #include <ray/shape/OrientedBox3.h>
 #include <ray/shape/Disc3.h>
+#include <ray/shape/IndexedTriangleMesh.h>
 #include <ray/shape/Triangle3.h>
 #include <ray/shape/Plane.h>
 #include <ray/shape/Sdf.h>
+#include <ray/shape/SharedShape.h>
 #include <ray/shape/Sphere.h>
 #include <ray/shape/TransformedShape3.h>
 
@@ -31,7 +33,7 @@ namespace ray
         // atan2 returns a value in the range [-pi, pi] and we need to remap it to range [0, 1]
         // acosf returns a value in the range [0, pi] and we also need to remap it to the range [0, 1]
         const float u = (1.0f + std::atan2(hit.normal.z, hit.normal.x) / pi) * 0.5f;
-        const float v = std::acosf(hit.normal.y) / pi;
+        const float v = std::acos(hit.normal.y) / pi;
 
         return { u, v };
     }
@@ -115,13 +117,27 @@ namespace ray
         return tri.vertex(0).uv * bc.u + tri.vertex(1).uv * bc.v + tri.vertex(2).uv * bc.w;
     }
 
+    [[nodiscard]] inline TexCoords resolveTexCoords(const IndexedTriangleMesh& mesh, const RaycastHit& hit)
+    {
+        // the raycast stores the face that was hit
+        const IndexedTriangleMesh::Face& face = *static_cast<const IndexedTriangleMesh::Face*>(hit.additionalData);
+        BarycentricCoords bc = mesh.barycentric(face, hit.point);
+        return mesh.uv(face[0]) * bc.u + mesh.uv(face[1]) * bc.v + mesh.uv(face[2]) * bc.w;
+    }
+
+    template <typename ShapeT>
+    [[nodiscard]] inline TexCoords resolveTexCoords(const SharedShape<ShapeT>& sh, const RaycastHit& hit)
+    {
+        return resolveTexCoords(sh.shape(), hit);
+    }
+
     template <typename TransformT, typename ShapeT>
     [[nodiscard]] inline TexCoords resolveTexCoords(const TransformedShape3<TransformT, ShapeT>& sh, const RaycastHit& hit)
     {
         RaycastHit hitLocal = hit;
-        hitLocal.point = sh.worldToLocal * hitLocal.point;
-        hitLocal.normal = sh.worldToLocal * hitLocal.normal;
-        return resolveTexCoords(sh.shape, hitLocal);
+        hitLocal.point = sh.worldToLocal() * hitLocal.point;
+        hitLocal.normal = sh.worldToLocal() * hitLocal.normal;
+        return resolveTexCoords(sh.shape(), hitLocal);
     }
 
     template <typename ClippingShapeT>
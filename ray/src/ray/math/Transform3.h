@@ -4,6 +4,7 @@
 #include "m128/M128MatrixOperations.h"
 
 #include "Basis3.h"
+#include "Matrix3.h"
 #include "Matrix4.h"
 #include "OrthonormalBasis3.h"
 #include "Quat4.h"
@@ -0,0 +1,294 @@
+#pragma once
+
+#include "Ray.h"
+#include "Vec3.h"
+
+#include <ray/shape/TriangleVertexPack8.h>
+
+#include <ray/utility/CpuFeatures.h>
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+#include <immintrin.h>
+
+// The avx2 kernel is compiled in regardless of the target architecture and only used when the cpu supports it.
+// msvc allows avx intrinsics anywhere, gcc and clang need them enabled per function.
+// fma is deliberately not enabled, contracted products would break the symmetry the watertight test relies on.
+#if defined(__GNUC__) || defined(__clang__)
+#define RAY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define RAY_TARGET_AVX2
+#endif
+
+namespace ray
+{
+    // Ray transformed for the watertight triangle test [Woop et al. 2013].
+    // The axis the direction is largest along becomes z and the ray is sheared to point along it,
+    // so the triangle can be tested in 2d. Edge functions are evaluated on the vertices directly,
+    // which makes hits on edges shared by two triangles consistent - rays can't slip between them.
+    struct WatertightRay
+    {
+        float origin[3];
+        float sx;
+        float sy;
+        float sz;
+        int kx;
+        int ky;
+        int kz;
+
+        explicit WatertightRay(const Ray& ray) noexcept
+        {
+            const Point3f o = ray.origin();
+            const Vec3f d = ray.direction();
+            const float dir[3] = { d.x, d.y, d.z };
+            origin[0] = o.x;
+            origin[1] = o.y;
+            origin[2] = o.z;
+
+            const Vec3f a = abs(d);
+            kz = a.x >= a.y && a.x >= a.z ? 0 : a.y >= a.z ? 1 : 2;
+            kx = kz == 2 ? 0 : kz + 1;
+            ky = kx == 2 ? 0 : kx + 1;
+            // keeps the winding, so the sign of the determinant still tells the side that was hit
+            if (dir[kz] < 0.0f) std::swap(kx, ky);
+
+            sx = dir[kx] / dir[kz];
+            sy = dir[ky] / dir[kz];
+            sz = 1.0f / dir[kz];
+        }
+    };
+
+    // Barycentric coordinates are weights of the respective vertices.
+    // det is positive when the ray enters the triangle's front face.
+    struct TriangleVertexPack8Hit
+    {
+        float dist;
+        float u;
+        float v;
+        float w;
+        float det;
+        int lane;
+    };
+
+    namespace detail
+    {
+        // Picks the nearest of the lanes set in mask and fills the hit. mask must be non-zero.
+        inline void resolveWatertightHit(const float* t, const float* u, const float* v, const float* w, const float* det, std::uint32_t mask, TriangleVertexPack8Hit& hit)
+        {
+            int best = -1;
+            for (int i = 0; i < TriangleVertexPack8::numShapes; ++i)
+            {
+                if ((mask & (1u << i)) == 0) continue;
+                if (best == -1 || t[i] < t[best]) best = i;
+            }
+
+            const float invDet = 1.0f / det[best];
+            hit.dist = t[best];
+            hit.u = u[best] * invDet;
+            hit.v = v[best] * invDet;
+            hit.w = w[best] * invDet;
+            hit.det = det[best];
+            hit.lane = best;
+        }
+
+        // An edge function that is 0 in float can come from rounding, the ray could be on either side of the edge.
+        // Recomputes the edge functions of the lanes set in mask in double, where the products are exact,
+        // so that the sign is right [Woop et al. 2013].
+        template <int NumLanesV>
+        inline void recomputeWatertightEdges(const float (&px)[3][NumLanesV], const float (&py)[3][NumLanesV], std::uint32_t mask, float (&e)[3][NumLanesV])
+        {
+            for (int i = 0; i < NumLanesV; ++i)
+            {
+                if ((mask & (1u << i)) == 0) continue;
+
+                e[0][i] = static_cast<float>(static_cast<double>(px[2][i]) * py[1][i] - static_cast<double>(py[2][i]) * px[1][i]);
+                e[1][i] = static_cast<float>(static_cast<double>(px[0][i]) * py[2][i] - static_cast<double>(py[0][i]) * px[2][i]);
+                e[2][i] = static_cast<float>(static_cast<double>(px[1][i]) * py[0][i] - static_cast<double>(py[1][i]) * px[0][i]);
+            }
+        }
+
+        // Lanes [first, first + 4) with sse. usedMask has a bit set for each used lane of the pack.
+        [[nodiscard]] inline std::uint32_t raycastWatertightSse(const WatertightRay& ray, const TriangleVertexPack8& tris, int first, std::uint32_t usedMask, float tMax, float* t, float* u, float* v, float* w, float* det)
+        {
+            const __m128 sx = _mm_set1_ps(ray.sx);
+            const __m128 sy = _mm_set1_ps(ray.sy);
+            const __m128 sz = _mm_set1_ps(ray.sz);
+            const __m128 ox = _mm_set1_ps(ray.origin[ray.kx]);
+            const __m128 oy = _mm_set1_ps(ray.origin[ray.ky]);
+            const __m128 oz = _mm_set1_ps(ray.origin[ray.kz]);
+
+            __m128 px[3];
+            __m128 py[3];
+            __m128 pz[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                const __m128 z = _mm_sub_ps(_mm_load_ps(tris.coords[i][ray.kz] + first), oz);
+                px[i] = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(tris.coords[i][ray.kx] + first), ox), _mm_mul_ps(sx, z));
+                py[i] = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(tris.coords[i][ray.ky] + first), oy), _mm_mul_ps(sy, z));
+                pz[i] = _mm_mul_ps(sz, z);
+            }
+
+            __m128 e0 = _mm_sub_ps(_mm_mul_ps(px[2], py[1]), _mm_mul_ps(py[2], px[1]));
+            __m128 e1 = _mm_sub_ps(_mm_mul_ps(px[0], py[2]), _mm_mul_ps(py[0], px[2]));
+            __m128 e2 = _mm_sub_ps(_mm_mul_ps(px[1], py[0]), _mm_mul_ps(py[1], px[0]));
+
+            const __m128 zero = _mm_setzero_ps();
+            const std::uint32_t zeroEdgeMask = (usedMask >> first) & static_cast<std::uint32_t>(_mm_movemask_ps(
+                _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(e0, zero), _mm_cmpeq_ps(e1, zero)), _mm_cmpeq_ps(e2, zero))
+            ));
+            if (zeroEdgeMask != 0)
+            {
+                alignas(16) float pxs[3][4];
+                alignas(16) float pys[3][4];
+                alignas(16) float es[3][4];
+                for (int i = 0; i < 3; ++i)
+                {
+                    _mm_store_ps(pxs[i], px[i]);
+                    _mm_store_ps(pys[i], py[i]);
+                }
+                _mm_store_ps(es[0], e0);
+                _mm_store_ps(es[1], e1);
+                _mm_store_ps(es[2], e2);
+                recomputeWatertightEdges(pxs, pys, zeroEdgeMask, es);
+                e0 = _mm_load_ps(es[0]);
+                e1 = _mm_load_ps(es[1]);
+                e2 = _mm_load_ps(es[2]);
+            }
+            const __m128 anyNegative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(e0, zero), _mm_cmplt_ps(e1, zero)), _mm_cmplt_ps(e2, zero));
+            const __m128 anyPositive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(e0, zero), _mm_cmpgt_ps(e1, zero)), _mm_cmpgt_ps(e2, zero));
+
+            const __m128 d = _mm_add_ps(_mm_add_ps(e0, e1), e2);
+            const __m128 scaledT = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, pz[0]), _mm_mul_ps(e1, pz[1])), _mm_mul_ps(e2, pz[2]));
+            const __m128 dist = _mm_div_ps(scaledT, d);
+
+            const __m128 isHit = _mm_andnot_ps(
+                _mm_and_ps(anyNegative, anyPositive),
+                _mm_and_ps(
+                    _mm_cmpneq_ps(d, zero),
+                    _mm_and_ps(_mm_cmpge_ps(dist, zero), _mm_cmplt_ps(dist, _mm_set1_ps(tMax)))
+                )
+            );
+
+            const std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_ps(isHit));
+            if (mask == 0) return 0;
+
+            _mm_storeu_ps(t + first, dist);
+            _mm_storeu_ps(u + first, e0);
+            _mm_storeu_ps(v + first, e1);
+            _mm_storeu_ps(w + first, e2);
+            _mm_storeu_ps(det + first, d);
+            return mask << first;
+        }
+
+        // Same as the sse version but all 8 lanes at once.
+        [[nodiscard]] RAY_TARGET_AVX2 inline std::uint32_t raycastWatertightAvx2(const WatertightRay& ray, const TriangleVertexPack8& tris, std::uint32_t usedMask, float tMax, float* t, float* u, float* v, float* w, float* det)
+        {
+            const __m256 sx = _mm256_set1_ps(ray.sx);
+            const __m256 sy = _mm256_set1_ps(ray.sy);
+            const __m256 sz = _mm256_set1_ps(ray.sz);
+            const __m256 ox = _mm256_set1_ps(ray.origin[ray.kx]);
+            const __m256 oy = _mm256_set1_ps(ray.origin[ray.ky]);
+            const __m256 oz = _mm256_set1_ps(ray.origin[ray.kz]);
+
+            __m256 px[3];
+            __m256 py[3];
+            __m256 pz[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                const __m256 z = _mm256_sub_ps(_mm256_load_ps(tris.coords[i][ray.kz]), oz);
+                px[i] = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(tris.coords[i][ray.kx]), ox), _mm256_mul_ps(sx, z));
+                py[i] = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(tris.coords[i][ray.ky]), oy), _mm256_mul_ps(sy, z));
+                pz[i] = _mm256_mul_ps(sz, z);
+            }
+
+            __m256 e0 = _mm256_sub_ps(_mm256_mul_ps(px[2], py[1]), _mm256_mul_ps(py[2], px[1]));
+            __m256 e1 = _mm256_sub_ps(_mm256_mul_ps(px[0], py[2]), _mm256_mul_ps(py[0], px[2]));
+            __m256 e2 = _mm256_sub_ps(_mm256_mul_ps(px[1], py[0]), _mm256_mul_ps(py[1], px[0]));
+
+            const __m256 zero = _mm256_setzero_ps();
+            const std::uint32_t zeroEdgeMask = usedMask & static_cast<std::uint32_t>(_mm256_movemask_ps(
+                _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(e0, zero, _CMP_EQ_OQ), _mm256_cmp_ps(e1, zero, _CMP_EQ_OQ)), _mm256_cmp_ps(e2, zero, _CMP_EQ_OQ))
+            ));
+            if (zeroEdgeMask != 0)
+            {
+                alignas(32) float pxs[3][8];
+                alignas(32) float pys[3][8];
+                alignas(32) float es[3][8];
+                for (int i = 0; i < 3; ++i)
+                {
+                    _mm256_store_ps(pxs[i], px[i]);
+                    _mm256_store_ps(pys[i], py[i]);
+                }
+                _mm256_store_ps(es[0], e0);
+                _mm256_store_ps(es[1], e1);
+                _mm256_store_ps(es[2], e2);
+                recomputeWatertightEdges(pxs, pys, zeroEdgeMask, es);
+                e0 = _mm256_load_ps(es[0]);
+                e1 = _mm256_load_ps(es[1]);
+                e2 = _mm256_load_ps(es[2]);
+            }
+            const __m256 anyNegative = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(e0, zero, _CMP_LT_OQ), _mm256_cmp_ps(e1, zero, _CMP_LT_OQ)), _mm256_cmp_ps(e2, zero, _CMP_LT_OQ));
+            const __m256 anyPositive = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(e0, zero, _CMP_GT_OQ), _mm256_cmp_ps(e1, zero, _CMP_GT_OQ)), _mm256_cmp_ps(e2, zero, _CMP_GT_OQ));
+
+            const __m256 d = _mm256_add_ps(_mm256_add_ps(e0, e1), e2);
+            const __m256 scaledT = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e0, pz[0]), _mm256_mul_ps(e1, pz[1])), _mm256_mul_ps(e2, pz[2]));
+            const __m256 dist = _mm256_div_ps(scaledT, d);
+
+            const __m256 isHit = _mm256_andnot_ps(
+                _mm256_and_ps(anyNegative, anyPositive),
+                _mm256_and_ps(
+                    _mm256_cmp_ps(d, zero, _CMP_NEQ_OQ),
+                    _mm256_and_ps(_mm256_cmp_ps(dist, zero, _CMP_GE_OQ), _mm256_cmp_ps(dist, _mm256_set1_ps(tMax), _CMP_LT_OQ))
+                )
+            );
+
+            const std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_ps(isHit));
+            if (mask == 0) return 0;
+
+            _mm256_storeu_ps(t, dist);
+            _mm256_storeu_ps(u, e0);
+            _mm256_storeu_ps(v, e1);
+            _mm256_storeu_ps(w, e2);
+            _mm256_storeu_ps(det, d);
+            return mask;
+        }
+    }
+
+    // Tests the first numTriangles triangles of the pack, hits must be closer than hit.dist.
+    // Uses avx2 when the cpu supports it and two sse halves otherwise.
+    [[nodiscard]] inline bool raycastWatertight(const WatertightRay& ray, const TriangleVertexPack8& tris, int numTriangles, TriangleVertexPack8Hit& hit)
+    {
+        static const bool useAvx2 = CpuFeatures::get().hasAvx2;
+
+        float t[TriangleVertexPack8::numShapes];
+        float u[TriangleVertexPack8::numShapes];
+        float v[TriangleVertexPack8::numShapes];
+        float w[TriangleVertexPack8::numShapes];
+        float det[TriangleVertexPack8::numShapes];
+
+        const std::uint32_t usedMask = (1u << numTriangles) - 1u;
+        std::uint32_t mask;
+        if (useAvx2)
+        {
+            mask = detail::raycastWatertightAvx2(ray, tris, usedMask, hit.dist, t, u, v, w, det);
+        }
+        else
+        {
+            mask = detail::raycastWatertightSse(ray, tris, 0, usedMask, hit.dist, t, u, v, w, det);
+            if (numTriangles > 4)
+            {
+                mask |= detail::raycastWatertightSse(ray, tris, 4, usedMask, hit.dist, t, u, v, w, det);
+            }
+        }
+
+        mask &= usedMask;
+        if (mask == 0) return false;
+
+        detail::resolveWatertightHit(t, u, v, w, det, mask, hit);
+        return true;
+    }
+}
+
+#undef RAY_TARGET_AVX2
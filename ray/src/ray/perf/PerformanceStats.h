@@ -2,61 +2,73 @@
 
 #include <ray/utility/Util.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <chrono>
 #include <cstdint>
-#include <intrin.h>
 #include <mutex>
+#include <new>
 #include <string>
 #include <thread>
 #include <tuple>
+#include <type_traits>
 #include <typeinfo>
 #include <vector>
 
 namespace ray 
 {
     struct Box3;
+    struct Box3Pack4;
     struct Capsule;
     struct ClosedTriangleMeshFace;
+    struct IndexedTriangleMesh;
     struct Cylinder;
     struct Disc3;
     struct HalfSphere;
     struct OrientedBox3;
     struct Plane;
     struct Sphere;
+    struct SpherePack4;
     struct Triangle3;
+    struct Triangle3Pack4;
 
     namespace perf
     {
+#if defined(__cpp_lib_hardware_interference_size)
         static constexpr std::size_t cacheLineSize = std::hardware_destructive_interference_size;
+#else
+        static constexpr std::size_t cacheLineSize = 64;
+#endif
 
         // provides same operations as atomic, but only exchange is atomic
+        // only the owning thread may add, other threads may only load or exchange
+        // so the addition is a relaxed load and store instead of a locked read-modify-write
         struct Count
         {
+            Count() noexcept :
+                m_value(0)
+            {
+            }
+
             Count& operator+=(std::uint64_t d)
             {
-                m_value += d;
+                m_value.store(m_value.load(std::memory_order_relaxed) + d, std::memory_order_relaxed);
                 return *this;
             }
 
             [[nodiscard]] std::uint64_t load() const
             {
-                return m_value;
+                return m_value.load(std::memory_order_relaxed);
             }
 
             std::uint64_t exchange(std::uint64_t d)
             {
-                std::int64_t s, new_s;
-                do {
-                    s = load();
-                    new_s = d;
-                } while (_InterlockedCompareExchange64(reinterpret_cast<volatile std::int64_t*>(&m_value), new_s, s) != s);
-                return s;
+                return m_value.exchange(d);
             }
 
         private:
-            std::uint64_t m_value;
+            std::atomic<std::uint64_t> m_value;
         };
 
         struct AtomicCount : std::atomic<std::uint64_t>
@@ -83,6 +95,21 @@ namespace ray
             }
         };
 
+        struct AtomicDouble : std::atomic<double>
+        {
+            using Base = std::atomic<double>;
+
+            AtomicDouble& operator+=(double c)
+            {
+                double s = Base::load();
+                double new_s;
+                do {
+                    new_s = s + c;
+                } while (!Base::compare_exchange_strong(s, new_s));
+                return *this;
+            }
+        };
+
         template <typename ShapeT, bool IsAtomicV>
         struct ObjectRaycastStats;
         template <typename BvShapeT, bool IsAtomicV>
@@ -164,11 +191,89 @@ namespace ray
             Count hits;
         };
 
+        // Durations bucketed by log2 of the number of nanoseconds.
+        // Bucket i holds durations in [2^(i-1), 2^i) ns, bucket 0 holds zero durations.
+        template <bool IsAtomicV>
+        struct TimeHistogram
+        {
+            using CountType = std::conditional_t<IsAtomicV, AtomicCount, Count>;
+
+            static constexpr int numBuckets = 40;
+
+            [[nodiscard]] static int bucket(std::chrono::nanoseconds dur)
+            {
+                std::uint64_t ns = static_cast<std::uint64_t>(std::max(dur.count(), static_cast<std::chrono::nanoseconds::rep>(0)));
+                int i = 0;
+                while (ns != 0 && i < numBuckets - 1)
+                {
+                    ns >>= 1;
+                    ++i;
+                }
+                return i;
+            }
+
+            void add(std::chrono::nanoseconds dur)
+            {
+                buckets[bucket(dur)] += 1;
+                totalNs += static_cast<std::uint64_t>(dur.count());
+            }
+
+            std::array<CountType, numBuckets> buckets;
+            CountType totalNs;
+        };
+
+        // Time spent in queries of arrays of a single shape type, per query.
+        // Shapes without their own entry are gathered under void.
+        template <typename ShapeT, bool IsAtomicV>
+        struct ObjectQueryTimeStats
+        {
+            using NonAtomicType = ObjectQueryTimeStats<ShapeT, false>;
+
+            TimeHistogram<IsAtomicV> time;
+        };
+
+        template <bool IsAtomicV>
+        using AllObjectQueryTimeStatsTypes = std::tuple <
+            ObjectQueryTimeStats<Box3, IsAtomicV>,
+            ObjectQueryTimeStats<Capsule, IsAtomicV>,
+            ObjectQueryTimeStats<ClosedTriangleMeshFace, IsAtomicV>,
+            ObjectQueryTimeStats<IndexedTriangleMesh, IsAtomicV>,
+            ObjectQueryTimeStats<Cylinder, IsAtomicV>,
+            ObjectQueryTimeStats<Disc3, IsAtomicV>,
+            ObjectQueryTimeStats<HalfSphere, IsAtomicV>,
+            ObjectQueryTimeStats<OrientedBox3, IsAtomicV>,
+            ObjectQueryTimeStats<Plane, IsAtomicV>,
+            ObjectQueryTimeStats<Sphere, IsAtomicV>,
+            ObjectQueryTimeStats<Triangle3, IsAtomicV>,
+            ObjectQueryTimeStats<void, IsAtomicV>
+        >;
+
+        namespace detail
+        {
+            template <typename T, typename TupleT>
+            struct TupleContains;
+
+            template <typename T, typename... Ts>
+            struct TupleContains<T, std::tuple<Ts...>> : std::disjunction<std::is_same<T, Ts>...> {};
+        }
+
+        template <typename ShapeT>
+        using ObjectQueryTimeKey = std::conditional_t<
+            detail::TupleContains<ObjectQueryTimeStats<ShapeT, false>, AllObjectQueryTimeStatsTypes<false>>::value,
+            ShapeT,
+            void
+        >;
+
+        // Reflection and refraction branches that were not traced are counted
+        // at the depth they would have been traced at.
         struct TraceStatsTotal
         {
             std::uint64_t all;
             std::uint64_t hits;
             std::uint64_t resolved;
+            std::uint64_t pruned; // contribution below the threshold
+            std::uint64_t killedByRoulette;
+            std::uint64_t depthCapped;
         };
 
         struct TraceStats
@@ -176,6 +281,14 @@ namespace ray
             AtomicCount all;
             AtomicCount hits;
             AtomicCount resolved;
+            AtomicCount pruned;
+            AtomicCount killedByRoulette;
+            AtomicCount depthCapped;
+
+            [[nodiscard]] TraceStatsTotal load() const
+            {
+                return { all.load(), hits.load(), resolved.load(), pruned.load(), killedByRoulette.load(), depthCapped.load() };
+            }
         };
 
         struct TimeStats
@@ -183,20 +296,136 @@ namespace ray
             AtomicDuration time;
         };
 
+        // Phases of acceleration structure construction.
+        enum struct ConstructionPhase
+        {
+            Gather, // computing bounding volumes of the objects
+            Build, // partitioning and creating nodes
+            Finalize // rearranging the created tree into its final layout
+        };
+
+        static constexpr int numConstructionPhases = 3;
+
+        [[nodiscard]] inline const char* constructionPhaseName(ConstructionPhase phase)
+        {
+            switch (phase)
+            {
+            case ConstructionPhase::Gather:
+                return "gather";
+            case ConstructionPhase::Build:
+                return "build";
+            case ConstructionPhase::Finalize:
+                return "finalize";
+            }
+            return "";
+        }
+
+        // Phases of rendering timed by ScopedRenderPhaseTimer.
+        // Phases nest, the self time of a phase excludes the phases nested in it.
+        enum struct RenderPhase
+        {
+            Pixel, // all work for a single pixel, the self time is the sampler overhead
+            Traversal, // walking the acceleration structure
+            LeafIntersection, // raycasts against the objects in the leaves
+            Shading, // resolving the hit and computing its color
+            TextureSampling,
+            ShadowRays // raycasts towards the lights
+        };
+
+        static constexpr int numRenderPhases = 6;
+
+        [[nodiscard]] inline const char* renderPhaseName(RenderPhase phase)
+        {
+            switch (phase)
+            {
+            case RenderPhase::Pixel:
+                return "pixel";
+            case RenderPhase::Traversal:
+                return "traversal";
+            case RenderPhase::LeafIntersection:
+                return "leaf intersection";
+            case RenderPhase::Shading:
+                return "shading";
+            case RenderPhase::TextureSampling:
+                return "texture sampling";
+            case RenderPhase::ShadowRays:
+                return "shadow rays";
+            }
+            return "";
+        }
+
+        template <bool IsAtomicV>
+        struct RenderPhaseStats
+        {
+            using CountType = std::conditional_t<IsAtomicV, AtomicCount, Count>;
+
+            CountType count;
+            CountType timeNs;
+            CountType selfTimeNs;
+        };
+
+        // Running totals of the work done by a thread. They are never collected,
+        // the difference of two snapshots is the work done in between.
+        struct WorkCounters
+        {
+            std::uint64_t traces = 0;
+            std::uint64_t bvRaycasts = 0;
+            std::uint64_t objectRaycasts = 0; // includes interval and distance raycasts
+
+            [[nodiscard]] friend WorkCounters operator-(const WorkCounters& lhs, const WorkCounters& rhs)
+            {
+                WorkCounters diff;
+                diff.traces = lhs.traces - rhs.traces;
+                diff.bvRaycasts = lhs.bvRaycasts - rhs.bvRaycasts;
+                diff.objectRaycasts = lhs.objectRaycasts - rhs.objectRaycasts;
+                return diff;
+            }
+        };
+
+        // A single timed phase, exported as a complete event of the chrome trace format.
+        struct TraceEvent
+        {
+            RenderPhase phase;
+            int threadIndex;
+            std::chrono::high_resolution_clock::time_point start;
+            std::chrono::nanoseconds duration;
+        };
+
+        struct BvhStats
+        {
+            AtomicCount count;
+            AtomicDouble sahCost;
+        };
+
+        // Tiles rendered by the TileScheduler.
+        // Total time compared to numThreads * busiestThreadTime shows how well the work was balanced.
+        struct TileStats
+        {
+            AtomicCount count;
+            AtomicDuration time;
+            AtomicCount numThreads;
+            AtomicDuration busiestThreadTime;
+        };
+
         template <bool IsAtomicV>
         using AllRaycastStatsTypes = std::tuple <
             ObjectRaycastStats<Box3, IsAtomicV>,
+            ObjectRaycastStats<Box3Pack4, IsAtomicV>,
             ObjectRaycastStats<Capsule, IsAtomicV>,
             ObjectRaycastStats<ClosedTriangleMeshFace, IsAtomicV>,
+            ObjectRaycastStats<IndexedTriangleMesh, IsAtomicV>,
             ObjectRaycastStats<Cylinder, IsAtomicV>,
             ObjectRaycastStats<Disc3, IsAtomicV>,
             ObjectRaycastStats<HalfSphere, IsAtomicV>,
             ObjectRaycastStats<OrientedBox3, IsAtomicV>,
             ObjectRaycastStats<Plane, IsAtomicV>,
             ObjectRaycastStats<Sphere, IsAtomicV>,
+            ObjectRaycastStats<SpherePack4, IsAtomicV>,
             ObjectRaycastStats<Triangle3, IsAtomicV>,
+            ObjectRaycastStats<Triangle3Pack4, IsAtomicV>,
 
             BvRaycastStats<Box3, IsAtomicV>,
+            BvRaycastStats<Box3Pack4, IsAtomicV>,
 
             IntervalRaycastStats<Box3, IsAtomicV>,
             IntervalRaycastStats<Capsule, IsAtomicV>,
@@ -247,6 +476,21 @@ namespace ray
                 m_tracesByDepth[depth].resolved += count;
             }
 
+            void addPrunedBranch(int depth)
+            {
+                m_tracesByDepth[depth].pruned += 1;
+            }
+
+            void addRouletteKill(int depth)
+            {
+                m_tracesByDepth[depth].killedByRoulette += 1;
+            }
+
+            void addDepthCappedBranch(int depth)
+            {
+                m_tracesByDepth[depth].depthCapped += 1;
+            }
+
             template <typename ShapeT>
             void addObjectRaycast(std::uint64_t count = 1)
             {
@@ -305,6 +549,23 @@ namespace ray
                 m_constructionDuration.time += dur;
             }
 
+            void addConstructionTime(ConstructionPhase phase, std::chrono::nanoseconds dur)
+            {
+                m_constructionPhaseDurations[static_cast<int>(phase)].time += dur;
+            }
+
+            void addBvhSahCost(double cost)
+            {
+                m_bvhs.count += 1;
+                m_bvhs.sahCost += cost;
+            }
+
+            void addTileRenderTime(std::chrono::nanoseconds dur)
+            {
+                m_tiles.count += 1;
+                m_tiles.time += dur;
+            }
+
             [[nodiscard]] std::string summary() const
             {
                 std::string out;
@@ -324,14 +585,45 @@ namespace ray
                 auto traceTimeSeconds = static_cast<double>(m_traceDuration.time.load().count()) / 1e9;
                 TraceStatsTotal totalTraces = total(m_tracesByDepth);
                 out += "Scene constrution time: " + std::to_string(constructionTimeSeconds) + "s\n";
+                for (int i = 0; i < numConstructionPhases; ++i)
+                {
+                    auto phaseTime = m_constructionPhaseDurations[i].time.load();
+                    if (phaseTime.count() == 0) continue;
+                    auto phaseTimeSeconds = static_cast<double>(phaseTime.count()) / 1e9;
+                    out += "  " + std::string(constructionPhaseName(static_cast<ConstructionPhase>(i))) + ": " + std::to_string(phaseTimeSeconds) + "s\n";
+                }
                 out += "Trace time: " + std::to_string(traceTimeSeconds) + "s\n";
+                if (m_bvhs.count.load() > 0)
+                {
+                    out += "BVH SAH cost: " + std::to_string(m_bvhs.sahCost.load()) + " (" + std::to_string(m_bvhs.count.load()) + " bvh(s))\n";
+                }
+                if (m_tiles.count.load() > 0)
+                {
+                    auto tileTimeSeconds = static_cast<double>(m_tiles.time.load().count()) / 1e9;
+                    auto busiestThreadTimeSeconds = static_cast<double>(m_tiles.busiestThreadTime.load().count()) / 1e9;
+                    auto balance = tileTimeSeconds / (busiestThreadTimeSeconds * static_cast<double>(m_tiles.numThreads.load())) * 100.0;
+                    out += "Tiles: " + std::to_string(m_tiles.count.load()) + " on " + std::to_string(m_tiles.numThreads.load()) + " thread(s), " 
+                        + "tile time " + std::to_string(tileTimeSeconds) + "s, busiest thread " + std::to_string(busiestThreadTimeSeconds) + "s [" + std::to_string(balance) + "% balanced]\n";
+                }
                 out += "Total resolved/hits/rays: " + entry3(totalTraces.resolved, totalTraces.hits, totalTraces.all) + "\n";
                 for (int i = 0; i < m_tracesByDepth.size(); ++i)
                 {
                     if (m_tracesByDepth[i].all.load() == 0) continue;
                     out += "  hits/rays at depth " + std::to_string(i) + ": " + entry3(m_tracesByDepth[i].resolved.load(), m_tracesByDepth[i].hits.load(), m_tracesByDepth[i].all.load()) + "\n";
                 }
+                for (int i = 0; i < m_tracesByDepth.size(); ++i)
+                {
+                    const TraceStatsTotal s = m_tracesByDepth[i].load();
+                    if (s.pruned + s.killedByRoulette + s.depthCapped == 0) continue;
+                    out += "  not traced at depth " + std::to_string(i) + ": pruned " + std::to_string(s.pruned)
+                        + ", killed by roulette " + std::to_string(s.killedByRoulette)
+                        + ", depth capped " + std::to_string(s.depthCapped) + "\n";
+                }
                 out += "Rays/s: " + std::to_string(totalTraces.all / traceTimeSeconds) + "\n";
+                if (std::any_of(m_renderPhases.begin(), m_renderPhases.end(), [](const auto& phase) { return phase.count.load() > 0; }))
+                {
+                    out += renderPhaseTable();
+                }
 
                 for_each(m_raycasts, [&](const auto& c) {
                     using T = remove_cvref_t<decltype(c)>;
@@ -339,9 +631,245 @@ namespace ray
                     out += "   hits/all: " + entry2(c.hits.load(), c.all.load()) + "\n";
                     });
 
+                for_each(m_objectQueryTimes, [&](const auto& c) {
+                    using T = remove_cvref_t<decltype(c)>;
+                    if (c.time.totalNs.load() == 0) return;
+                    out += "Query time of " + std::string(typeid(T).name()) + ": " + std::to_string(static_cast<double>(c.time.totalNs.load()) / 1e9) + "s\n";
+                    out += "   queries by log2(ns):";
+                    for (int i = 0; i < c.time.buckets.size(); ++i)
+                    {
+                        if (c.time.buckets[i].load() == 0) continue;
+                        out += " " + std::to_string(i) + ":" + std::to_string(c.time.buckets[i].load());
+                    }
+                    out += "\n";
+                    });
+
+                return out;
+            }
+
+            // Same data as the summary, machine readable.
+            [[nodiscard]] std::string json() const
+            {
+                std::string out;
+
+                auto seconds = [](std::chrono::nanoseconds dur) {
+                    return std::to_string(static_cast<double>(dur.count()) / 1e9);
+                };
+
+                auto traces = [](const TraceStatsTotal& t) {
+                    return "{\"resolved\":" + std::to_string(t.resolved) + ",\"hits\":" + std::to_string(t.hits) + ",\"all\":" + std::to_string(t.all)
+                        + ",\"pruned\":" + std::to_string(t.pruned) + ",\"killedByRoulette\":" + std::to_string(t.killedByRoulette)
+                        + ",\"depthCapped\":" + std::to_string(t.depthCapped) + "}";
+                };
+
+                TraceStatsTotal totalTraces = total(m_tracesByDepth);
+                out += "{";
+                out += "\"constructionTime\":" + seconds(m_constructionDuration.time.load());
+                out += ",\"constructionPhaseTimes\":{";
+                for (int i = 0; i < numConstructionPhases; ++i)
+                {
+                    if (i != 0) out += ",";
+                    out += "\"" + std::string(constructionPhaseName(static_cast<ConstructionPhase>(i))) + "\":" + seconds(m_constructionPhaseDurations[i].time.load());
+                }
+                out += "}";
+                out += ",\"traceTime\":" + seconds(m_traceDuration.time.load());
+                out += ",\"bvhs\":{\"count\":" + std::to_string(m_bvhs.count.load()) + ",\"sahCost\":" + std::to_string(m_bvhs.sahCost.load()) + "}";
+                out += ",\"tiles\":{\"count\":" + std::to_string(m_tiles.count.load())
+                    + ",\"numThreads\":" + std::to_string(m_tiles.numThreads.load())
+                    + ",\"time\":" + seconds(m_tiles.time.load())
+                    + ",\"busiestThreadTime\":" + seconds(m_tiles.busiestThreadTime.load()) + "}";
+                out += ",\"renderPhases\":{";
+                for (int i = 0; i < numRenderPhases; ++i)
+                {
+                    if (i != 0) out += ",";
+                    out += "\"" + std::string(renderPhaseName(static_cast<RenderPhase>(i))) + "\":{"
+                        + "\"count\":" + std::to_string(m_renderPhases[i].count.load())
+                        + ",\"time\":" + seconds(std::chrono::nanoseconds(m_renderPhases[i].timeNs.load()))
+                        + ",\"selfTime\":" + seconds(std::chrono::nanoseconds(m_renderPhases[i].selfTimeNs.load())) + "}";
+                }
+                out += "}";
+                out += ",\"traces\":" + traces(totalTraces);
+                out += ",\"tracesByDepth\":[";
+                for (int i = 0; i < m_tracesByDepth.size(); ++i)
+                {
+                    if (i != 0) out += ",";
+                    out += traces(m_tracesByDepth[i].load());
+                }
+                out += "]";
+                out += ",\"raycasts\":[";
+                bool first = true;
+                for_each(m_raycasts, [&](const auto& c) {
+                    using T = remove_cvref_t<decltype(c)>;
+                    if (!first) out += ",";
+                    first = false;
+                    out += "{\"type\":\"" + std::string(typeid(T).name()) + "\",\"hits\":" + std::to_string(c.hits.load()) + ",\"all\":" + std::to_string(c.all.load()) + "}";
+                    });
+                out += "]";
+                out += ",\"objectQueryTimes\":[";
+                first = true;
+                for_each(m_objectQueryTimes, [&](const auto& c) {
+                    using T = remove_cvref_t<decltype(c)>;
+                    if (!first) out += ",";
+                    first = false;
+                    out += "{\"type\":\"" + std::string(typeid(T).name()) + "\",\"time\":" + std::to_string(static_cast<double>(c.time.totalNs.load()) / 1e9) + ",\"log2NsBuckets\":[";
+                    for (int i = 0; i < c.time.buckets.size(); ++i)
+                    {
+                        if (i != 0) out += ",";
+                        out += std::to_string(c.time.buckets[i].load());
+                    }
+                    out += "]}";
+                    });
+                out += "]";
+                out += "}";
+
                 return out;
             }
 
+            // Time of each render phase summed over all threads.
+            [[nodiscard]] std::string renderPhaseTable() const
+            {
+                auto column = [](std::string str, std::size_t width) {
+                    if (str.size() < width) str.resize(width, ' ');
+                    return str;
+                };
+
+                std::uint64_t totalSelfTimeNs = 0;
+                for (const auto& phase : m_renderPhases)
+                {
+                    totalSelfTimeNs += phase.selfTimeNs.load();
+                }
+
+                std::string out;
+                out += column("Render phase", 20) + column("count", 14) + column("time [s]", 14) + column("self time [s]", 16) + "self time [%]\n";
+                for (int i = 0; i < numRenderPhases; ++i)
+                {
+                    const auto& phase = m_renderPhases[i];
+                    const auto selfTimeNs = phase.selfTimeNs.load();
+                    out += column(renderPhaseName(static_cast<RenderPhase>(i)), 20)
+                        + column(std::to_string(phase.count.load()), 14)
+                        + column(std::to_string(static_cast<double>(phase.timeNs.load()) / 1e9), 14)
+                        + column(std::to_string(static_cast<double>(selfTimeNs) / 1e9), 16)
+                        + std::to_string(totalSelfTimeNs ? static_cast<double>(selfTimeNs) / static_cast<double>(totalSelfTimeNs) * 100.0 : 0.0) + "\n";
+                }
+
+                return out;
+            }
+
+            // Every samplingInterval-th outermost phase of each thread is recorded
+            // together with all phases nested in it, until the thread has recorded maxEventsPerThread events.
+            // Zero maxEventsPerThread disables recording.
+            void recordTraceEvents(std::size_t maxEventsPerThread, int samplingInterval = 1)
+            {
+                m_traceEventSamplingInterval.store(std::max(samplingInterval, 1), std::memory_order_relaxed);
+                m_maxTraceEventsPerThread.store(maxEventsPerThread, std::memory_order_relaxed);
+            }
+
+            // Recorded events in the chrome trace event format, viewable in chrome://tracing.
+            // Threads have to be collected first.
+            [[nodiscard]] std::string chromeTrace() const
+            {
+                auto micros = [](std::chrono::nanoseconds dur) {
+                    return std::to_string(static_cast<double>(dur.count()) / 1e3);
+                };
+
+                std::string out = "{\"traceEvents\":[";
+                bool first = true;
+                for (const TraceEvent& event : m_traceEvents)
+                {
+                    if (!first) out += ",";
+                    first = false;
+                    out += "\n{\"name\":\"" + std::string(renderPhaseName(event.phase)) + "\",\"cat\":\"render\",\"ph\":\"X\""
+                        + ",\"ts\":" + micros(event.start - m_epoch)
+                        + ",\"dur\":" + micros(event.duration)
+                        + ",\"pid\":0,\"tid\":" + std::to_string(event.threadIndex) + "}";
+                }
+                out += "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+                return out;
+            }
+
+            // Discards everything gathered so far, including what the threads didn't report yet.
+            void reset()
+            {
+                resetRenderStats();
+
+                std::lock_guard<std::mutex> lock(m_childrenMutex);
+                m_constructionDuration.time.store(std::chrono::nanoseconds(0));
+                for (auto& phase : m_constructionPhaseDurations)
+                {
+                    phase.time.store(std::chrono::nanoseconds(0));
+                }
+                m_bvhs.count.store(0);
+                m_bvhs.sahCost.store(0.0);
+            }
+
+            // Same as reset but keeps the construction stats,
+            // so that multiple renders of the same scene can be measured separately.
+            void resetRenderStats()
+            {
+                collect();
+
+                std::lock_guard<std::mutex> lock(m_childrenMutex);
+                for (auto& s : m_tracesByDepth)
+                {
+                    s.all.store(0);
+                    s.hits.store(0);
+                    s.resolved.store(0);
+                    s.pruned.store(0);
+                    s.killedByRoulette.store(0);
+                    s.depthCapped.store(0);
+                }
+                for_each(m_raycasts, [](auto& c) {
+                    c.all.store(0);
+                    c.hits.store(0);
+                    });
+                for_each(m_objectQueryTimes, [](auto& c) {
+                    for (auto& b : c.time.buckets)
+                    {
+                        b.store(0);
+                    }
+                    c.time.totalNs.store(0);
+                    });
+                m_traceDuration.time.store(std::chrono::nanoseconds(0));
+                m_tiles.count.store(0);
+                m_tiles.time.store(std::chrono::nanoseconds(0));
+                m_tiles.numThreads.store(0);
+                m_tiles.busiestThreadTime.store(std::chrono::nanoseconds(0));
+                for (auto& phase : m_renderPhases)
+                {
+                    phase.count.store(0);
+                    phase.timeNs.store(0);
+                    phase.selfTimeNs.store(0);
+                }
+                m_traceEvents.clear();
+                for (ThreadLocalPerformanceStats* child : m_children)
+                {
+                    resetTraceEventLimit(*child);
+                }
+                m_epoch = std::chrono::high_resolution_clock().now();
+            }
+
+            [[nodiscard]] TraceStatsTotal totalTraces() const
+            {
+                return total(m_tracesByDepth);
+            }
+
+            // For tuning the pruning policy, see Raytracer::Options.
+            [[nodiscard]] TraceStatsTotal tracesAtDepth(int depth) const
+            {
+                return m_tracesByDepth[depth].load();
+            }
+
+            [[nodiscard]] std::chrono::nanoseconds traceTime() const
+            {
+                return m_traceDuration.time.load();
+            }
+
+            [[nodiscard]] std::chrono::nanoseconds constructionTime() const
+            {
+                return m_constructionDuration.time.load();
+            }
+
             template <typename ShapeT>
             [[nodiscard]] decltype(auto) objectRaycasts() const
             {
@@ -369,8 +897,18 @@ namespace ray
         private:
             std::array<TraceStats, maxDepth + 1> m_tracesByDepth;
             AllRaycastStatsTypes<true> m_raycasts;
+            AllObjectQueryTimeStatsTypes<true> m_objectQueryTimes;
             TimeStats m_traceDuration;
             TimeStats m_constructionDuration;
+            std::array<TimeStats, numConstructionPhases> m_constructionPhaseDurations;
+            BvhStats m_bvhs;
+            TileStats m_tiles;
+            std::array<RenderPhaseStats<true>, numRenderPhases> m_renderPhases;
+            std::vector<TraceEvent> m_traceEvents;
+            std::atomic<std::size_t> m_maxTraceEventsPerThread{ 0 };
+            std::atomic<int> m_traceEventSamplingInterval{ 1 };
+            std::chrono::high_resolution_clock::time_point m_epoch = std::chrono::high_resolution_clock().now();
+            int m_nextThreadIndex = 0;
             std::vector<ThreadLocalPerformanceStats*> m_children;
             std::mutex m_childrenMutex;
 
@@ -408,17 +946,16 @@ namespace ray
                     tot.all += s.all.load();
                     tot.hits += s.hits.load();
                     tot.resolved += s.resolved.load();
+                    tot.pruned += s.pruned.load();
+                    tot.killedByRoulette += s.killedByRoulette.load();
+                    tot.depthCapped += s.depthCapped.load();
                 }
 
                 return tot;
             }
 
 
-            void registerChild(ThreadLocalPerformanceStats& child)
-            {
-                std::lock_guard<std::mutex> lock(m_childrenMutex);
-                m_children.emplace_back(&child);
-            }
+            void registerChild(ThreadLocalPerformanceStats& child);
 
             void collectRemove(ThreadLocalPerformanceStats& perf)
             {
@@ -432,6 +969,8 @@ namespace ray
             }
 
             void collect(ThreadLocalPerformanceStats& perf);
+
+            void resetTraceEventLimit(ThreadLocalPerformanceStats& perf);
         };
 
         struct alignas(cacheLineSize) ThreadLocalPerformanceStats
@@ -443,8 +982,19 @@ namespace ray
             explicit ThreadLocalPerformanceStats(AtomicPerformanceStats* parent = nullptr) noexcept :
                 m_tracesByDepth{},
                 m_raycasts{},
+                m_objectQueryTimes{},
                 m_traceDuration{},
                 m_constructionDuration{},
+                m_constructionPhaseDurations{},
+                m_bvhs{},
+                m_tiles{},
+                m_renderPhases{},
+                m_traceEvents{},
+                m_numRecordedTraceEvents{},
+                m_numOutermostPhases(0),
+                m_isRecordingTraceEvents(false),
+                m_threadIndex(0),
+                m_workCounters{},
                 m_parent(parent)
             {
                 if (m_parent)
@@ -469,6 +1019,7 @@ namespace ray
             void addTrace(int depth, std::uint64_t count = 1)
             {
                 m_tracesByDepth[depth].all += count;
+                m_workCounters.traces += count;
             }
 
             void addTraceHit(int depth, std::uint64_t count = 1)
@@ -481,10 +1032,26 @@ namespace ray
                 m_tracesByDepth[depth].resolved += count;
             }
 
+            void addPrunedBranch(int depth)
+            {
+                m_tracesByDepth[depth].pruned += 1;
+            }
+
+            void addRouletteKill(int depth)
+            {
+                m_tracesByDepth[depth].killedByRoulette += 1;
+            }
+
+            void addDepthCappedBranch(int depth)
+            {
+                m_tracesByDepth[depth].depthCapped += 1;
+            }
+
             template <typename ShapeT>
             void addObjectRaycast(std::uint64_t count = 1)
             {
                 objectRaycasts<ShapeT>().all += count;
+                m_workCounters.objectRaycasts += count;
             }
 
             template <typename ShapeT>
@@ -497,6 +1064,7 @@ namespace ray
             void addBvRaycast(std::uint64_t count = 1)
             {
                 bvRaycasts<BvShapeT>().all += count;
+                m_workCounters.bvRaycasts += count;
             }
 
             template <typename BvShapeT>
@@ -509,6 +1077,7 @@ namespace ray
             void addIntervalRaycast(std::uint64_t count = 1)
             {
                 intervalRaycasts<ShapeT>().all += count;
+                m_workCounters.objectRaycasts += count;
             }
 
             template <typename ShapeT>
@@ -521,6 +1090,7 @@ namespace ray
             void addDistRaycast(std::uint64_t count = 1)
             {
                 distRaycasts<ShapeT>().all += count;
+                m_workCounters.objectRaycasts += count;
             }
 
             template <typename ShapeT>
@@ -529,6 +1099,42 @@ namespace ray
                 distRaycasts<ShapeT>().hits += count;
             }
 
+            [[nodiscard]] const WorkCounters& workCounters() const
+            {
+                return m_workCounters;
+            }
+
+            template <typename ShapeT>
+            [[nodiscard]] TimeHistogram<false>& objectQueryTimes()
+            {
+                return std::get<ObjectQueryTimeStats<ObjectQueryTimeKey<ShapeT>, false>>(m_objectQueryTimes).time;
+            }
+
+            // Decides whether the outermost phase that is starting and the phases nested in it are recorded as trace events.
+            void beginOutermostRenderPhase()
+            {
+                const std::size_t maxEvents = m_parent ? m_parent->m_maxTraceEventsPerThread.load(std::memory_order_relaxed) : 0;
+                const int samplingInterval = m_parent ? m_parent->m_traceEventSamplingInterval.load(std::memory_order_relaxed) : 1;
+                m_isRecordingTraceEvents =
+                    m_numRecordedTraceEvents.load() < maxEvents
+                    && m_numOutermostPhases++ % static_cast<std::uint64_t>(samplingInterval) == 0;
+            }
+
+            void addRenderPhaseTime(RenderPhase phase, std::chrono::high_resolution_clock::time_point start, std::chrono::nanoseconds dur, std::chrono::nanoseconds nestedDur)
+            {
+                auto& stats = m_renderPhases[static_cast<int>(phase)];
+                stats.count += 1;
+                stats.timeNs += static_cast<std::uint64_t>(dur.count());
+                stats.selfTimeNs += static_cast<std::uint64_t>((dur - nestedDur).count());
+
+                if (m_isRecordingTraceEvents)
+                {
+                    std::lock_guard<std::mutex> lock(m_traceEventsMutex);
+                    m_traceEvents.emplace_back(TraceEvent{ phase, m_threadIndex, start, dur });
+                    m_numRecordedTraceEvents += 1;
+                }
+            }
+
             void addTraceTime(std::chrono::nanoseconds dur)
             {
                 m_traceDuration.time += dur;
@@ -539,6 +1145,23 @@ namespace ray
                 m_constructionDuration.time += dur;
             }
 
+            void addConstructionTime(ConstructionPhase phase, std::chrono::nanoseconds dur)
+            {
+                m_constructionPhaseDurations[static_cast<int>(phase)].time += dur;
+            }
+
+            void addBvhSahCost(double cost)
+            {
+                m_bvhs.count += 1;
+                m_bvhs.sahCost += cost;
+            }
+
+            void addTileRenderTime(std::chrono::nanoseconds dur)
+            {
+                m_tiles.count += 1;
+                m_tiles.time += dur;
+            }
+
             template <typename ShapeT>
             [[nodiscard]] decltype(auto) objectRaycasts() const
             {
@@ -566,10 +1189,21 @@ namespace ray
         private:
             std::array<TraceStats, maxDepth + 1> m_tracesByDepth;
             AllRaycastStatsTypes<false> m_raycasts;
+            AllObjectQueryTimeStatsTypes<false> m_objectQueryTimes;
             TimeStats m_traceDuration;
             TimeStats m_constructionDuration;
+            std::array<TimeStats, numConstructionPhases> m_constructionPhaseDurations;
+            BvhStats m_bvhs;
+            TileStats m_tiles;
+            std::array<RenderPhaseStats<false>, numRenderPhases> m_renderPhases;
+            std::vector<TraceEvent> m_traceEvents;
+            Count m_numRecordedTraceEvents;
+            std::uint64_t m_numOutermostPhases;
+            bool m_isRecordingTraceEvents;
+            int m_threadIndex;
+            WorkCounters m_workCounters;
             AtomicPerformanceStats* m_parent;
-            std::mutex m_childrenMutex;
+            std::mutex m_traceEventsMutex;
 
             template <typename ShapeT>
             [[nodiscard]] decltype(auto) objectRaycasts()
@@ -596,13 +1230,28 @@ namespace ray
             }
         };
 
-        void AtomicPerformanceStats::collect(ThreadLocalPerformanceStats& perf)
+        inline void AtomicPerformanceStats::registerChild(ThreadLocalPerformanceStats& child)
+        {
+            std::lock_guard<std::mutex> lock(m_childrenMutex);
+            child.m_threadIndex = m_nextThreadIndex++;
+            m_children.emplace_back(&child);
+        }
+
+        inline void AtomicPerformanceStats::resetTraceEventLimit(ThreadLocalPerformanceStats& perf)
+        {
+            perf.m_numRecordedTraceEvents.exchange(0);
+        }
+
+        inline void AtomicPerformanceStats::collect(ThreadLocalPerformanceStats& perf)
         {
             for (int i = 0; i <= maxDepth; ++i)
             {
                 m_tracesByDepth[i].all += perf.m_tracesByDepth[i].all.exchange(0);
                 m_tracesByDepth[i].hits += perf.m_tracesByDepth[i].hits.exchange(0);
                 m_tracesByDepth[i].resolved += perf.m_tracesByDepth[i].resolved.exchange(0);
+                m_tracesByDepth[i].pruned += perf.m_tracesByDepth[i].pruned.exchange(0);
+                m_tracesByDepth[i].killedByRoulette += perf.m_tracesByDepth[i].killedByRoulette.exchange(0);
+                m_tracesByDepth[i].depthCapped += perf.m_tracesByDepth[i].depthCapped.exchange(0);
             }
 
             for_each(m_raycasts, [&perf](auto& c) {
@@ -611,11 +1260,112 @@ namespace ray
                 c.hits += std::get<T>(perf.m_raycasts).hits.exchange(0);
                 });
 
+            for_each(m_objectQueryTimes, [&perf](auto& c) {
+                using T = typename remove_cvref_t<decltype(c)>::NonAtomicType;
+                auto& local = std::get<T>(perf.m_objectQueryTimes);
+                for (int i = 0; i < c.time.buckets.size(); ++i)
+                {
+                    c.time.buckets[i] += local.time.buckets[i].exchange(0);
+                }
+                c.time.totalNs += local.time.totalNs.exchange(0);
+                });
+
             m_traceDuration.time += perf.m_traceDuration.time.exchange(std::chrono::nanoseconds(0));
             m_constructionDuration.time += perf.m_constructionDuration.time.exchange(std::chrono::nanoseconds(0));
+            for (int i = 0; i < numConstructionPhases; ++i)
+            {
+                m_constructionPhaseDurations[i].time += perf.m_constructionPhaseDurations[i].time.exchange(std::chrono::nanoseconds(0));
+            }
+            m_bvhs.count += perf.m_bvhs.count.exchange(0);
+            m_bvhs.sahCost += perf.m_bvhs.sahCost.exchange(0.0);
+
+            // Called with m_childrenMutex locked so the busiest thread can be updated non atomically.
+            const auto tileTime = perf.m_tiles.time.exchange(std::chrono::nanoseconds(0));
+            m_tiles.count += perf.m_tiles.count.exchange(0);
+            if (tileTime.count() > 0)
+            {
+                m_tiles.time += tileTime;
+                m_tiles.numThreads += 1;
+                if (tileTime > m_tiles.busiestThreadTime.load())
+                {
+                    m_tiles.busiestThreadTime.store(tileTime);
+                }
+            }
+
+            for (int i = 0; i < numRenderPhases; ++i)
+            {
+                m_renderPhases[i].count += perf.m_renderPhases[i].count.exchange(0);
+                m_renderPhases[i].timeNs += perf.m_renderPhases[i].timeNs.exchange(0);
+                m_renderPhases[i].selfTimeNs += perf.m_renderPhases[i].selfTimeNs.exchange(0);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(perf.m_traceEventsMutex);
+                m_traceEvents.insert(m_traceEvents.end(), perf.m_traceEvents.begin(), perf.m_traceEvents.end());
+                perf.m_traceEvents.clear();
+            }
         }
 
         inline AtomicPerformanceStats gGlobalPerfStats;
         inline thread_local ThreadLocalPerformanceStats gThreadLocalPerfStats(&gGlobalPerfStats);
+
+        struct ScopedRenderPhaseTimer;
+
+        // Innermost running timer of the thread, nested timers report their time to it.
+        inline thread_local ScopedRenderPhaseTimer* gCurrentRenderPhaseTimer = nullptr;
+
+        // Adds the lifetime of the timer to the render phase of the calling thread.
+        struct ScopedRenderPhaseTimer
+        {
+            explicit ScopedRenderPhaseTimer(RenderPhase phase, TimeHistogram<false>* histogram = nullptr) noexcept :
+                m_phase(phase),
+                m_histogram(histogram),
+                m_parent(gCurrentRenderPhaseTimer),
+                m_nestedDuration(0)
+            {
+                if (m_parent == nullptr)
+                {
+                    gThreadLocalPerfStats.beginOutermostRenderPhase();
+                }
+                gCurrentRenderPhaseTimer = this;
+                m_start = std::chrono::high_resolution_clock().now();
+            }
+
+            ScopedRenderPhaseTimer(const ScopedRenderPhaseTimer&) = delete;
+            ScopedRenderPhaseTimer& operator=(const ScopedRenderPhaseTimer&) = delete;
+
+            ~ScopedRenderPhaseTimer()
+            {
+                const std::chrono::nanoseconds dur = std::chrono::high_resolution_clock().now() - m_start;
+                gThreadLocalPerfStats.addRenderPhaseTime(m_phase, m_start, dur, m_nestedDuration);
+                if (m_histogram)
+                {
+                    m_histogram->add(dur);
+                }
+
+                if (m_parent)
+                {
+                    m_parent->m_nestedDuration += dur;
+                }
+                gCurrentRenderPhaseTimer = m_parent;
+            }
+
+        private:
+            RenderPhase m_phase;
+            TimeHistogram<false>* m_histogram;
+            ScopedRenderPhaseTimer* m_parent;
+            std::chrono::nanoseconds m_nestedDuration;
+            std::chrono::high_resolution_clock::time_point m_start;
+        };
+
+        // Leaf intersection timer that also adds to the query time histogram of ShapeT.
+        template <typename ShapeT>
+        struct ScopedObjectQueryTimer : ScopedRenderPhaseTimer
+        {
+            ScopedObjectQueryTimer() noexcept :
+                ScopedRenderPhaseTimer(RenderPhase::LeafIntersection, &gThreadLocalPerfStats.objectQueryTimes<ShapeT>())
+            {
+            }
+        };
     }
 }
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "PerformanceStats.h"
+
+#include <ray/material/Color.h>
+
+#include <ray/math/Ray.h>
+#include <ray/math/Vec2.h>
+
+#include <ray/utility/Array2.h>
+
+#include <ray/Image.h>
+#include <ray/Viewport.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace ray
+{
+    namespace perf
+    {
+        enum struct PixelCostChannel
+        {
+            BvRaycasts, // bounding volumes tested, roughly bvh nodes visited
+            ObjectRaycasts, // primitive tests, including interval and distance raycasts
+            SecondaryRays, // reflection, refraction and shadow rays
+            Time // nanoseconds
+        };
+
+        static constexpr int numPixelCostChannels = 4;
+
+        [[nodiscard]] inline const char* pixelCostChannelName(PixelCostChannel channel)
+        {
+            switch (channel)
+            {
+            case PixelCostChannel::BvRaycasts:
+                return "bv raycasts";
+            case PixelCostChannel::ObjectRaycasts:
+                return "object raycasts";
+            case PixelCostChannel::SecondaryRays:
+                return "secondary rays";
+            case PixelCostChannel::Time:
+                return "time";
+            }
+            return "";
+        }
+
+        // Work done by primary rays attributed to the pixels they pass through.
+        // Filled by Raytracer::capture, all pixels can be written concurrently.
+        struct PixelCostMap
+        {
+            PixelCostMap(int width, int height) :
+                m_bvRaycasts(width, height),
+                m_objectRaycasts(width, height),
+                m_secondaryRays(width, height),
+                m_timeNs(width, height)
+            {
+                clear();
+            }
+
+            void clear()
+            {
+                for (int x = 0; x < width(); ++x)
+                {
+                    for (int y = 0; y < height(); ++y)
+                    {
+                        for (int i = 0; i < numPixelCostChannels; ++i)
+                        {
+                            channelCounts(static_cast<PixelCostChannel>(i))(x, y).store(0, std::memory_order_relaxed);
+                        }
+                    }
+                }
+            }
+
+            // Work done tracing rays that started numPrimaryRays primary rays.
+            // Packets share the work, each ray gets an equal part of it.
+            void add(const Viewport& vp, const Ray* rays, int numPrimaryRays, const WorkCounters& work, std::chrono::nanoseconds time)
+            {
+                const std::uint64_t n = static_cast<std::uint64_t>(numPrimaryRays);
+                const std::uint64_t secondaryRays = work.traces - n;
+                const std::uint64_t timeNs = static_cast<std::uint64_t>(time.count());
+                for (int i = 0; i < numPrimaryRays; ++i)
+                {
+                    // the first ray takes the remainders
+                    const std::uint64_t extra = i == 0;
+                    const Point2i pixel = pixelOf(vp, rays[i]);
+                    m_bvRaycasts(pixel.x, pixel.y) += work.bvRaycasts / n + extra * (work.bvRaycasts % n);
+                    m_objectRaycasts(pixel.x, pixel.y) += work.objectRaycasts / n + extra * (work.objectRaycasts % n);
+                    m_secondaryRays(pixel.x, pixel.y) += secondaryRays / n + extra * (secondaryRays % n);
+                    m_timeNs(pixel.x, pixel.y) += timeNs / n + extra * (timeNs % n);
+                }
+            }
+
+            [[nodiscard]] Array2<float> channel(PixelCostChannel ch) const
+            {
+                const auto& counts = channelCounts(ch);
+                Array2<float> values(width(), height());
+                for (int x = 0; x < width(); ++x)
+                {
+                    for (int y = 0; y < height(); ++y)
+                    {
+                        values(x, y) = static_cast<float>(counts(x, y).load(std::memory_order_relaxed));
+                    }
+                }
+
+                return values;
+            }
+
+            // Black for no cost through blue, green and yellow to red for the most expensive pixel.
+            // With logarithmic scale the cost is compressed with log(1 + cost) first.
+            [[nodiscard]] Image falseColor(PixelCostChannel ch, bool logarithmic = false) const
+            {
+                Array2<float> values = channel(ch);
+                float maxValue = 0.0f;
+                for (int x = 0; x < width(); ++x)
+                {
+                    for (int y = 0; y < height(); ++y)
+                    {
+                        if (logarithmic)
+                        {
+                            values(x, y) = std::log1p(values(x, y));
+                        }
+                        maxValue = std::max(maxValue, values(x, y));
+                    }
+                }
+
+                Image img(width(), height());
+                const float invMaxValue = maxValue > 0.0f ? 1.0f / maxValue : 0.0f;
+                for (int x = 0; x < width(); ++x)
+                {
+                    for (int y = 0; y < height(); ++y)
+                    {
+                        img(x, y) = ColorRGBi(heat(values(x, y) * invMaxValue));
+                    }
+                }
+
+                return img;
+            }
+
+            [[nodiscard]] int width() const
+            {
+                return m_bvRaycasts.width();
+            }
+
+            [[nodiscard]] int height() const
+            {
+                return m_bvRaycasts.height();
+            }
+
+        private:
+            Array2<std::atomic<std::uint64_t>> m_bvRaycasts;
+            Array2<std::atomic<std::uint64_t>> m_objectRaycasts;
+            Array2<std::atomic<std::uint64_t>> m_secondaryRays;
+            Array2<std::atomic<std::uint64_t>> m_timeNs;
+
+            [[nodiscard]] Array2<std::atomic<std::uint64_t>>& channelCounts(PixelCostChannel ch)
+            {
+                switch (ch)
+                {
+                case PixelCostChannel::BvRaycasts:
+                    return m_bvRaycasts;
+                case PixelCostChannel::ObjectRaycasts:
+                    return m_objectRaycasts;
+                case PixelCostChannel::SecondaryRays:
+                    return m_secondaryRays;
+                default:
+                    return m_timeNs;
+                }
+            }
+
+            [[nodiscard]] const Array2<std::atomic<std::uint64_t>>& channelCounts(PixelCostChannel ch) const
+            {
+                return const_cast<PixelCostMap*>(this)->channelCounts(ch);
+            }
+
+            // Samples can be jittered outside of the pixel they belong to, they are clamped to the image.
+            [[nodiscard]] Point2i pixelOf(const Viewport& vp, const Ray& ray) const
+            {
+                const Point2f coords = vp.coordsOf(ray);
+                return Point2i(
+                    std::clamp(static_cast<int>(std::floor(coords.x + 0.5f)), 0, width() - 1),
+                    std::clamp(static_cast<int>(std::floor(coords.y + 0.5f)), 0, height() - 1)
+                );
+            }
+
+            [[nodiscard]] static ColorRGBf heat(float t)
+            {
+                static constexpr int numStops = 5;
+                static const ColorRGBf stops[numStops] = {
+                    ColorRGBf(0.0f, 0.0f, 0.0f),
+                    ColorRGBf(0.0f, 0.0f, 1.0f),
+                    ColorRGBf(0.0f, 1.0f, 0.0f),
+                    ColorRGBf(1.0f, 1.0f, 0.0f),
+                    ColorRGBf(1.0f, 0.0f, 0.0f)
+                };
+
+                const float s = std::clamp(t, 0.0f, 1.0f) * static_cast<float>(numStops - 1);
+                const int i = std::min(static_cast<int>(s), numStops - 2);
+                const float f = s - static_cast<float>(i);
+                return stops[i] * (1.0f - f) + stops[i + 1] * f;
+            }
+        };
+    }
+}
@@ -7,9 +7,9 @@
 #include <ray/math/Vec3.h>
 
 #include <ray/utility/Array2.h>
-#include <ray/utility/IntRange2.h>
 
 #include <ray/Camera.h>
+#include <ray/TileScheduler.h>
 
 #include <algorithm>
 #include <cmath>
@@ -36,8 +36,7 @@ namespace ray
             };
 
             Array2<ColorRGBf> samples(vp.widthPixels, vp.heightPixels);
-            auto range = IntRange2(Point2i(vp.widthPixels, vp.heightPixels));
-            std::for_each(exec, range.begin(), range.end(), [&](const Point2i& xyi) {
+            forEachPixel(exec, Point2i(vp.widthPixels, vp.heightPixels), [&](const Point2i& xyi) {
                 auto[xi, yi] = xyi;
                 samples(xi, yi) = sample(Point2f(static_cast<float>(xi), static_cast<float>(yi)));
             });
@@ -88,7 +87,7 @@ namespace ray
                 }
             };
 
-            std::for_each(exec, range.begin(), range.end(), [&](const Point2i& xyi) {
+            forEachPixel(exec, Point2i(vp.widthPixels, vp.heightPixels), [&](const Point2i& xyi) {
                 auto[xi, yi] = xyi;
                 if (xi == 0 || yi == 0 || xi == vp.widthPixels - 1 || yi == vp.heightPixels - 1)
                 {
@@ -7,9 +7,9 @@
 #include <ray/math/Vec3.h>
 
 #include <ray/utility/Array2.h>
-#include <ray/utility/IntRange2.h>
 
 #include <ray/Camera.h>
+#include <ray/TileScheduler.h>
 
 #include <algorithm>
 #include <cmath>
@@ -45,8 +45,7 @@ namespace ray
 
             Array2<ColorRGBf> supersamples(vp.widthPixels + 1, vp.heightPixels + 1);
             {
-                auto range = IntRange2(Point2i(vp.widthPixels + 1, vp.heightPixels + 1));
-                std::for_each(exec, range.begin(), range.end(), [&](const Point2i& xyi) {
+                forEachPixel(exec, Point2i(vp.widthPixels + 1, vp.heightPixels + 1), [&](const Point2i& xyi) {
                     auto[xi, yi] = xyi;
                     const Point2f xyf(static_cast<float>(xi), static_cast<float>(yi));
                     supersamples(xi, yi) = sample(xyf);
@@ -54,8 +53,7 @@ namespace ray
             }
 
             {
-                auto range = IntRange2(Point2i(vp.widthPixels, vp.heightPixels));
-                std::for_each(exec, range.begin(), range.end(), [&](const Point2i& xyi) {
+                forEachPixel(exec, Point2i(vp.widthPixels, vp.heightPixels), [&](const Point2i& xyi) {
                     auto[xi, yi] = xyi;
                     const Point2f xyf(static_cast<float>(xi), static_cast<float>(yi));
                     const ColorRGBf total =
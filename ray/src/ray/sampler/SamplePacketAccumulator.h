@@ -0,0 +1,76 @@
+#pragma once
+
+#include <ray/material/Color.h>
+
+#include <ray/math/RayPacket4.h>
+#include <ray/math/Vec2.h>
+
+#include <ray/Viewport.h>
+
+#include <array>
+#include <cstdint>
+
+namespace ray
+{
+    // Groups samples of a single pixel into packets of 4 rays and sums the traced colors.
+    // The last packet is padded with copies of its last ray, those lanes are masked out.
+    template <typename TracePacketFuncT>
+    struct SamplePacketAccumulator
+    {
+        SamplePacketAccumulator(const Viewport& vp, TracePacketFuncT& tracePacketFunc) :
+            m_viewport(&vp),
+            m_tracePacketFunc(&tracePacketFunc),
+            m_numSamples(0),
+            m_total{}
+        {
+        }
+
+        void add(const Point2f& coords)
+        {
+            m_coords[m_numSamples++] = coords;
+            if (m_numSamples == RayPacket4::numRays)
+            {
+                flush();
+            }
+        }
+
+        [[nodiscard]] ColorRGBf total()
+        {
+            if (m_numSamples > 0)
+            {
+                flush();
+            }
+
+            return m_total;
+        }
+
+    private:
+        const Viewport* m_viewport;
+        TracePacketFuncT* m_tracePacketFunc;
+        std::array<Point2f, RayPacket4::numRays> m_coords;
+        int m_numSamples;
+        ColorRGBf m_total;
+
+        void flush()
+        {
+            for (int i = m_numSamples; i < RayPacket4::numRays; ++i)
+            {
+                m_coords[i] = m_coords[m_numSamples - 1];
+            }
+
+            const RayPacket4 rays(
+                m_viewport->rayAt(m_coords[0]),
+                m_viewport->rayAt(m_coords[1]),
+                m_viewport->rayAt(m_coords[2]),
+                m_viewport->rayAt(m_coords[3])
+            );
+            const auto colors = (*m_tracePacketFunc)(rays, static_cast<std::uint8_t>((1 << m_numSamples) - 1));
+            for (int i = 0; i < m_numSamples; ++i)
+            {
+                m_total += colors[i];
+            }
+
+            m_numSamples = 0;
+        }
+    };
+}
@@ -3,15 +3,16 @@
 #include <ray/material/Color.h>
 
 #include <ray/math/Ray.h>
+#include <ray/math/RayPacket4.h>
 #include <ray/math/Vec2.h>
 #include <ray/math/Vec3.h>
 
-#include <ray/utility/IntRange2.h>
-
 #include <ray/Camera.h>
+#include <ray/TileScheduler.h>
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <execution>
 
 namespace ray
@@ -21,7 +22,7 @@ namespace ray
         template <typename FuncT>
         void forEachSampleOffset(const Point2i& pixel, FuncT func) const
         {
-            func(Point2f(0.0f, 0.0f));
+            func(Vec2f(0.0f, 0.0f), 1.0f);
         }
 
         template <typename TraceFuncT, typename StoreFuncT, typename ExecT = std::execution::sequenced_policy>
@@ -33,12 +34,50 @@ namespace ray
                 return traceFunc(vp.rayAt(coords));
             };
 
-            auto range = IntRange2(Point2i(vp.widthPixels, vp.heightPixels));
-            std::for_each(exec, range.begin(), range.end(), [&](const Point2i& xyi) {
+            forEachPixel(exec, Point2i(vp.widthPixels, vp.heightPixels), [&](const Point2i& xyi) {
                 auto[xi, yi] = xyi;
                 const Point2f xyf(static_cast<float>(xi), static_cast<float>(yi));
                 storeFunc(xyi, sample(xyf));
             });
         }
+
+        // Traces 2x2 blocks of pixels as one packet.
+        // At the right and bottom edges lanes outside of the image repeat the edge pixels and are masked out.
+        template <typename TracePacketFuncT, typename StoreFuncT, typename ExecT = std::execution::sequenced_policy>
+        void forEachSamplePacket(const Camera& camera, TracePacketFuncT tracePacketFunc, StoreFuncT storeFunc, ExecT exec = ExecT{}) const
+        {
+            const Viewport vp = camera.viewport();
+
+            auto pixelAt = [&](const Point2i& block, int lane) {
+                return Point2i(
+                    std::min(block.x * 2 + (lane & 1), vp.widthPixels - 1),
+                    std::min(block.y * 2 + (lane >> 1), vp.heightPixels - 1)
+                );
+            };
+
+            auto rayAt = [&](const Point2i& xyi) {
+                return vp.rayAt(Point2f(static_cast<float>(xyi.x), static_cast<float>(xyi.y)));
+            };
+
+            forEachPixel(exec, Point2i((vp.widthPixels + 1) / 2, (vp.heightPixels + 1) / 2), [&](const Point2i& block) {
+                const RayPacket4 rays(
+                    rayAt(pixelAt(block, 0)),
+                    rayAt(pixelAt(block, 1)),
+                    rayAt(pixelAt(block, 2)),
+                    rayAt(pixelAt(block, 3))
+                );
+                const bool hasRight = block.x * 2 + 1 < vp.widthPixels;
+                const bool hasBottom = block.y * 2 + 1 < vp.heightPixels;
+                const std::uint8_t activeMask = 0b0001 | (hasRight << 1) | (hasBottom << 2) | ((hasRight && hasBottom) << 3);
+                const auto colors = tracePacketFunc(rays, activeMask);
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    if (activeMask & (1 << lane))
+                    {
+                        storeFunc(pixelAt(block, lane), colors[lane]);
+                    }
+                }
+            });
+        }
     };
 }
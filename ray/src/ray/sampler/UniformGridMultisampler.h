@@ -6,9 +6,10 @@
 #include <ray/math/Vec2.h>
 #include <ray/math/Vec3.h>
 
-#include <ray/utility/IntRange2.h>
+#include <ray/sampler/SamplePacketAccumulator.h>
 
 #include <ray/Camera.h>
+#include <ray/TileScheduler.h>
 
 #include <algorithm>
 #include <cmath>
@@ -56,8 +57,7 @@ namespace ray
 
             const float singleSampleContribution = 1.0f / static_cast<float>(m_offsets.size());
 
-            auto range = IntRange2(Point2i(vp.widthPixels, vp.heightPixels));
-            std::for_each(exec, range.begin(), range.end(), [&](const Point2i& xyi) {
+            forEachPixel(exec, Point2i(vp.widthPixels, vp.heightPixels), [&](const Point2i& xyi) {
                 auto[xi, yi] = xyi;
                 const Point2f xyf(static_cast<float>(xi), static_cast<float>(yi));
                 ColorRGBf totalColor{};
@@ -68,6 +68,25 @@ namespace ray
             });
         }
 
+        // Samples of a pixel are traced in packets of 4.
+        template <typename TracePacketFuncT, typename StoreFuncT, typename ExecT = std::execution::sequenced_policy>
+        void forEachSamplePacket(const Camera& camera, TracePacketFuncT tracePacketFunc, StoreFuncT storeFunc, ExecT exec = ExecT{}) const
+        {
+            const Viewport vp = camera.viewport();
+
+            const float singleSampleContribution = 1.0f / static_cast<float>(m_offsets.size());
+
+            forEachPixel(exec, Point2i(vp.widthPixels, vp.heightPixels), [&](const Point2i& xyi) {
+                auto[xi, yi] = xyi;
+                const Point2f xyf(static_cast<float>(xi), static_cast<float>(yi));
+                SamplePacketAccumulator accumulator(vp, tracePacketFunc);
+                forEachSampleOffset(xyi, [&](const Vec2f& offset, float c) {
+                    accumulator.add(xyf + offset);
+                });
+                storeFunc(xyi, accumulator.total() * singleSampleContribution);
+            });
+        }
+
     private:
         std::vector<Vec2f> m_offsets;
     };
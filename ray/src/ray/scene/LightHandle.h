@@ -1,16 +1,26 @@
 #pragma once
 
+#include "SceneRaycastHit.h"
+
+#include "object/SceneObjectCollection.h"
 #include "object/SceneObjectId.h"
 
+#include <ray/math/Ray.h>
 #include <ray/math/Vec3.h>
 
+#include <ray/shape/Box3.h>
+
 namespace ray
 {
     struct LightHandle
     {
-        LightHandle(const Point3f& center, SceneObjectId id) noexcept :
+        LightHandle(const Point3f& center, const Box3& bounds, float emission, SceneObjectId id, const HomogeneousSceneObjectCollection& owner, int shapeNo) noexcept :
             m_center(center),
-            m_id(id)
+            m_bounds(bounds),
+            m_emission(emission),
+            m_id(id),
+            m_owner(&owner),
+            m_shapeNo(shapeNo)
         {
 
         }
@@ -20,13 +30,34 @@ namespace ray
             return m_center;
         }
 
+        [[nodiscard]] const Box3& bounds() const
+        {
+            return m_bounds;
+        }
+
+        // Upper bound of the components of the emission color, infinity if not known.
+        [[nodiscard]] float emission() const
+        {
+            return m_emission;
+        }
+
         [[nodiscard]] SceneObjectId id() const
         {
             return m_id;
         }
 
+        // Raycasts only the light object, ignoring everything else in the scene.
+        [[nodiscard]] bool raycast(const Ray& ray, ResolvableRaycastHit& hit) const
+        {
+            return m_owner->queryLocal(ray, m_shapeNo, hit);
+        }
+
     private:
         Point3f m_center;
+        Box3 m_bounds;
+        float m_emission;
         SceneObjectId m_id;
+        const HomogeneousSceneObjectCollection* m_owner;
+        int m_shapeNo;
     };
 }
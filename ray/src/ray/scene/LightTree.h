@@ -0,0 +1,188 @@
+#pragma once
+
+#include "LightHandle.h"
+
+#include <ray/math/Vec3.h>
+
+#include <ray/shape/Box3.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace ray
+{
+    // Bvh over the bounds of the lights, each node knows the total emission of the lights below it.
+    // The contribution of a light is at most its emission scaled by the largest cosine
+    // between the surface normal and the direction to any point of the light.
+    // So a node entirely behind the surface can't contribute anything
+    // and nodes with small bounds on the contribution can be skipped as a whole.
+    struct LightTree
+    {
+        static constexpr int maxLightsPerLeaf = 4;
+        static constexpr int maxDepth = 64;
+
+        LightTree() = default;
+
+        explicit LightTree(const std::vector<LightHandle>& lights)
+        {
+            if (lights.empty())
+            {
+                return;
+            }
+
+            std::vector<int> indices(lights.size());
+            std::iota(indices.begin(), indices.end(), 0);
+            m_lights.reserve(lights.size());
+            m_nodes.reserve(2 * lights.size() / maxLightsPerLeaf + 1);
+            build(lights, indices.begin(), indices.end(), 0);
+        }
+
+        // Calls func for each light that is at least partially above the surface with the given normal.
+        // Lights are also skipped while the sum of their bounds on the emission scaled by the cosine
+        // stays below maxCulledEmission, so all skipped lights together can't contribute more than that.
+        template <typename FuncT>
+        void forEachLight(const Point3f& point, const UnitVec3f& normal, float maxCulledEmission, FuncT&& func) const
+        {
+            if (m_nodes.empty())
+            {
+                return;
+            }
+
+            float culledEmission = 0.0f;
+            auto isCulled = [&](const Box3& bounds, float emission) {
+                const float cosBound = maxCosine(bounds, point, normal);
+                if (cosBound <= 0.0f) return true;
+
+                const float bound = emission * cosBound;
+                if (culledEmission + bound >= maxCulledEmission) return false;
+
+                culledEmission += bound;
+                return true;
+            };
+
+            std::array<int, maxDepth> stack;
+            int stackSize = 0;
+            stack[stackSize++] = 0;
+            while (stackSize > 0)
+            {
+                const Node& node = m_nodes[stack[--stackSize]];
+                if (isCulled(node.bounds, node.emission)) continue;
+
+                if (node.numLights == 0)
+                {
+                    const int nodeNo = static_cast<int>(&node - m_nodes.data());
+                    stack[stackSize++] = node.secondChild;
+                    stack[stackSize++] = nodeNo + 1;
+                    continue;
+                }
+
+                for (int i = node.firstLight; i < node.firstLight + node.numLights; ++i)
+                {
+                    const LightHandle& light = m_lights[i];
+                    if (isCulled(light.bounds(), light.emission())) continue;
+
+                    func(light);
+                }
+            }
+        }
+
+        [[nodiscard]] const std::vector<LightHandle>& lights() const
+        {
+            return m_lights;
+        }
+
+    private:
+        using Point3fMemberPtr = float(Point3f::*);
+
+        struct Node
+        {
+            Box3 bounds; // of the lights
+            float emission; // sum over the lights
+            int firstLight;
+            int numLights; // 0 for inner nodes
+            int secondChild; // the first one is right after the node
+        };
+
+        std::vector<Node> m_nodes;
+        std::vector<LightHandle> m_lights; // in leaf order
+
+        // Upper bound of the cosine between normal and the direction from point to any point in the box.
+        [[nodiscard]] static float maxCosine(const Box3& box, const Point3f& point, const UnitVec3f& normal)
+        {
+            const Vec3f halfExtent = box.extent() * 0.5f;
+            const float maxDot =
+                dot(normal, box.center() - point)
+                + std::abs(normal.x) * halfExtent.x
+                + std::abs(normal.y) * halfExtent.y
+                + std::abs(normal.z) * halfExtent.z;
+            if (maxDot <= 0.0f)
+            {
+                return 0.0f;
+            }
+
+            const Vec3f outside(
+                std::max({ box.min.x - point.x, 0.0f, point.x - box.max.x }),
+                std::max({ box.min.y - point.y, 0.0f, point.y - box.max.y }),
+                std::max({ box.min.z - point.z, 0.0f, point.z - box.max.z })
+            );
+            const float minDist = outside.length();
+            if (minDist <= 0.0f)
+            {
+                return 1.0f;
+            }
+
+            return std::min(maxDot / minDist, 1.0f);
+        }
+
+        // Median split on the longest axis of the centers.
+        void build(const std::vector<LightHandle>& lights, std::vector<int>::iterator first, std::vector<int>::iterator last, int depth)
+        {
+            const int nodeNo = static_cast<int>(m_nodes.size());
+            Node& node = m_nodes.emplace_back();
+            node.bounds = lights[*first].bounds();
+            node.emission = 0.0f;
+            Box3 centerBounds(lights[*first].center(), lights[*first].center());
+            for (auto it = first; it != last; ++it)
+            {
+                node.bounds.extend(lights[*it].bounds());
+                node.emission += lights[*it].emission();
+                centerBounds.extend(lights[*it].center());
+            }
+
+            const int numLights = static_cast<int>(last - first);
+            if (numLights <= maxLightsPerLeaf || depth >= maxDepth - 2)
+            {
+                node.firstLight = static_cast<int>(m_lights.size());
+                node.numLights = numLights;
+                node.secondChild = 0;
+                for (auto it = first; it != last; ++it)
+                {
+                    m_lights.emplace_back(lights[*it]);
+                }
+                return;
+            }
+
+            const Vec3f extent = centerBounds.extent();
+            const Point3fMemberPtr cmpAxis =
+                extent.x >= extent.y && extent.x >= extent.z ? &Point3f::x
+                : extent.y >= extent.z ? &Point3f::y
+                : &Point3f::z;
+            node.firstLight = 0;
+            node.numLights = 0;
+
+            auto mid = first + numLights / 2;
+            std::nth_element(first, mid, last, [&lights, cmpAxis](int lhs, int rhs) {
+                return lights[lhs].center().*cmpAxis < lights[rhs].center().*cmpAxis;
+            });
+
+            // node is invalidated by the recursive calls
+            build(lights, first, mid, depth + 1);
+            const int secondChild = static_cast<int>(m_nodes.size());
+            build(lights, mid, last, depth + 1);
+            m_nodes[nodeNo].secondChild = secondChild;
+        }
+    };
+}
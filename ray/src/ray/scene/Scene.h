@@ -1,20 +1,34 @@
 #pragma once
 
+#include <cstdint>
 #include <optional>
 #include <vector>
 
 namespace ray
 {
+    struct Float4;
     struct MediumMaterial;
     struct Ray;
+    struct RayPacket4;
     struct ResolvableRaycastHit;
+    struct ResolvableRaycastHitPacket4;
     struct LightHandle;
+    struct LightTree;
     struct ColorRGBf;
 
     struct Scene
     {
         [[nodiscard]] virtual bool queryNearest(const Ray& ray, ResolvableRaycastHit& hit) const = 0;
+        // Only lanes set in activeMask are considered.
+        // Returns the mask of lanes for which the hit was updated.
+        [[nodiscard]] virtual std::uint8_t queryNearest(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const = 0;
+        // Whether anything is hit closer than maxDist, for occlusion tests.
+        [[nodiscard]] virtual bool queryAny(const Ray& ray, float maxDist) const = 0;
+        // Only lanes set in activeMask are considered.
+        // Returns the mask of lanes that hit anything closer than their maxDists.
+        [[nodiscard]] virtual std::uint8_t queryAny(const RayPacket4& rays, std::uint8_t activeMask, const Float4& maxDists) const = 0;
         [[nodiscard]] virtual const std::vector<LightHandle>& lights() const = 0;
+        [[nodiscard]] virtual const LightTree& lightTree() const = 0;
         [[nodiscard]] virtual const ColorRGBf& backgroundColor() const = 0;
         [[nodiscard]] virtual const MediumMaterial* mediumMaterial() const = 0;
         [[nodiscard]] virtual float backgroundDistance() const = 0;
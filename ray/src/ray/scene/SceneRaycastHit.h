@@ -9,6 +9,7 @@
 #include <ray/math/RaycastHit.h>
 #include <ray/math/Vec3.h>
 
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <optional>
@@ -30,6 +31,22 @@ namespace ray
         [[nodiscard]] SceneObjectId objectId() const;
     };
 
+    // Nearest hits of the rays of a RayPacket4, one per lane.
+    struct ResolvableRaycastHitPacket4
+    {
+        std::array<ResolvableRaycastHit, 4> hits;
+
+        [[nodiscard]] ResolvableRaycastHit& operator[](int i)
+        {
+            return hits[i];
+        }
+
+        [[nodiscard]] const ResolvableRaycastHit& operator[](int i) const
+        {
+            return hits[i];
+        }
+    };
+
     struct ResolvedRaycastHit : SurfaceShaderOutput
     {
         ResolvedRaycastHit(
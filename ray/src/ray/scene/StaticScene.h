@@ -1,5 +1,6 @@
 #pragma once
 
+#include "LightTree.h"
 #include "Scene.h"
 #include "SceneRaycastHit.h"
 
@@ -8,14 +9,42 @@
 
 #include <ray/material/MediumMaterial.h>
 
+#include <ray/math/Float4.h>
+#include <ray/math/RayPacket4.h>
+
+#include <cstdint>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace ray
 {
+    namespace detail
+    {
+        template <typename StorageT, typename = void>
+        struct SupportsPacketQuery : std::false_type {};
+
+        template <typename StorageT>
+        struct SupportsPacketQuery<
+            StorageT, 
+            std::void_t<decltype(std::declval<const StorageT&>().queryNearest(std::declval<const RayPacket4&>(), std::declval<std::uint8_t>(), std::declval<ResolvableRaycastHitPacket4&>()))>
+        > : std::true_type {};
+
+        template <typename StorageT, typename = void>
+        struct SupportsPacketAnyQuery : std::false_type {};
+
+        template <typename StorageT>
+        struct SupportsPacketAnyQuery<
+            StorageT,
+            std::void_t<decltype(std::declval<const StorageT&>().queryAny(std::declval<const RayPacket4&>(), std::declval<std::uint8_t>(), std::declval<const Float4&>()))>
+        > : std::true_type {};
+    }
+
     // Uses given space partitioning.
+    // Final so that queries through a StaticScene are not virtual calls, see BasicRaytracer.
     template <typename StaticSpacePartitionedStorageT>
-    struct StaticScene : Scene
+    struct StaticScene final : Scene
     {
     private:
     public:
@@ -24,6 +53,7 @@ namespace ray
             m_storage(collection, std::forward<ArgTs>(args)...)
         {
             m_storage.gatherLights(m_lights);
+            m_lightTree = LightTree(m_lights);
         }
 
         template <typename... ShapeTs, typename... ArgTs>
@@ -31,6 +61,7 @@ namespace ray
             m_storage(std::move(collection), std::forward<ArgTs>(args)...)
         {
             m_storage.gatherLights(m_lights);
+            m_lightTree = LightTree(m_lights);
         }
 
         [[nodiscard]] bool queryNearest(const Ray& ray, ResolvableRaycastHit& hit) const override
@@ -38,11 +69,67 @@ namespace ray
             return m_storage.queryNearest(ray, hit);
         }
 
+        // Storages without a packet query get the rays one by one.
+        [[nodiscard]] std::uint8_t queryNearest(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const override
+        {
+            if constexpr (detail::SupportsPacketQuery<StaticSpacePartitionedStorageT>::value)
+            {
+                return m_storage.queryNearest(rays, activeMask, hits);
+            }
+            else
+            {
+                std::uint8_t mask = 0;
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    if ((activeMask & (1 << lane)) == 0) continue;
+
+                    if (m_storage.queryNearest(rays.ray(lane), hits[lane]))
+                    {
+                        mask |= 1 << lane;
+                    }
+                }
+                return mask;
+            }
+        }
+
+        [[nodiscard]] bool queryAny(const Ray& ray, float maxDist) const override
+        {
+            return m_storage.queryAny(ray, maxDist);
+        }
+
+        // Storages without a packet query get the rays one by one.
+        [[nodiscard]] std::uint8_t queryAny(const RayPacket4& rays, std::uint8_t activeMask, const Float4& maxDists) const override
+        {
+            if constexpr (detail::SupportsPacketAnyQuery<StaticSpacePartitionedStorageT>::value)
+            {
+                return m_storage.queryAny(rays, activeMask, maxDists);
+            }
+            else
+            {
+                std::uint8_t mask = 0;
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    if ((activeMask & (1 << lane)) == 0) continue;
+
+                    if (m_storage.queryAny(rays.ray(lane), maxDists.v[lane]))
+                    {
+                        mask |= 1 << lane;
+                    }
+                }
+                return mask;
+            }
+        }
+
         [[nodiscard]] const std::vector<LightHandle>& lights() const override
         {
             return m_lights;
         }
 
+        [[nodiscard]] const LightTree& lightTree() const override
+        {
+            return m_lightTree;
+        }
+
         [[nodiscard]] const ColorRGBf& backgroundColor() const override
         {
             return m_backgroundColor;
@@ -77,6 +164,7 @@ namespace ray
         StaticSpacePartitionedStorageT m_storage;
 
         std::vector<LightHandle> m_lights;
+        LightTree m_lightTree;
 
         ColorRGBf m_backgroundColor;
         float m_backgroundDistance;
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "BvhParams.h"
+#include "BvhSahCost.h"
+#include "StaticBvhTraversal.h"
 
+#include <ray/math/Float4.h>
 #include <ray/math/Ray.h>
+#include <ray/math/RayPacket4.h>
 #include <ray/math/Raycast.h>
 #include <ray/math/RaycastHit.h>
 
@@ -10,8 +14,13 @@
 #include <ray/scene/SceneRaycastHit.h>
 #include <ray/scene/object/SceneObjectBlob.h>
 
+#include <ray/shape/Box3.h>
+#include <ray/shape/Box3Pack4.h>
 #include <ray/shape/Shapes.h>
 
+#include <array>
+#include <cassert>
+#include <cstdint>
 #include <queue>
 #include <optional>
 #include <memory>
@@ -32,17 +41,35 @@ namespace ray
             std::greater<StaticBvhNodeHit<BvShapeT>>
         >;
 
+    template <typename BvShapeT>
+    using BvhNodeHitStack = StaticBvhTraversalStack<StaticBvhNodeHit<BvShapeT>>;
+
+    template <typename BvShapeT>
+    struct StaticBvhNodePacketHit;
+
+    template <typename BvShapeT>
+    using BvhNodePacketHitStack = StaticBvhTraversalStack<StaticBvhNodePacketHit<BvShapeT>>;
+
     template <typename BvShapeT>
     struct StaticBvhNode
     {
         [[nodiscard]] virtual bool nextHit(const Ray& ray, BvhNodeHitQueue<BvShapeT>& queue, ResolvableRaycastHit& hit) const = 0;
+        [[nodiscard]] virtual bool nextHit(const Ray& ray, BvhNodeHitStack<BvShapeT>& stack, ResolvableRaycastHit& hit) const = 0;
+        [[nodiscard]] virtual std::uint8_t nextHit(const RayPacket4& rays, std::uint8_t activeMask, BvhNodePacketHitStack<BvShapeT>& stack, ResolvableRaycastHitPacket4& hits) const = 0;
+        // Occlusion queries, return whether anything closer than maxDist (hits[lane].dist for packets) was hit.
+        // Children are not ordered because the traversal ends at the first hit found.
+        [[nodiscard]] virtual bool nextAnyHit(const Ray& ray, float maxDist, BvhNodeHitStack<BvShapeT>& stack) const = 0;
+        [[nodiscard]] virtual std::uint8_t nextAnyHit(const RayPacket4& rays, std::uint8_t activeMask, BvhNodePacketHitStack<BvShapeT>& stack, ResolvableRaycastHitPacket4& hits) const = 0;
         virtual void gatherLights(std::vector<LightHandle>& lights) const = 0;
+        virtual void accumulateSahCost(const BvShapeT& boundingVolume, BvhSahCost& cost) const = 0;
         virtual ~StaticBvhNode() = default;
     };
 
     template <typename BvShapeT>
     struct StaticBvhNodeHit
     {
+        StaticBvhNodeHit() noexcept = default;
+
         StaticBvhNodeHit(float dist, const StaticBvhNode<BvShapeT>& node) :
             dist(dist),
             node(&node)
@@ -62,6 +89,26 @@ namespace ray
         }
     };
 
+    // Entry of a packet traversal. Only lanes in mask hit the node's bounding volume.
+    template <typename BvShapeT>
+    struct StaticBvhNodePacketHit
+    {
+        StaticBvhNodePacketHit() noexcept = default;
+
+        StaticBvhNodePacketHit(const Float4& dists, std::uint8_t mask, const StaticBvhNode<BvShapeT>& node) :
+            dists(dists),
+            dist(dists.v[nearestLane(dists, mask)]),
+            mask(mask),
+            node(&node)
+        {
+        }
+
+        Float4 dists;
+        float dist; // nearest entry among the lanes in mask, used for ordering
+        std::uint8_t mask;
+        const StaticBvhNode<BvShapeT>* node;
+    };
+
     template <typename...>
     struct StaticBvhLeafNode;
 
@@ -89,11 +136,42 @@ namespace ray
             return m_objects.queryNearest(ray, hit);
         }
 
+        [[nodiscard]] bool nextHit(const Ray& ray, BvhNodeHitStack<BvShapeT>& stack, ResolvableRaycastHit& hit) const override
+        {
+            return m_objects.queryNearest(ray, hit);
+        }
+
+        [[nodiscard]] std::uint8_t nextHit(const RayPacket4& rays, std::uint8_t activeMask, BvhNodePacketHitStack<BvShapeT>& stack, ResolvableRaycastHitPacket4& hits) const override
+        {
+            return m_objects.queryNearest(rays, activeMask, hits);
+        }
+
+        [[nodiscard]] bool nextAnyHit(const Ray& ray, float maxDist, BvhNodeHitStack<BvShapeT>& stack) const override
+        {
+            return m_objects.queryAny(ray, maxDist);
+        }
+
+        [[nodiscard]] std::uint8_t nextAnyHit(const RayPacket4& rays, std::uint8_t activeMask, BvhNodePacketHitStack<BvShapeT>& stack, ResolvableRaycastHitPacket4& hits) const override
+        {
+            return m_objects.queryAny(rays, activeMask, hits);
+        }
+
         void gatherLights(std::vector<LightHandle>& lights) const override
         {
             m_objects.gatherLights(lights);
         }
 
+        void accumulateSahCost(const BvShapeT& boundingVolume, BvhSahCost& cost) const override
+        {
+            cost.addLeafNode(boundingVolume.surfaceArea(), m_objects.size());
+        }
+
+        // Called when all objects are added, see SceneObjectBlob::compact.
+        void compact()
+        {
+            m_objects.compact();
+        }
+
     private:
         SceneObjectBlob<AllShapes, StorageProviderT> m_objects;
     };
@@ -134,6 +212,66 @@ namespace ray
             return false;
         }
 
+        [[nodiscard]] bool nextHit(const Ray& ray, BvhNodeHitStack<BvShapeT>& stack, ResolvableRaycastHit& hit) const override
+        {
+            RaycastBvHit bvhit;
+            int numHits = 0;
+            for (const auto& child : m_children)
+            {
+                if (raycastBv(ray, child.boundingVolume, hit.dist, bvhit))
+                {
+                    stack.push(StaticBvhNodeHit(bvhit.dist, *child.node));
+                    ++numHits;
+                }
+            }
+            stack.sortTop(numHits);
+            return false;
+        }
+
+        [[nodiscard]] std::uint8_t nextHit(const RayPacket4& rays, std::uint8_t activeMask, BvhNodePacketHitStack<BvShapeT>& stack, ResolvableRaycastHitPacket4& hits) const override
+        {
+            const Float4 tNearest = nearestDistances(hits);
+            RaycastBvHitPacket4 bvhit;
+            int numHits = 0;
+            for (const auto& child : m_children)
+            {
+                if (raycastBv(rays, child.boundingVolume, tNearest, activeMask, bvhit))
+                {
+                    stack.push(StaticBvhNodePacketHit(bvhit.dist, bvhit.mask, *child.node));
+                    ++numHits;
+                }
+            }
+            stack.sortTop(numHits);
+            return 0;
+        }
+
+        [[nodiscard]] bool nextAnyHit(const Ray& ray, float maxDist, BvhNodeHitStack<BvShapeT>& stack) const override
+        {
+            RaycastBvHit bvhit;
+            for (const auto& child : m_children)
+            {
+                if (raycastBv(ray, child.boundingVolume, maxDist, bvhit))
+                {
+                    stack.push(StaticBvhNodeHit(bvhit.dist, *child.node));
+                }
+            }
+            return false;
+        }
+
+        [[nodiscard]] std::uint8_t nextAnyHit(const RayPacket4& rays, std::uint8_t activeMask, BvhNodePacketHitStack<BvShapeT>& stack, ResolvableRaycastHitPacket4& hits) const override
+        {
+            const Float4 maxDists = nearestDistances(hits);
+            RaycastBvHitPacket4 bvhit;
+            for (const auto& child : m_children)
+            {
+                if (raycastBv(rays, child.boundingVolume, maxDists, activeMask, bvhit))
+                {
+                    stack.push(StaticBvhNodePacketHit(bvhit.dist, bvhit.mask, *child.node));
+                }
+            }
+            return 0;
+        }
+
         void addChild(std::unique_ptr<StaticBvhNode<BvShapeT>>&& node, const BvShapeT& bv)
         {
             m_children.emplace_back(std::move(node), bv);
@@ -152,7 +290,124 @@ namespace ray
             }
         }
 
+        void accumulateSahCost(const BvShapeT& boundingVolume, BvhSahCost& cost) const override
+        {
+            cost.addPartitionNode(boundingVolume.surfaceArea());
+            for (const auto& child : m_children)
+            {
+                child.node->accumulateSahCost(child.boundingVolume, cost);
+            }
+        }
+
     private:
         std::vector<Child> m_children;
     };
+
+    // Partition node with up to 4 children whose boxes are tested together.
+    struct StaticBvh4PartitionNode : StaticBvhNode<Box3>
+    {
+        static constexpr int maxChildren = Box3Pack4::numShapes;
+
+        StaticBvh4PartitionNode() :
+            m_numChildren(0)
+        {
+        }
+
+        [[nodiscard]] bool nextHit(const Ray& ray, BvhNodeHitQueue<Box3>& hits, ResolvableRaycastHit& hit) const override
+        {
+            RaycastBvHit4 bvhit;
+            const int numHits = raycastBv(ray, m_boundingVolumes, hit.dist, bvhit);
+            for (int i = 0; i < numHits; ++i)
+            {
+                hits.push(StaticBvhNodeHit(bvhit.dist[i], *m_children[bvhit.lanes[i]]));
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool nextHit(const Ray& ray, BvhNodeHitStack<Box3>& stack, ResolvableRaycastHit& hit) const override
+        {
+            // hits are already sorted, push the farthest first so that the nearest is on top
+            RaycastBvHit4 bvhit;
+            const int numHits = raycastBv(ray, m_boundingVolumes, hit.dist, bvhit);
+            for (int i = numHits - 1; i >= 0; --i)
+            {
+                stack.push(StaticBvhNodeHit(bvhit.dist[i], *m_children[bvhit.lanes[i]]));
+            }
+            return false;
+        }
+
+        // The packet is tested against each child box separately,
+        // 4 rays against 4 boxes doesn't fit in a single test.
+        [[nodiscard]] std::uint8_t nextHit(const RayPacket4& rays, std::uint8_t activeMask, BvhNodePacketHitStack<Box3>& stack, ResolvableRaycastHitPacket4& hits) const override
+        {
+            const Float4 tNearest = nearestDistances(hits);
+            RaycastBvHitPacket4 bvhit;
+            int numHits = 0;
+            for (int i = 0; i < m_numChildren; ++i)
+            {
+                if (raycastBv(rays, m_boundingVolumes.get(i), tNearest, activeMask, bvhit))
+                {
+                    stack.push(StaticBvhNodePacketHit(bvhit.dist, bvhit.mask, *m_children[i]));
+                    ++numHits;
+                }
+            }
+            stack.sortTop(numHits);
+            return 0;
+        }
+
+        [[nodiscard]] bool nextAnyHit(const Ray& ray, float maxDist, BvhNodeHitStack<Box3>& stack) const override
+        {
+            RaycastBvHit4 bvhit;
+            const int numHits = raycastBv(ray, m_boundingVolumes, maxDist, bvhit);
+            for (int i = 0; i < numHits; ++i)
+            {
+                stack.push(StaticBvhNodeHit(bvhit.dist[i], *m_children[bvhit.lanes[i]]));
+            }
+            return false;
+        }
+
+        [[nodiscard]] std::uint8_t nextAnyHit(const RayPacket4& rays, std::uint8_t activeMask, BvhNodePacketHitStack<Box3>& stack, ResolvableRaycastHitPacket4& hits) const override
+        {
+            const Float4 maxDists = nearestDistances(hits);
+            RaycastBvHitPacket4 bvhit;
+            for (int i = 0; i < m_numChildren; ++i)
+            {
+                if (raycastBv(rays, m_boundingVolumes.get(i), maxDists, activeMask, bvhit))
+                {
+                    stack.push(StaticBvhNodePacketHit(bvhit.dist, bvhit.mask, *m_children[i]));
+                }
+            }
+            return 0;
+        }
+
+        void addChild(std::unique_ptr<StaticBvhNode<Box3>>&& node, const Box3& bv)
+        {
+            assert(m_numChildren < maxChildren);
+            m_boundingVolumes.set(m_numChildren, bv);
+            m_children[m_numChildren] = std::move(node);
+            ++m_numChildren;
+        }
+
+        void gatherLights(std::vector<LightHandle>& lights) const override
+        {
+            for (int i = 0; i < m_numChildren; ++i)
+            {
+                m_children[i]->gatherLights(lights);
+            }
+        }
+
+        void accumulateSahCost(const Box3& boundingVolume, BvhSahCost& cost) const override
+        {
+            cost.addPartitionNode(boundingVolume.surfaceArea());
+            for (int i = 0; i < m_numChildren; ++i)
+            {
+                m_children[i]->accumulateSahCost(m_boundingVolumes.get(i), cost);
+            }
+        }
+
+    private:
+        Box3Pack4 m_boundingVolumes;
+        std::array<std::unique_ptr<StaticBvhNode<Box3>>, maxChildren> m_children;
+        int m_numChildren;
+    };
 }
@@ -3,17 +3,22 @@
 #include "BvhNode.h"
 #include "BvhParams.h"
 
+#include <ray/math/BoundingVolume.h>
 #include <ray/math/Vec3.h>
 
+#include <ray/scene/object/SceneObject.h>
+#include <ray/scene/object/SceneObjectBlob.h>
+
+#include <ray/shape/Box3.h>
 #include <ray/shape/Shapes.h>
 
+#include <ray/utility/Util.h>
+
+#include <tuple>
 #include <vector>
-#include <memory>
 
 namespace ray
 {
-    struct Box3;
-
     template <typename...>
     struct BoundedStaticBvhObject;
 
@@ -21,21 +26,131 @@ namespace ray
     struct BoundedStaticBvhObject<BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>> 
     {
         using BvhParamsT = BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>;
+        using BvShapeType = BvShapeT;
         using LeafNodeType = StaticBvhLeafNode<BvhParamsT>;
+        using ObjectBlobType = SceneObjectBlob<Shapes<ShapeTs...>, StorageProviderT>;
 
         virtual void addTo(LeafNodeType& leaf) const = 0;
+        virtual void addTo(ObjectBlobType& objects) const = 0;
         [[nodiscard]] virtual const BvShapeT& boundingVolume() const = 0;
         [[nodiscard]] virtual const Box3& aabb() const = 0;
         [[nodiscard]] virtual const Point3f& center() const = 0;
         virtual ~BoundedStaticBvhObject() = default;
     };
 
+    template <typename BvhParamsT, typename ShapeT>
+    struct SpecificBoundedStaticBvhObject : BoundedStaticBvhObject<BvhParamsT>
+    {
+        using BaseType = BoundedStaticBvhObject<BvhParamsT>;
+        using BvShapeType = typename BaseType::BvShapeType;
+        using LeafNodeType = typename BaseType::LeafNodeType;
+        using ObjectBlobType = typename BaseType::ObjectBlobType;
+
+        SpecificBoundedStaticBvhObject(const SceneObject<ShapeT>& obj) :
+            m_object(&obj),
+            m_boundingVolume(ray::boundingVolume<BvShapeType>(obj)),
+            m_aabb(ray::boundingVolume<Box3>(obj)),
+            m_center(obj.center())
+        {
+
+        }
+
+        void addTo(LeafNodeType& leaf) const override
+        {
+            leaf.add(object());
+        }
+
+        void addTo(ObjectBlobType& objects) const override
+        {
+            objects.add(object());
+        }
+
+        [[nodiscard]] const SceneObject<ShapeT>& object() const
+        {
+            return *m_object;
+        }
+
+        [[nodiscard]] const BvShapeType& boundingVolume() const override
+        {
+            return m_boundingVolume;
+        }
+
+        [[nodiscard]] const Box3& aabb() const override
+        {
+            return m_aabb;
+        }
+
+        [[nodiscard]] const Point3f& center() const override
+        {
+            return m_center;
+        }
+
+    private:
+        const SceneObject<ShapeT>* m_object;
+        BvShapeType m_boundingVolume;
+        Box3 m_aabb;
+        Point3f m_center;
+    };
+
+    template <typename...>
+    struct BoundedStaticBvhObjectStorage;
+
+    // Owns bvh objects by value, one array per shape type.
+    // Construction code only passes around pointers to them.
+    template <typename BvShapeT, typename StorageProviderT, typename... ShapeTs>
+    struct BoundedStaticBvhObjectStorage<BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>>
+    {
+        using BvhParamsT = BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>;
+
+        template <typename ShapeT>
+        using ObjectStorageType = std::vector<SpecificBoundedStaticBvhObject<BvhParamsT, ShapeT>>;
+
+        // References are invalidated by subsequent additions of the same shape type.
+        template <typename ShapeT>
+        void add(const SceneObject<ShapeT>& obj)
+        {
+            objectsOfType<ShapeT>().emplace_back(obj);
+        }
+
+        // Visits objects grouped by type in the order of ShapeTs.
+        template <typename FuncT>
+        void forEach(FuncT&& func) const
+        {
+            for_each(m_objects, [&](auto&& collection) {
+                for (auto&& object : collection)
+                {
+                    func(object);
+                }
+            });
+        }
+
+        [[nodiscard]] int size() const
+        {
+            return (static_cast<int>(objectsOfType<ShapeTs>().size()) + ... + 0);
+        }
+
+    private:
+        std::tuple<
+            ObjectStorageType<ShapeTs>...
+        > m_objects;
+
+        template <typename ShapeT>
+        [[nodiscard]] ObjectStorageType<ShapeT>& objectsOfType()
+        {
+            return std::get<ObjectStorageType<ShapeT>>(m_objects);
+        }
+
+        template <typename ShapeT>
+        [[nodiscard]] const ObjectStorageType<ShapeT>& objectsOfType() const
+        {
+            return std::get<ObjectStorageType<ShapeT>>(m_objects);
+        }
+    };
+
     template <typename BvhParamsT>
     using BoundedStaticBvhObjectVector = 
         std::vector<
-            std::unique_ptr<
-                BoundedStaticBvhObject<BvhParamsT>
-            >
+            const BoundedStaticBvhObject<BvhParamsT>*
         >;
 
     template <typename BvhParamsT>
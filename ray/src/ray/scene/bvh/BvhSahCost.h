@@ -0,0 +1,40 @@
+#pragma once
+
+namespace ray
+{
+    // Accumulates the surface area heuristic cost of a bvh.
+    // Node areas are normalized by the area of the root so the cost is
+    // the expected cost of a ray that hits the root.
+    struct BvhSahCost
+    {
+        // Only the ratio matters.
+        static constexpr float traversalCost = 1.0f;
+        static constexpr float intersectionCost = 1.0f;
+
+        explicit BvhSahCost(float rootArea) noexcept :
+            m_rootArea(rootArea),
+            m_cost(0.0)
+        {
+        }
+
+        void addPartitionNode(float area)
+        {
+            m_cost += static_cast<double>(area) * traversalCost;
+        }
+
+        void addLeafNode(float area, int numObjects)
+        {
+            m_cost += static_cast<double>(area) * numObjects * intersectionCost;
+        }
+
+        [[nodiscard]] double value() const
+        {
+            if (m_rootArea <= 0.0f) return 0.0;
+            return m_cost / m_rootArea;
+        }
+
+    private:
+        float m_rootArea;
+        double m_cost;
+    };
+}
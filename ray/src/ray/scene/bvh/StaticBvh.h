@@ -7,8 +7,12 @@
 #include "BvhNode.h"
 #include "BvhObject.h"
 #include "BvhParams.h"
+#include "BvhSahCost.h"
+#include "StaticBvhTraversal.h"
 
 #include <ray/math/BoundingVolume.h>
+#include <ray/math/Float4.h>
+#include <ray/math/RayPacket4.h>
 
 #include <ray/scene/LightHandle.h>
 #include <ray/scene/SceneRaycastHit.h>
@@ -20,8 +24,10 @@
 #include <ray/shape/Shapes.h>
 #include <ray/shape/ShapeTraits.h>
 
+#include <ray/utility/ThreadPool.h>
 #include <ray/utility/Util.h>
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <queue>
@@ -33,21 +39,28 @@ namespace ray
     template <typename... Ts>
     struct StaticBvh;
 
-    template <typename PartitionerMakerT, typename BvShapeT, typename StorageProviderT, typename... ShapeTs>
-    struct StaticBvh<BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>, PartitionerMakerT> : StaticHeterogeneousSceneObjectCollection
+    // TraversalT is either StaticBvhStackTraversal or StaticBvhPriorityQueueTraversal
+    template <typename PartitionerMakerT, typename TraversalT, typename BvShapeT, typename StorageProviderT, typename... ShapeTs>
+    struct StaticBvh<BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>, PartitionerMakerT, TraversalT> : StaticHeterogeneousSceneObjectCollection
     {
         static constexpr int maxDepth = 16;
         static constexpr int maxObjectsPerNode = 1;
+        static constexpr int minParallelBuildSize = 1024;
 
         using AllShapes = Shapes<ShapeTs...>;
         using BoundedShapes = FilterShapes<AllShapes, ShapePredicates::IsBounded>;
         using UnboundedShapes = FilterShapes<AllShapes, ShapePredicates::IsUnbounded>;
         using BvhParamsT = BvhParams<BoundedShapes, BvShapeT, StorageProviderT>;
         using PartitionerT = typename PartitionerMakerT::template For<BvhParamsT>;
+
+        // Occlusion and packet queries always use the fixed size stack, so it has to fit regardless of TraversalT.
+        static_assert(maxStaticBvhTraversalStackSize(maxDepth, PartitionerT::maxNumParts) <= BvhNodeHitStack<BvShapeT>::capacity,
+            "The traversal stack can overflow for the deepest and widest trees this bvh can build.");
         using LeafNodeType = StaticBvhLeafNode<BvhParamsT>;
         using PartitionNodeType = StaticBvhPartitionNode<BvShapeT>;
 
         using BoundedBvhObject = BoundedStaticBvhObject<BvhParamsT>;
+        using BoundedBvhObjectStorage = BoundedStaticBvhObjectStorage<BvhParamsT>;
 
         using BoundedBvhObjectVector = BoundedStaticBvhObjectVector<BvhParamsT>;
         using BoundedBvhObjectVectorIterator = BoundedStaticBvhObjectVectorIterator<BvhParamsT>;
@@ -59,110 +72,243 @@ namespace ray
 #if defined(RAY_GATHER_PERF_STATS)
             auto t0 = std::chrono::high_resolution_clock().now();
 #endif
-            construct(blob);
+            construct(blob, nullptr);
 #if defined(RAY_GATHER_PERF_STATS)
             auto t1 = std::chrono::high_resolution_clock().now();
             auto diff = t1 - t0;
             perf::gThreadLocalPerfStats.addConstructionTime(diff);
+            perf::gThreadLocalPerfStats.addBvhSahCost(sahCost());
+#endif
+        }
+
+        // Subtrees with at least minParallelBuildSize objects are built as separate tasks on the pool.
+        // The resulting tree is the same as the one built serially.
+        template <typename... PartitionerArgsTs>
+        StaticBvh(const RawSceneObjectBlob<AllShapes>& blob, ThreadPool& pool, PartitionerArgsTs&&... args) :
+            m_partitioner(std::forward<PartitionerArgsTs>(args)...)
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t0 = std::chrono::high_resolution_clock().now();
+#endif
+            construct(blob, &pool);
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t1 = std::chrono::high_resolution_clock().now();
+            auto diff = t1 - t0;
+            perf::gThreadLocalPerfStats.addConstructionTime(diff);
+            perf::gThreadLocalPerfStats.addBvhSahCost(sahCost());
 #endif
         }
 
         [[nodiscard]] bool queryNearest(const Ray& ray, ResolvableRaycastHit& hit) const
         {
-            thread_local BvhNodeHitQueue<BvShapeT> queue = []() {
-                std::vector<StaticBvhNodeHit<BvShapeT>> vec;
-                vec.reserve(maxDepth * 4);
-                return BvhNodeHitQueue<BvShapeT>(std::greater<StaticBvhNodeHit<BvShapeT>>{}, std::move(vec));
-            }();
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Traversal);
+#endif
 
-            queue.push(StaticBvhNodeHit(0.0f, *m_root));
-            bool anyHit = m_unboundedObjects.queryNearest(ray, hit);
+            if constexpr (std::is_same_v<TraversalT, StaticBvhStackTraversal>)
+            {
+                return queryNearestStack(ray, hit);
+            }
+            else
+            {
+                return queryNearestQueue(ray, hit);
+            }
+        }
 
-            while (!queue.empty())
+        // The tree is traversed once for the whole packet, always depth first regardless of TraversalT.
+        // A node is visited only by the lanes that hit its bounding volume closer than their nearest hit.
+        // Only lanes set in activeMask are considered.
+        // Returns the mask of lanes for which the hit was updated.
+        [[nodiscard]] std::uint8_t queryNearest(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Traversal);
+#endif
+
+            BvhNodePacketHitStack<BvShapeT> stack;
+
+            stack.push(StaticBvhNodePacketHit(Float4{}, activeMask, *m_root));
+            std::uint8_t anyHitMask = m_unboundedObjects.queryNearest(rays, activeMask, hits);
+
+            while (!stack.empty())
             {
-                StaticBvhNodeHit entry = queue.top();
-                if (entry.dist >= hit.dist) break;
-                queue.pop();
+                const StaticBvhNodePacketHit entry = stack.pop();
+                const std::uint8_t entryMask = entry.mask & (entry.dists < nearestDistances(hits)).packed();
+                if (entryMask == 0) continue;
 
-                anyHit |= entry.node->nextHit(ray, queue, hit);
+                anyHitMask |= entry.node->nextHit(rays, entryMask, stack, hits);
             }
-            while (!queue.empty()) queue.pop();
 
-            return anyHit;
+            return anyHitMask;
         }
 
-        void gatherLights(std::vector<LightHandle>& lights) const
+        // Whether anything is hit closer than maxDist.
+        // The traversal ends at the first hit found, so it's always depth first regardless of TraversalT.
+        [[nodiscard]] bool queryAny(const Ray& ray, float maxDist) const
         {
-            m_root->gatherLights(lights);
-        }
 
-    private:
-        std::unique_ptr<StaticBvhNode<BvShapeT>> m_root;
-        SceneObjectBlob<UnboundedShapes, StorageProviderT> m_unboundedObjects;
-        PartitionerT m_partitioner;
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Traversal);
+#endif
 
-        template <typename ShapeT>
-        struct SpecificBvhObject : BoundedBvhObject
-        {
-            SpecificBvhObject(const SceneObject<ShapeT>& obj) :
-                m_object(&obj),
-                m_boundingVolume(ray::boundingVolume<BvShapeT>(obj)),
-                m_aabb(ray::boundingVolume<Box3>(obj)),
-                m_center(obj.center())
+            if (m_unboundedObjects.queryAny(ray, maxDist))
             {
+                return true;
+            }
 
+            BvhNodeHitStack<BvShapeT> stack;
+            stack.push(StaticBvhNodeHit(0.0f, *m_root));
+            while (!stack.empty())
+            {
+                const StaticBvhNodeHit entry = stack.pop();
+                if (entry.node->nextAnyHit(ray, maxDist, stack))
+                {
+                    return true;
+                }
             }
 
-            void addTo(LeafNodeType& leaf) const override
+            return false;
+        }
+
+        // Lanes are dropped from the traversal as soon as they hit anything.
+        // Returns the mask of lanes that hit anything closer than maxDists.
+        [[nodiscard]] std::uint8_t queryAny(const RayPacket4& rays, std::uint8_t activeMask, const Float4& maxDists) const
+        {
+
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Traversal);
+#endif
+
+            ResolvableRaycastHitPacket4 hits;
+            for (int lane = 0; lane < RayPacket4::numRays; ++lane)
             {
-                leaf.add(object());
+                hits[lane].dist = maxDists.v[lane];
             }
 
-            [[nodiscard]] const SceneObject<ShapeT>& object() const
+            std::uint8_t anyHitMask = m_unboundedObjects.queryAny(rays, activeMask, hits);
+            activeMask &= ~anyHitMask;
+            if (activeMask == 0)
             {
-                return *m_object;
+                return anyHitMask;
             }
 
-            [[nodiscard]] const BvShapeT& boundingVolume() const override
+            BvhNodePacketHitStack<BvShapeT> stack;
+            stack.push(StaticBvhNodePacketHit(Float4{}, activeMask, *m_root));
+            while (!stack.empty() && activeMask != 0)
             {
-                return m_boundingVolume;
+                const StaticBvhNodePacketHit entry = stack.pop();
+                const std::uint8_t entryMask = entry.mask & activeMask;
+                if (entryMask == 0) continue;
+
+                const std::uint8_t mask = entry.node->nextAnyHit(rays, entryMask, stack, hits);
+                anyHitMask |= mask;
+                activeMask &= ~mask;
             }
 
-            [[nodiscard]] const Box3& aabb() const override
+            return anyHitMask;
+        }
+
+        void gatherLights(std::vector<LightHandle>& lights) const
+        {
+            m_root->gatherLights(lights);
+        }
+
+        // Unbounded objects are not included.
+        [[nodiscard]] double sahCost() const
+        {
+            BvhSahCost cost(m_boundingVolume.surfaceArea());
+            m_root->accumulateSahCost(m_boundingVolume, cost);
+            return cost.value();
+        }
+
+    private:
+        std::unique_ptr<StaticBvhNode<BvShapeT>> m_root;
+        BvShapeT m_boundingVolume;
+        SceneObjectBlob<UnboundedShapes, StorageProviderT> m_unboundedObjects;
+        PartitionerT m_partitioner;
+
+        [[nodiscard]] bool queryNearestStack(const Ray& ray, ResolvableRaycastHit& hit) const
+        {
+            BvhNodeHitStack<BvShapeT> stack;
+
+            stack.push(StaticBvhNodeHit(0.0f, *m_root));
+            bool anyHit = m_unboundedObjects.queryNearest(ray, hit);
+
+            while (!stack.empty())
             {
-                return m_aabb;
+                const StaticBvhNodeHit entry = stack.pop();
+                if (entry.dist >= hit.dist) continue;
+
+                anyHit |= entry.node->nextHit(ray, stack, hit);
             }
 
-            [[nodiscard]] const Point3f& center() const override
+            return anyHit;
+        }
+
+        [[nodiscard]] bool queryNearestQueue(const Ray& ray, ResolvableRaycastHit& hit) const
+        {
+            thread_local BvhNodeHitQueue<BvShapeT> queue = []() {
+                std::vector<StaticBvhNodeHit<BvShapeT>> vec;
+                vec.reserve(maxDepth * 4);
+                return BvhNodeHitQueue<BvShapeT>(std::greater<StaticBvhNodeHit<BvShapeT>>{}, std::move(vec));
+            }();
+
+            queue.push(StaticBvhNodeHit(0.0f, *m_root));
+            bool anyHit = m_unboundedObjects.queryNearest(ray, hit);
+
+            while (!queue.empty())
             {
-                return m_center;
+                StaticBvhNodeHit entry = queue.top();
+                if (entry.dist >= hit.dist) break;
+                queue.pop();
+
+                anyHit |= entry.node->nextHit(ray, queue, hit);
             }
+            while (!queue.empty()) queue.pop();
 
-        private:
-            const SceneObject<ShapeT>* m_object;
-            BvShapeT m_boundingVolume;
-            Box3 m_aabb;
-            Point3f m_center;
-        };
+            return anyHit;
+        }
 
-        template <typename... SceneObjectCollectionTs>
-        void construct(const RawSceneObjectBlob<AllShapes>& blob)
+        void construct(const RawSceneObjectBlob<AllShapes>& blob, ThreadPool* pool)
         {
-            BoundedBvhObjectVector allObjects;
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t0 = std::chrono::high_resolution_clock().now();
+#endif
+            BoundedBvhObjectStorage storage;
             blob.forEach([&](auto&& object) {
                 using ObjectType = remove_cvref_t<decltype(object)>;
                 using ShapeType = typename ObjectType::ShapeType;
                 if constexpr (ShapeTraits<ShapeType>::isBounded)
                 {
-                    allObjects.emplace_back(std::make_unique<SpecificBvhObject<ShapeType>>(object));
+                    storage.add(object);
                 }
                 else
                 {
                     m_unboundedObjects.add(object);
                 }
             });
+            m_unboundedObjects.compact();
+
+            // The storage is not modified anymore so the pointers stay valid.
+            // The order is the same as the order of objects in the blob.
+            BoundedBvhObjectVector allObjects;
+            allObjects.reserve(storage.size());
+            storage.forEach([&](const auto& object) {
+                allObjects.emplace_back(&object);
+            });
+
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t1 = std::chrono::high_resolution_clock().now();
+            perf::gThreadLocalPerfStats.addConstructionTime(perf::ConstructionPhase::Gather, t1 - t0);
+#endif
+
+            m_boundingVolume = boundingVolume(allObjects.begin(), allObjects.end());
+            m_root = makeNode(allObjects.begin(), allObjects.end(), 0, pool);
 
-            m_root = makeNode(allObjects.begin(), allObjects.end());
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t2 = std::chrono::high_resolution_clock().now();
+            perf::gThreadLocalPerfStats.addConstructionTime(perf::ConstructionPhase::Build, t2 - t1);
+#endif
         }
 
         [[nodiscard]] BvShapeT boundingVolume(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last) const
@@ -186,24 +332,70 @@ namespace ray
                 (*first)->addTo(*leaf);
                 ++first;
             }
+            leaf->compact();
             return leaf;
         }
 
-        [[nodiscard]] std::unique_ptr<PartitionNodeType> makePartitionNode(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last, int depth) const
+        [[nodiscard]] std::unique_ptr<StaticBvhNode<BvShapeT>> makePartitionNode(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last, int depth, ThreadPool* pool) const
         {
             // call recucively
             std::vector<BoundedBvhObjectVectorIterator> ends = m_partitioner.partition(first, last);
-            auto node = std::make_unique<PartitionNodeType>();
-            for (const auto& partEnd : ends)
+            const int numParts = static_cast<int>(ends.size());
+
+            // Parts only touch their own ranges so big ones can be built concurrently.
+            // Children are added in the original order afterwards so the tree doesn't depend on scheduling.
+            std::vector<std::unique_ptr<StaticBvhNode<BvShapeT>>> children(numParts);
+            std::vector<BvShapeT> bvs(numParts);
+            ThreadPoolTaskGroup group;
+            for (int i = 0; i < numParts; ++i)
             {
-                BvShapeT bv = boundingVolume(first, partEnd);
-                node->addChild(makeNode(first, partEnd, depth + 1), std::move(bv));
+                const auto partEnd = ends[i];
+                auto buildPart = [this, &children, &bvs, first, partEnd, i, depth, pool]() {
+                    bvs[i] = boundingVolume(first, partEnd);
+                    children[i] = makeNode(first, partEnd, depth + 1, pool);
+                };
+
+                if (pool != nullptr && std::distance(first, partEnd) >= minParallelBuildSize)
+                {
+                    pool->run(group, buildPart);
+                }
+                else
+                {
+                    buildPart();
+                }
+
                 first = partEnd;
             }
+
+            if (pool != nullptr)
+            {
+                pool->wait(group);
+            }
+
+            // Boxes of up to 4 children can be tested with a single SIMD slab test.
+            if constexpr (std::is_same_v<BvShapeT, Box3>)
+            {
+                if (numParts <= StaticBvh4PartitionNode::maxChildren)
+                {
+                    return assemblePartitionNode<StaticBvh4PartitionNode>(children, bvs);
+                }
+            }
+
+            return assemblePartitionNode<PartitionNodeType>(children, bvs);
+        }
+
+        template <typename NodeT>
+        [[nodiscard]] std::unique_ptr<NodeT> assemblePartitionNode(std::vector<std::unique_ptr<StaticBvhNode<BvShapeT>>>& children, std::vector<BvShapeT>& bvs) const
+        {
+            auto node = std::make_unique<NodeT>();
+            for (int i = 0; i < static_cast<int>(children.size()); ++i)
+            {
+                node->addChild(std::move(children[i]), std::move(bvs[i]));
+            }
             return node;
         }
 
-        [[nodiscard]] std::unique_ptr<StaticBvhNode<BvShapeT>> makeNode(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last, int depth = 0) const
+        [[nodiscard]] std::unique_ptr<StaticBvhNode<BvShapeT>> makeNode(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last, int depth, ThreadPool* pool) const
         {
             const int size = static_cast<int>(std::distance(first, last));
             if (size <= maxObjectsPerNode || depth >= maxDepth)
@@ -212,8 +404,16 @@ namespace ray
             }
             else
             {
-                return makePartitionNode(first, last, depth);
+                return makePartitionNode(first, last, depth, pool);
             }
         }
     };
+
+    template <typename BvhParamsT, typename PartitionerMakerT>
+    struct StaticBvh<BvhParamsT, PartitionerMakerT> : StaticBvh<BvhParamsT, PartitionerMakerT, StaticBvhStackTraversal>
+    {
+        using BaseType = StaticBvh<BvhParamsT, PartitionerMakerT, StaticBvhStackTraversal>;
+
+        using BaseType::BaseType;
+    };
 }
@@ -32,7 +32,7 @@ namespace ray
             using Point3fMemberPtr = float(Point3f::*);
 
             For(int order = 1) :
-                m_numParts(1 << order)
+                m_numParts(1 << std::clamp(order, 1, maxOrder))
             {
 
             }
@@ -4,6 +4,9 @@ namespace ray
 {
     struct StaticBvhObjectPartitioner
     {
-
+        // Partitioners split a node into at most 1 << maxOrder children.
+        // The traversal stacks are sized for this, see StaticBvhTraversalStack.
+        static constexpr int maxOrder = 3;
+        static constexpr int maxNumParts = 1 << maxOrder;
     };
 }
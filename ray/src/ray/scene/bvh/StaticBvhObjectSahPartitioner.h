@@ -0,0 +1,212 @@
+#pragma once
+
+#include "BvhObject.h"
+#include "BvhParams.h"
+#include "StaticBvhObjectPartitioner.h"
+
+#include <ray/math/Vec3.h>
+
+#include <ray/shape/Box3.h>
+#include <ray/shape/Shapes.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace ray
+{
+    // Splits using the surface area heuristic.
+    // Object centers are put into bins along each axis and the best
+    // of the boundaries between bins is chosen.
+    struct StaticBvhObjectSahPartitioner
+    {
+        template <typename...>
+        struct For;
+
+        template <typename BvShapeT, typename StorageProviderT, typename... ShapeTs>
+        struct For<BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>> : StaticBvhObjectPartitioner
+        {
+            using BvhParamsT = BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>;
+            using AllShapes = Shapes<ShapeTs...>;
+
+            using BoundedBvhObject = BoundedStaticBvhObject<BvhParamsT>;
+
+            using BoundedBvhObjectVector = BoundedStaticBvhObjectVector<BvhParamsT>;
+            using BoundedBvhObjectVectorIterator = BoundedStaticBvhObjectVectorIterator<BvhParamsT>;
+
+            using Point3fMemberPtr = float(Point3f::*);
+
+            static constexpr int maxNumBins = 64;
+
+            For(int order = 1, int numBins = 16) :
+                m_numParts(1 << std::clamp(order, 1, maxOrder)),
+                m_numBins(std::clamp(numBins, 2, maxNumBins))
+            {
+
+            }
+
+            // must include last
+            // can assume that distance(first, last) > 1
+            [[nodiscard]] std::vector<BoundedBvhObjectVectorIterator> partition(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last) const
+            {
+                return partition(first, last, m_numParts);
+            }
+
+        private:
+            struct Bin
+            {
+                Box3 aabb;
+                int count;
+
+                void add(const Box3& box)
+                {
+                    if (count == 0) aabb = box;
+                    else aabb.extend(box);
+                    ++count;
+                }
+
+                void add(const Bin& other)
+                {
+                    if (other.count == 0) return;
+                    if (count == 0) aabb = other.aabb;
+                    else aabb.extend(other.aabb);
+                    count += other.count;
+                }
+
+                [[nodiscard]] float cost() const
+                {
+                    return count == 0 ? 0.0f : aabb.surfaceArea() * static_cast<float>(count);
+                }
+            };
+
+            struct Split
+            {
+                Point3fMemberPtr axis;
+                int bin;
+                float cost;
+            };
+
+            int m_numParts;
+            int m_numBins;
+
+            // must include last
+            [[nodiscard]] std::vector<BoundedBvhObjectVectorIterator> partition(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last, int p) const
+            {
+                auto flp2 = [](int x) {
+                    int y;
+                    do {
+                        y = x;
+                        x = x & (x - 1);
+                    } while (x);
+                    return y;
+                };
+
+                const int size = static_cast<int>(std::distance(first, last));
+                const int parts = flp2(std::min(size, p));
+                const auto mid = partitionHalf(first, last);
+                if (parts <= 2)
+                {
+                    return { mid, last };
+                }
+
+                // a single object can't be split further
+                std::vector<BoundedBvhObjectVectorIterator> p1 = 
+                    std::distance(first, mid) > 1
+                    ? partition(first, mid, parts / 2)
+                    : std::vector<BoundedBvhObjectVectorIterator>{ mid };
+                if (std::distance(mid, last) > 1)
+                {
+                    std::vector<BoundedBvhObjectVectorIterator> p2 = partition(mid, last, parts / 2);
+                    p1.insert(p1.end(), p2.begin(), p2.end());
+                }
+                else
+                {
+                    p1.emplace_back(last);
+                }
+                return p1;
+            }
+
+            [[nodiscard]] Box3 centerBounds(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last) const
+            {
+                Box3 bb((*first)->center(), (*first)->center());
+                ++first;
+                while (first != last)
+                {
+                    bb.extend((*first)->center());
+                    ++first;
+                }
+                return bb;
+            }
+
+            [[nodiscard]] int binIndex(float c, float min, float invExtent) const
+            {
+                const int i = static_cast<int>((c - min) * invExtent * static_cast<float>(m_numBins));
+                return std::clamp(i, 0, m_numBins - 1);
+            }
+
+            // Finds the cheapest boundary between bins along the given axis.
+            // Objects in bins [0, split.bin) go to the left part.
+            void findBestSplit(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last, const Box3& bounds, Point3fMemberPtr axis, Split& best) const
+            {
+                const float min = bounds.min.*axis;
+                const float extent = bounds.max.*axis - min;
+                if (extent <= 0.0f) return;
+                const float invExtent = 1.0f / extent;
+
+                Bin bins[maxNumBins]{};
+                for (auto it = first; it != last; ++it)
+                {
+                    const auto& obj = *it;
+                    bins[binIndex(obj->center().*axis, min, invExtent)].add(obj->aabb());
+                }
+
+                // rightCosts[i] and rightCounts[i] are for bins [i, numBins)
+                float rightCosts[maxNumBins];
+                int rightCounts[maxNumBins];
+                Bin right{};
+                for (int i = m_numBins - 1; i > 0; --i)
+                {
+                    right.add(bins[i]);
+                    rightCosts[i] = right.cost();
+                    rightCounts[i] = right.count;
+                }
+
+                Bin left{};
+                for (int i = 1; i < m_numBins; ++i)
+                {
+                    left.add(bins[i - 1]);
+                    if (left.count == 0 || rightCounts[i] == 0) continue;
+
+                    const float cost = left.cost() + rightCosts[i];
+                    if (cost < best.cost)
+                    {
+                        best = Split{ axis, i, cost };
+                    }
+                }
+            }
+
+            [[nodiscard]] BoundedBvhObjectVectorIterator partitionHalf(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last) const
+            {
+                const Box3 bounds = centerBounds(first, last);
+
+                Split best{ nullptr, 0, std::numeric_limits<float>::max() };
+                findBestSplit(first, last, bounds, &Point3f::x, best);
+                findBestSplit(first, last, bounds, &Point3f::y, best);
+                findBestSplit(first, last, bounds, &Point3f::z, best);
+
+                if (best.axis == nullptr)
+                {
+                    // All centers are at the same point, any split is as good as the other.
+                    return first + std::distance(first, last) / 2;
+                }
+
+                const Point3fMemberPtr axis = best.axis;
+                const float min = bounds.min.*axis;
+                const float invExtent = 1.0f / (bounds.max.*axis - min);
+                return std::partition(first, last, [&](const auto& em) {
+                    return binIndex(em->center().*axis, min, invExtent) < best.bin;
+                });
+            }
+        };
+    };
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+
+namespace ray
+{
+    // Visits nodes in the order of increasing entry distance.
+    // Uses a thread_local priority queue so every visited node costs a heap operation.
+    struct StaticBvhPriorityQueueTraversal {};
+
+    // Depth first traversal using a small fixed size stack.
+    // Children are pushed such that the nearest one is visited first,
+    // and nodes are culled when popped if the entry is already beyond the nearest hit.
+    struct StaticBvhStackTraversal {};
+
+    // Most entries a depth first traversal can have on the stack at once.
+    // Every level above the current node leaves at most maxChildren - 1 siblings behind.
+    [[nodiscard]] constexpr int maxStaticBvhTraversalStackSize(int maxDepth, int maxChildren)
+    {
+        return maxDepth * (maxChildren - 1) + 1;
+    }
+
+    // EntryT must have a `float dist` member.
+    // Trees using it must static_assert that they fit, see maxStaticBvhTraversalStackSize.
+    template <typename EntryT>
+    struct StaticBvhTraversalStack
+    {
+        static constexpr int capacity = 128;
+
+        StaticBvhTraversalStack() noexcept :
+            m_size(0)
+        {
+        }
+
+        void push(const EntryT& entry)
+        {
+            assert(m_size < capacity);
+            m_entries[m_size++] = entry;
+        }
+
+        [[nodiscard]] EntryT pop()
+        {
+            return m_entries[--m_size];
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        // Orders the n topmost entries so that the one with the smallest dist is on top.
+        // n is at most the number of children of a node so insertion sort is fine.
+        void sortTop(int n)
+        {
+            EntryT* const first = m_entries.data() + (m_size - n);
+            for (int i = 1; i < n; ++i)
+            {
+                const EntryT entry = first[i];
+                int j = i;
+                while (j > 0 && first[j - 1].dist < entry.dist)
+                {
+                    first[j] = first[j - 1];
+                    --j;
+                }
+                first[j] = entry;
+            }
+        }
+
+    private:
+        std::array<EntryT, capacity> m_entries;
+        int m_size;
+    };
+}
@@ -0,0 +1,487 @@
+#pragma once
+
+#if defined(RAY_GATHER_PERF_STATS)
+#include <ray/perf/PerformanceStats.h>
+#endif
+
+#include "BvhObject.h"
+#include "BvhParams.h"
+#include "BvhSahCost.h"
+#include "StaticBvhTraversal.h"
+
+#include <ray/math/BoundingVolume.h>
+#include <ray/math/Ray.h>
+#include <ray/math/Raycast.h>
+#include <ray/math/RaycastHit.h>
+
+#include <ray/scene/LightHandle.h>
+#include <ray/scene/SceneRaycastHit.h>
+#include <ray/scene/object/RawSceneObjectBlob.h>
+#include <ray/scene/object/SceneObjectBlob.h>
+#include <ray/scene/object/SceneObjectCollection.h>
+
+#include <ray/shape/Box3.h>
+#include <ray/shape/Shapes.h>
+#include <ray/shape/ShapeTraits.h>
+
+#include <ray/utility/ThreadPool.h>
+#include <ray/utility/Util.h>
+
+#include <functional>
+#include <new>
+#include <queue>
+#include <type_traits>
+#include <vector>
+
+namespace ray
+{
+    // Node of a bvh linearized in depth-first order.
+    // Children of a partition node are stored right after it,
+    // the first child is at (nodeNo + 1) and each next one is at (childNo + child.subtreeSize).
+    template <typename BvShapeT>
+    struct alignas(std::hardware_destructive_interference_size) StaticFlatBvhNode
+    {
+        BvShapeT boundingVolume;
+        int subtreeSize; // in nodes, including this one
+        int numChildren; // 0 for leaves
+        int leafNo; // index of the leaf's object range, only valid for leaves
+
+        [[nodiscard]] bool isLeaf() const
+        {
+            return numChildren == 0;
+        }
+    };
+
+    struct StaticFlatBvhNodeHit
+    {
+        float dist;
+        int nodeNo;
+
+        [[nodiscard]] friend bool operator<(const StaticFlatBvhNodeHit& lhs, const StaticFlatBvhNodeHit& rhs) noexcept
+        {
+            return lhs.dist < rhs.dist;
+        }
+        [[nodiscard]] friend bool operator>(const StaticFlatBvhNodeHit& lhs, const StaticFlatBvhNodeHit& rhs) noexcept
+        {
+            return lhs.dist > rhs.dist;
+        }
+    };
+
+    using StaticFlatBvhNodeHitQueue =
+        std::priority_queue<
+            StaticFlatBvhNodeHit,
+            std::vector<StaticFlatBvhNodeHit>,
+            std::greater<StaticFlatBvhNodeHit>
+        >;
+
+    using StaticFlatBvhNodeHitStack = StaticBvhTraversalStack<StaticFlatBvhNodeHit>;
+
+    template <typename... Ts>
+    struct StaticFlatBvh;
+
+    // Builds the same tree as StaticBvh but stores it in a single contiguous array of nodes.
+    // All bounded objects are stored in one blob in leaf order and leaves only reference ranges in it.
+    // There are no pointers between nodes and no virtual calls during traversal.
+    // TraversalT is either StaticBvhStackTraversal or StaticBvhPriorityQueueTraversal
+    template <typename PartitionerMakerT, typename TraversalT, typename BvShapeT, typename StorageProviderT, typename... ShapeTs>
+    struct StaticFlatBvh<BvhParams<Shapes<ShapeTs...>, BvShapeT, StorageProviderT>, PartitionerMakerT, TraversalT> : StaticHeterogeneousSceneObjectCollection
+    {
+        static constexpr int maxDepth = 16;
+        static constexpr int maxObjectsPerNode = 1;
+        static constexpr int minParallelBuildSize = 1024;
+
+        using AllShapes = Shapes<ShapeTs...>;
+        using BoundedShapes = FilterShapes<AllShapes, ShapePredicates::IsBounded>;
+        using UnboundedShapes = FilterShapes<AllShapes, ShapePredicates::IsUnbounded>;
+        using BvhParamsT = BvhParams<BoundedShapes, BvShapeT, StorageProviderT>;
+        using PartitionerT = typename PartitionerMakerT::template For<BvhParamsT>;
+
+        // Occlusion and packet queries always use the fixed size stack, so it has to fit regardless of TraversalT.
+        static_assert(maxStaticBvhTraversalStackSize(maxDepth, PartitionerT::maxNumParts) <= StaticFlatBvhNodeHitStack::capacity,
+            "The traversal stack can overflow for the deepest and widest trees this bvh can build.");
+        using NodeType = StaticFlatBvhNode<BvShapeT>;
+        using ObjectBlobType = SceneObjectBlob<BoundedShapes, StorageProviderT>;
+        using ObjectRangeType = typename ObjectBlobType::Range;
+
+        using BoundedBvhObjectStorage = BoundedStaticBvhObjectStorage<BvhParamsT>;
+        using BoundedBvhObjectVector = BoundedStaticBvhObjectVector<BvhParamsT>;
+        using BoundedBvhObjectVectorIterator = BoundedStaticBvhObjectVectorIterator<BvhParamsT>;
+
+        template <typename... PartitionerArgsTs>
+        StaticFlatBvh(const RawSceneObjectBlob<AllShapes>& blob, PartitionerArgsTs&&... args) :
+            m_partitioner(std::forward<PartitionerArgsTs>(args)...)
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t0 = std::chrono::high_resolution_clock().now();
+#endif
+            construct(blob, nullptr);
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t1 = std::chrono::high_resolution_clock().now();
+            auto diff = t1 - t0;
+            perf::gThreadLocalPerfStats.addConstructionTime(diff);
+            perf::gThreadLocalPerfStats.addBvhSahCost(sahCost());
+#endif
+        }
+
+        // Subtrees with at least minParallelBuildSize objects are built as separate tasks on the pool.
+        // The resulting layout is the same as the one built serially.
+        template <typename... PartitionerArgsTs>
+        StaticFlatBvh(const RawSceneObjectBlob<AllShapes>& blob, ThreadPool& pool, PartitionerArgsTs&&... args) :
+            m_partitioner(std::forward<PartitionerArgsTs>(args)...)
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t0 = std::chrono::high_resolution_clock().now();
+#endif
+            construct(blob, &pool);
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t1 = std::chrono::high_resolution_clock().now();
+            auto diff = t1 - t0;
+            perf::gThreadLocalPerfStats.addConstructionTime(diff);
+            perf::gThreadLocalPerfStats.addBvhSahCost(sahCost());
+#endif
+        }
+
+        [[nodiscard]] bool queryNearest(const Ray& ray, ResolvableRaycastHit& hit) const
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Traversal);
+#endif
+
+            if constexpr (std::is_same_v<TraversalT, StaticBvhStackTraversal>)
+            {
+                return queryNearestStack(ray, hit);
+            }
+            else
+            {
+                return queryNearestQueue(ray, hit);
+            }
+        }
+
+        // Whether anything is hit closer than maxDist.
+        // The traversal ends at the first hit found, so it's always depth first regardless of TraversalT.
+        [[nodiscard]] bool queryAny(const Ray& ray, float maxDist) const
+        {
+
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedRenderPhaseTimer timer(perf::RenderPhase::Traversal);
+#endif
+
+            if (m_unboundedObjects.queryAny(ray, maxDist))
+            {
+                return true;
+            }
+
+            StaticFlatBvhNodeHitStack stack;
+            stack.push(StaticFlatBvhNodeHit{ 0.0f, 0 });
+            while (!stack.empty())
+            {
+                const StaticFlatBvhNodeHit entry = stack.pop();
+                const NodeType& node = m_nodes[entry.nodeNo];
+                if (node.isLeaf())
+                {
+                    if (m_objects.queryAny(ray, m_leafObjectRanges[node.leafNo], maxDist))
+                    {
+                        return true;
+                    }
+                    continue;
+                }
+
+                RaycastBvHit bvhit;
+                int childNo = entry.nodeNo + 1;
+                for (int i = 0; i < node.numChildren; ++i)
+                {
+                    const NodeType& child = m_nodes[childNo];
+                    if (raycastBv(ray, child.boundingVolume, maxDist, bvhit))
+                    {
+                        stack.push(StaticFlatBvhNodeHit{ bvhit.dist, childNo });
+                    }
+                    childNo += child.subtreeSize;
+                }
+            }
+
+            return false;
+        }
+
+        void gatherLights(std::vector<LightHandle>& lights) const
+        {
+            m_objects.gatherLights(lights);
+        }
+
+        // Unbounded objects are not included.
+        [[nodiscard]] double sahCost() const
+        {
+            BvhSahCost cost(m_nodes.front().boundingVolume.surfaceArea());
+            for (const NodeType& node : m_nodes)
+            {
+                if (node.isLeaf())
+                {
+                    const ObjectRangeType& range = m_leafObjectRanges[node.leafNo];
+                    int numObjects = 0;
+                    for (int i = 0; i < static_cast<int>(range.begin.size()); ++i)
+                    {
+                        numObjects += range.end[i] - range.begin[i];
+                    }
+                    cost.addLeafNode(node.boundingVolume.surfaceArea(), numObjects);
+                }
+                else
+                {
+                    cost.addPartitionNode(node.boundingVolume.surfaceArea());
+                }
+            }
+            return cost.value();
+        }
+
+    private:
+        std::vector<NodeType> m_nodes;
+        std::vector<ObjectRangeType> m_leafObjectRanges;
+        ObjectBlobType m_objects;
+        SceneObjectBlob<UnboundedShapes, StorageProviderT> m_unboundedObjects;
+        PartitionerT m_partitioner;
+
+        [[nodiscard]] bool queryNearestStack(const Ray& ray, ResolvableRaycastHit& hit) const
+        {
+            StaticFlatBvhNodeHitStack stack;
+
+            stack.push(StaticFlatBvhNodeHit{ 0.0f, 0 });
+            bool anyHit = m_unboundedObjects.queryNearest(ray, hit);
+
+            while (!stack.empty())
+            {
+                const StaticFlatBvhNodeHit entry = stack.pop();
+                if (entry.dist >= hit.dist) continue;
+
+                const NodeType& node = m_nodes[entry.nodeNo];
+                if (node.isLeaf())
+                {
+                    anyHit |= m_objects.queryNearest(ray, m_leafObjectRanges[node.leafNo], hit);
+                    continue;
+                }
+
+                RaycastBvHit bvhit;
+                int numHits = 0;
+                int childNo = entry.nodeNo + 1;
+                for (int i = 0; i < node.numChildren; ++i)
+                {
+                    const NodeType& child = m_nodes[childNo];
+                    if (raycastBv(ray, child.boundingVolume, hit.dist, bvhit))
+                    {
+                        stack.push(StaticFlatBvhNodeHit{ bvhit.dist, childNo });
+                        ++numHits;
+                    }
+                    childNo += child.subtreeSize;
+                }
+                stack.sortTop(numHits);
+            }
+
+            return anyHit;
+        }
+
+        [[nodiscard]] bool queryNearestQueue(const Ray& ray, ResolvableRaycastHit& hit) const
+        {
+            thread_local StaticFlatBvhNodeHitQueue queue = []() {
+                std::vector<StaticFlatBvhNodeHit> vec;
+                vec.reserve(maxDepth * 4);
+                return StaticFlatBvhNodeHitQueue(std::greater<StaticFlatBvhNodeHit>{}, std::move(vec));
+            }();
+
+            queue.push(StaticFlatBvhNodeHit{ 0.0f, 0 });
+            bool anyHit = m_unboundedObjects.queryNearest(ray, hit);
+
+            while (!queue.empty())
+            {
+                const StaticFlatBvhNodeHit entry = queue.top();
+                if (entry.dist >= hit.dist) break;
+                queue.pop();
+
+                const NodeType& node = m_nodes[entry.nodeNo];
+                if (node.isLeaf())
+                {
+                    anyHit |= m_objects.queryNearest(ray, m_leafObjectRanges[node.leafNo], hit);
+                    continue;
+                }
+
+                RaycastBvHit bvhit;
+                int childNo = entry.nodeNo + 1;
+                for (int i = 0; i < node.numChildren; ++i)
+                {
+                    const NodeType& child = m_nodes[childNo];
+                    if (raycastBv(ray, child.boundingVolume, hit.dist, bvhit))
+                    {
+                        queue.push(StaticFlatBvhNodeHit{ bvhit.dist, childNo });
+                    }
+                    childNo += child.subtreeSize;
+                }
+            }
+            while (!queue.empty()) queue.pop();
+
+            return anyHit;
+        }
+
+        // Intermediate tree, only used during construction.
+        // It can be built concurrently, the final layout is only known once the whole tree is built.
+        struct BuildNode
+        {
+            BvShapeT boundingVolume;
+            BoundedBvhObjectVectorIterator first;
+            BoundedBvhObjectVectorIterator last;
+            std::vector<BuildNode> children;
+            int subtreeSize; // in nodes, including this one
+        };
+
+        void construct(const RawSceneObjectBlob<AllShapes>& blob, ThreadPool* pool)
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t0 = std::chrono::high_resolution_clock().now();
+#endif
+            BoundedBvhObjectStorage storage;
+            blob.forEach([&](auto&& object) {
+                using ObjectType = remove_cvref_t<decltype(object)>;
+                using ShapeType = typename ObjectType::ShapeType;
+                if constexpr (ShapeTraits<ShapeType>::isBounded)
+                {
+                    storage.add(object);
+                }
+                else
+                {
+                    m_unboundedObjects.add(object);
+                }
+            });
+            m_unboundedObjects.compact();
+
+            // The storage is not modified anymore so the pointers stay valid.
+            BoundedBvhObjectVector allObjects;
+            allObjects.reserve(storage.size());
+            storage.forEach([&](const auto& object) {
+                allObjects.emplace_back(&object);
+            });
+
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t1 = std::chrono::high_resolution_clock().now();
+            perf::gThreadLocalPerfStats.addConstructionTime(perf::ConstructionPhase::Gather, t1 - t0);
+#endif
+
+            BuildNode root;
+            makeNode(root, allObjects.begin(), allObjects.end(), 0, pool);
+
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t2 = std::chrono::high_resolution_clock().now();
+            perf::gThreadLocalPerfStats.addConstructionTime(perf::ConstructionPhase::Build, t2 - t1);
+#endif
+
+            m_nodes.reserve(root.subtreeSize);
+            linearize(root);
+            m_leafObjectRanges.shrink_to_fit();
+            m_objects.compact();
+
+#if defined(RAY_GATHER_PERF_STATS)
+            auto t3 = std::chrono::high_resolution_clock().now();
+            perf::gThreadLocalPerfStats.addConstructionTime(perf::ConstructionPhase::Finalize, t3 - t2);
+#endif
+        }
+
+        [[nodiscard]] BvShapeT boundingVolume(BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last) const
+        {
+            if (first == last) return {};
+            BvShapeT bb = (*first)->boundingVolume();
+            ++first;
+            while (first != last)
+            {
+                bb.extend((*first)->boundingVolume());
+                ++first;
+            }
+            return bb;
+        }
+
+        void makePartitionNode(BuildNode& node, int depth, ThreadPool* pool) const
+        {
+            std::vector<BoundedBvhObjectVectorIterator> ends = m_partitioner.partition(node.first, node.last);
+
+            // Parts only touch their own ranges so big ones can be built concurrently.
+            node.children.resize(ends.size());
+            ThreadPoolTaskGroup group;
+            auto first = node.first;
+            for (int i = 0; i < static_cast<int>(ends.size()); ++i)
+            {
+                const auto partEnd = ends[i];
+                BuildNode& child = node.children[i];
+                if (pool != nullptr && std::distance(first, partEnd) >= minParallelBuildSize)
+                {
+                    pool->run(group, [this, &child, first, partEnd, depth, pool]() {
+                        makeNode(child, first, partEnd, depth + 1, pool);
+                    });
+                }
+                else
+                {
+                    makeNode(child, first, partEnd, depth + 1, pool);
+                }
+
+                first = partEnd;
+            }
+
+            if (pool != nullptr)
+            {
+                pool->wait(group);
+            }
+
+            for (const BuildNode& child : node.children)
+            {
+                node.subtreeSize += child.subtreeSize;
+            }
+        }
+
+        void makeNode(BuildNode& node, BoundedBvhObjectVectorIterator first, BoundedBvhObjectVectorIterator last, int depth, ThreadPool* pool) const
+        {
+            node.boundingVolume = boundingVolume(first, last);
+            node.first = first;
+            node.last = last;
+            node.subtreeSize = 1;
+
+            const int size = static_cast<int>(std::distance(first, last));
+            if (size > maxObjectsPerNode && depth < maxDepth)
+            {
+                makePartitionNode(node, depth, pool);
+            }
+        }
+
+        // Appends the whole subtree to m_nodes in depth-first order.
+        // Leaf objects are added to m_objects in the same order so each leaf is a contiguous range.
+        void linearize(const BuildNode& node)
+        {
+            const int nodeNo = static_cast<int>(m_nodes.size());
+            m_nodes.emplace_back();
+            m_nodes[nodeNo].boundingVolume = node.boundingVolume;
+            m_nodes[nodeNo].subtreeSize = node.subtreeSize;
+            m_nodes[nodeNo].numChildren = static_cast<int>(node.children.size());
+
+            if (node.children.empty())
+            {
+                ObjectRangeType range;
+                range.begin = m_objects.sizes();
+                for (auto it = node.first; it != node.last; ++it)
+                {
+                    (*it)->addTo(m_objects);
+                }
+                range.end = m_objects.sizes();
+
+                m_nodes[nodeNo].leafNo = static_cast<int>(m_leafObjectRanges.size());
+                m_leafObjectRanges.emplace_back(range);
+            }
+            else
+            {
+                m_nodes[nodeNo].leafNo = -1;
+                for (const BuildNode& child : node.children)
+                {
+                    linearize(child);
+                }
+            }
+        }
+    };
+
+    template <typename BvhParamsT, typename PartitionerMakerT>
+    struct StaticFlatBvh<BvhParamsT, PartitionerMakerT> : StaticFlatBvh<BvhParamsT, PartitionerMakerT, StaticBvhStackTraversal>
+    {
+        using BaseType = StaticFlatBvh<BvhParamsT, PartitionerMakerT, StaticBvhStackTraversal>;
+
+        using BaseType::BaseType;
+    };
+}
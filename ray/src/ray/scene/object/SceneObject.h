@@ -42,7 +42,7 @@ namespace ray
     struct SceneObject
     {
         using ShapeType = ShapeT;
-        using ShapeTraits = ShapeTraits<ShapeType>;
+        using ShapeTraits = ray::ShapeTraits<ShapeType>;
         using BaseShapeType = typename ShapeTraits::BaseShapeType;
         static constexpr bool isPack = ShapeTraits::numShapes > 1;
         static constexpr bool isBounded = ShapeTraits::isBounded;
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ray
+{
+    // Single allocation holding the objects of all arrays of a SceneObjectBlob.
+    // Columns are first reserved, which sizes the allocation, and then stored in the same order.
+    // Hot columns, the shapes tested during traversal, are placed before the cold ones
+    // that are only read when a hit is resolved, so intersection touches fewer cache lines.
+    // Stored values are never destroyed.
+    struct SceneObjectArena
+    {
+        enum struct Section
+        {
+            Hot,
+            Cold
+        };
+
+        // Hot columns start at cache line boundaries.
+        static constexpr std::size_t hotAlignment = 64;
+
+        SceneObjectArena() noexcept :
+            m_hotSize(0),
+            m_coldSize(0),
+            m_hotUsed(0),
+            m_coldUsed(0)
+        {
+        }
+
+        SceneObjectArena(const SceneObjectArena&) = delete;
+        SceneObjectArena(SceneObjectArena&&) noexcept = default;
+        SceneObjectArena& operator=(const SceneObjectArena&) = delete;
+        SceneObjectArena& operator=(SceneObjectArena&&) noexcept = default;
+
+        template <typename T>
+        void reserve(Section section, std::size_t count)
+        {
+            if (count == 0) return;
+
+            std::size_t& size = section == Section::Hot ? m_hotSize : m_coldSize;
+            size = alignUp(size, alignment<T>(section)) + count * sizeof(T);
+        }
+
+        // Must be called once, after all columns are reserved.
+        void allocate()
+        {
+            const std::size_t size = coldBegin() + m_coldSize;
+            if (size > 0)
+            {
+                m_memory.reset(static_cast<std::byte*>(::operator new(size, std::align_val_t{ hotAlignment })));
+            }
+        }
+
+        // Moves the values to the arena and frees the vector.
+        // Must be called in the same order as reserve.
+        template <typename T>
+        [[nodiscard]] T* store(Section section, std::vector<T>& values)
+        {
+            static_assert(std::is_trivially_destructible_v<T>, "Values in the arena are never destroyed.");
+
+            if (values.empty()) return nullptr;
+
+            std::size_t& used = section == Section::Hot ? m_hotUsed : m_coldUsed;
+            used = alignUp(used, alignment<T>(section));
+            T* data = reinterpret_cast<T*>(m_memory.get() + (section == Section::Hot ? 0 : coldBegin()) + used);
+            used += values.size() * sizeof(T);
+
+            std::uninitialized_move(values.begin(), values.end(), data);
+            std::vector<T>().swap(values);
+            return data;
+        }
+
+        [[nodiscard]] bool isAllocated() const
+        {
+            return m_memory != nullptr;
+        }
+
+        // In bytes, including padding.
+        [[nodiscard]] std::size_t size() const
+        {
+            return m_memory != nullptr ? coldBegin() + m_coldSize : 0;
+        }
+
+    private:
+        struct Deleter
+        {
+            void operator()(std::byte* memory) const
+            {
+                ::operator delete(memory, std::align_val_t{ hotAlignment });
+            }
+        };
+
+        std::unique_ptr<std::byte, Deleter> m_memory;
+        std::size_t m_hotSize;
+        std::size_t m_coldSize;
+        std::size_t m_hotUsed;
+        std::size_t m_coldUsed;
+
+        template <typename T>
+        [[nodiscard]] static constexpr std::size_t alignment(Section section)
+        {
+            return section == Section::Hot && hotAlignment > alignof(T) ? hotAlignment : alignof(T);
+        }
+
+        [[nodiscard]] static constexpr std::size_t alignUp(std::size_t offset, std::size_t alignment)
+        {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        [[nodiscard]] std::size_t coldBegin() const
+        {
+            return alignUp(m_hotSize, hotAlignment);
+        }
+    };
+
+    // Column of a SceneObjectArray that is a vector until it's moved to an arena.
+    // Values that have to be destroyed, like shapes owning memory, stay in the vector.
+    // Can't be copied because after the move it points into memory it doesn't own.
+    template <typename T>
+    struct SceneObjectArenaColumn
+    {
+        static constexpr bool isMovableToArena = std::is_trivially_destructible_v<T>;
+
+        SceneObjectArenaColumn() noexcept :
+            m_data(nullptr)
+        {
+        }
+
+        SceneObjectArenaColumn(const SceneObjectArenaColumn&) = delete;
+        SceneObjectArenaColumn(SceneObjectArenaColumn&&) noexcept = default;
+        SceneObjectArenaColumn& operator=(const SceneObjectArenaColumn&) = delete;
+        SceneObjectArenaColumn& operator=(SceneObjectArenaColumn&&) noexcept = default;
+
+        template <typename... ArgTs>
+        T& emplace_back(ArgTs&&... args)
+        {
+            T& value = m_staging.emplace_back(std::forward<ArgTs>(args)...);
+            m_data = m_staging.data();
+            return value;
+        }
+
+        [[nodiscard]] T& back()
+        {
+            return m_staging.back();
+        }
+
+        [[nodiscard]] const T& operator[](int i) const
+        {
+            return m_data[i];
+        }
+
+        void reserveIn(SceneObjectArena& arena, SceneObjectArena::Section section) const
+        {
+            if constexpr (isMovableToArena)
+            {
+                arena.reserve<T>(section, m_staging.size());
+            }
+        }
+
+        // Values added after this are not accessible.
+        void moveTo(SceneObjectArena& arena, SceneObjectArena::Section section)
+        {
+            if constexpr (isMovableToArena)
+            {
+                if (m_staging.empty()) return;
+
+                m_data = arena.store(section, m_staging);
+            }
+        }
+
+    private:
+        std::vector<T> m_staging;
+        const T* m_data;
+    };
+
+    struct ArenaSceneObjectColumns
+    {
+        template <typename T>
+        using Type = SceneObjectArenaColumn<T>;
+    };
+}
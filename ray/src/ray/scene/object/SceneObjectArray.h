@@ -1,12 +1,19 @@
 #pragma once
 
+#if defined(RAY_GATHER_PERF_STATS)
+#include <ray/perf/PerformanceStats.h>
+#endif
+
+#include "SceneObjectArena.h"
 #include "SceneObjectCollection.h"
 #include "SceneObject.h"
 
 #include <ray/material/Material.h>
 #include <ray/material/SurfaceShader.h>
 
+#include <ray/math/BoundingVolume.h>
 #include <ray/math/Ray.h>
+#include <ray/math/RayPacket4.h>
 #include <ray/math/RaycastHit.h>
 #include <ray/math/TextureCoordinateResolver.h>
 
@@ -15,12 +22,21 @@
 
 #include <ray/shape/ShapeTraits.h>
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <functional>
+#include <limits>
 #include <vector>
 
 namespace ray
 {
+    struct VectorSceneObjectColumns
+    {
+        template <typename T>
+        using Type = std::vector<T>;
+    };
+
     namespace detail
     {
         // Specialization for polymorphic shapes
@@ -70,6 +86,10 @@ namespace ray
 
             [[nodiscard]] bool queryNearest(const Ray& ray, ResolvableRaycastHit& hit) const
             {
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::ScopedObjectQueryTimer<AnyShapeT> timer;
+#endif
+
                 const int size = static_cast<int>(m_objects.size());
                 bool anyHit = false;
                 for (int shapeNo = 0; shapeNo < size; ++shapeNo)
@@ -89,6 +109,89 @@ namespace ray
                 return anyHit;
             }
 
+            // Only objects in [firstShapeNo, lastShapeNo) are considered.
+            [[nodiscard]] bool queryNearest(const Ray& ray, int firstShapeNo, int lastShapeNo, ResolvableRaycastHit& hit) const
+            {
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::ScopedObjectQueryTimer<AnyShapeT> timer;
+#endif
+
+                bool anyHit = false;
+                for (int shapeNo = firstShapeNo; shapeNo < lastShapeNo; ++shapeNo)
+                {
+                    if (m_objects[shapeNo].raycast(ray, hit))
+                    {
+                        anyHit = true;
+                        hit.shapeNo = shapeNo;
+                    }
+                }
+
+                if (anyHit)
+                {
+                    hit.owner = this;
+                }
+
+                return anyHit;
+            }
+
+            // Polymorphic shapes have no packet kernels so the rays are queried one by one.
+            [[nodiscard]] std::uint8_t queryNearest(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const
+            {
+                std::uint8_t mask = 0;
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    if ((activeMask & (1 << lane)) == 0) continue;
+
+                    if (queryNearest(rays.ray(lane), hits[lane]))
+                    {
+                        mask |= 1 << lane;
+                    }
+                }
+
+                return mask;
+            }
+
+            [[nodiscard]] bool queryAny(const Ray& ray, float maxDist) const
+            {
+                return queryAny(ray, 0, size(), maxDist);
+            }
+
+            // Only objects in [firstShapeNo, lastShapeNo) are considered.
+            [[nodiscard]] bool queryAny(const Ray& ray, int firstShapeNo, int lastShapeNo, float maxDist) const
+            {
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::ScopedObjectQueryTimer<AnyShapeT> timer;
+#endif
+
+                ResolvableRaycastHit hit;
+                hit.dist = maxDist;
+                for (int shapeNo = firstShapeNo; shapeNo < lastShapeNo; ++shapeNo)
+                {
+                    if (m_objects[shapeNo].raycast(ray, hit))
+                    {
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+
+            [[nodiscard]] std::uint8_t queryAny(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const
+            {
+                std::uint8_t mask = 0;
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    if ((activeMask & (1 << lane)) == 0) continue;
+
+                    if (queryAny(rays.ray(lane), hits[lane].dist))
+                    {
+                        mask |= 1 << lane;
+                    }
+                }
+
+                return mask;
+            }
+
             [[nodiscard]] bool queryLocal(const Ray& ray, int shapeNo, ResolvableRaycastHit& hit) const override
             {
                 if (m_objects[shapeNo].raycast(ray, hit))
@@ -118,12 +221,22 @@ namespace ray
                         const auto& obj = m_objects[i];
                         if (obj.isLight())
                         {
-                            lights.emplace_back(obj.center(), obj.id());
+                            // materials of polymorphic objects are not accessible, so the emission is unknown
+                            lights.emplace_back(obj.center(), obj.aabb(), std::numeric_limits<float>::infinity(), obj.id(), *this, i);
                         }
                     }
                 }
             }
 
+            // Polymorphic objects own their shapes so they stay where they are.
+            void reserveIn(SceneObjectArena&) const
+            {
+            }
+
+            void moveTo(SceneObjectArena&)
+            {
+            }
+
         private:
             ShapeStorageType m_objects;
         };
@@ -132,23 +245,24 @@ namespace ray
     // Analogical to SceneObject but shapePacks and materialsView are not interleaved.
     // So there are two separate arrays for shapePacks and materialsView
     // Handles packs by abstracting insertion and access to be done on with granularity of a single shape.
-    template <typename ShapeT>
+    // ColumnsT decides how the arrays are stored, either in vectors or in a SceneObjectArena.
+    template <typename ShapeT, typename ColumnsT = VectorSceneObjectColumns>
     struct SceneObjectArray : HomogeneousSceneObjectCollection
     {
         using ShapePackType = ShapeT;
-        using ShapeTraits = ShapeTraits<ShapePackType>;
+        using ShapeTraits = ray::ShapeTraits<ShapePackType>;
         using BaseShapeType = typename ShapeTraits::BaseShapeType;
-        using SurfaceShaderType = SurfaceShader<ShapeT>;
+        using SurfaceShaderType = SurfaceShader<BaseShapeType>;
         using SurfaceShaderPtrType = const SurfaceShaderType*;
         static constexpr int numShapesInPack = ShapeTraits::numShapes;
         static constexpr bool isPack = numShapesInPack > 1;
         static constexpr bool hasVolume = ShapeTraits::hasVolume;
         static constexpr bool isBounded = ShapeTraits::isBounded;
         static constexpr bool isLocallyContinuable = ShapeTraits::isLocallyContinuable;
-        using ShapeStorageType = std::vector<ShapePackType>;
-        using MaterialStorageType = std::vector<MaterialPtrStorageType<BaseShapeType>>;
-        using SurfaceShaderPtrStorageType = std::vector<SurfaceShaderPtrType>;
-        using IdStorageType = std::vector<SceneObjectId>;
+        using ShapeStorageType = typename ColumnsT::template Type<ShapePackType>;
+        using MaterialStorageType = typename ColumnsT::template Type<MaterialPtrStorageType<BaseShapeType>>;
+        using SurfaceShaderPtrStorageType = typename ColumnsT::template Type<SurfaceShaderPtrType>;
+        using IdStorageType = typename ColumnsT::template Type<SceneObjectId>;
 
         SceneObjectArray() noexcept :
             m_size(0)
@@ -218,12 +332,25 @@ namespace ray
 
         [[nodiscard]] bool queryNearest(const Ray& ray, ResolvableRaycastHit& hit) const
         {
-            const int size = static_cast<int>(m_shapePacks.size());
+            return queryNearest(ray, 0, m_size, hit);
+        }
+
+        // Only objects in [firstShapeNo, lastShapeNo) are considered.
+        // Lanes of packs sharing shapes with the neighbouring ranges are masked out,
+        // those shapes are tested when their own range is queried.
+        [[nodiscard]] bool queryNearest(const Ray& ray, int firstShapeNo, int lastShapeNo, ResolvableRaycastHit& hit) const
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedObjectQueryTimer<ShapeT> timer;
+#endif
+
+            const int firstPackNo = firstShapeNo / numShapesInPack;
+            const int lastPackNo = (lastShapeNo + numShapesInPack - 1) / numShapesInPack;
             int nearestHitPackNo{};
             bool anyHit = false;
-            for (int packNo = 0; packNo < size; ++packNo)
+            for (int packNo = firstPackNo; packNo < lastPackNo; ++packNo)
             {
-                if (raycast(ray, m_shapePacks[packNo], hit))
+                if (raycastPack(ray, packNo, firstShapeNo, lastShapeNo, hit))
                 {
                     anyHit = true;
                     nearestHitPackNo = packNo;
@@ -240,10 +367,130 @@ namespace ray
             return anyHit;
         }
 
+        // Only lanes set in activeMask are considered.
+        // Returns the mask of lanes for which the hit was updated.
+        [[nodiscard]] std::uint8_t queryNearest(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const
+        {
+            std::uint8_t anyHitMask = 0;
+            if constexpr (isPack)
+            {
+                // One ray against a pack is as wide as a packet against one shape
+                // and doesn't require unpacking the shapes.
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    if ((activeMask & (1 << lane)) == 0) continue;
+
+                    if (queryNearest(rays.ray(lane), hits[lane]))
+                    {
+                        anyHitMask |= 1 << lane;
+                    }
+                }
+            }
+            else
+            {
+
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::ScopedObjectQueryTimer<ShapeT> timer;
+#endif
+
+                for (int shapeNo = 0; shapeNo < m_size; ++shapeNo)
+                {
+                    const std::uint8_t mask = raycast(rays, m_shapePacks[shapeNo], activeMask, hits);
+                    if (mask == 0) continue;
+
+                    for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                    {
+                        if (mask & (1 << lane))
+                        {
+                            hits[lane].shapeNo = shapeNo;
+                            hits[lane].owner = this;
+                        }
+                    }
+                    anyHitMask |= mask;
+                }
+            }
+
+            return anyHitMask;
+        }
+
+        // Whether any object is hit closer than maxDist, stops at the first one found.
+        [[nodiscard]] bool queryAny(const Ray& ray, float maxDist) const
+        {
+            return queryAny(ray, 0, m_size, maxDist);
+        }
+
+        // Only objects in [firstShapeNo, lastShapeNo) are considered, same as in queryNearest.
+        [[nodiscard]] bool queryAny(const Ray& ray, int firstShapeNo, int lastShapeNo, float maxDist) const
+        {
+#if defined(RAY_GATHER_PERF_STATS)
+            perf::ScopedObjectQueryTimer<ShapeT> timer;
+#endif
+
+            const int firstPackNo = firstShapeNo / numShapesInPack;
+            const int lastPackNo = (lastShapeNo + numShapesInPack - 1) / numShapesInPack;
+            ResolvableRaycastHit hit;
+            hit.dist = maxDist;
+            for (int packNo = firstPackNo; packNo < lastPackNo; ++packNo)
+            {
+                if (raycastPack(ray, packNo, firstShapeNo, lastShapeNo, hit))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // hits[lane].dist is the distance up to which objects are searched for the lane.
+        // Lanes are dropped as soon as they hit anything, the hits of such lanes are not meaningful.
+        // Returns the mask of lanes that hit anything.
+        [[nodiscard]] std::uint8_t queryAny(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const
+        {
+            std::uint8_t anyHitMask = 0;
+            if constexpr (isPack)
+            {
+                for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+                {
+                    if ((activeMask & (1 << lane)) == 0) continue;
+
+                    if (queryAny(rays.ray(lane), hits[lane].dist))
+                    {
+                        anyHitMask |= 1 << lane;
+                    }
+                }
+            }
+            else
+            {
+
+#if defined(RAY_GATHER_PERF_STATS)
+                perf::ScopedObjectQueryTimer<ShapeT> timer;
+#endif
+
+                for (int shapeNo = 0; shapeNo < m_size && activeMask != 0; ++shapeNo)
+                {
+                    const std::uint8_t mask = raycast(rays, m_shapePacks[shapeNo], activeMask, hits);
+                    anyHitMask |= mask;
+                    activeMask &= ~mask;
+                }
+            }
+
+            return anyHitMask;
+        }
+
         [[nodiscard]] bool queryLocal(const Ray& ray, int shapeNo, ResolvableRaycastHit& hit) const override
         {
-            const int packNo = shapeNo / numShapesInPack;
-            if (raycast(ray, m_shapePacks[packNo], hit))
+            // Other shapes in the pack must not be considered.
+            bool isHit;
+            if constexpr (isPack)
+            {
+                isHit = raycast(ray, shape(shapeNo), hit);
+            }
+            else
+            {
+                isHit = raycast(ray, m_shapePacks[shapeNo], hit);
+            }
+
+            if (isHit)
             {
                 hit.shapeNo = shapeNo;
                 hit.owner = this;
@@ -270,25 +517,58 @@ namespace ray
                 {
                     if (m_materials[i].isEmissive())
                     {
-                        lights.emplace_back(shape(i).center(), m_ids[i]);
+                        lights.emplace_back(shape(i).center(), boundingVolume<Box3>(shape(i)), m_materials[i].maxEmission(), m_ids[i], *this, i);
                     }
                 }
             }
         }
 
+        // Only for arena columns, see SceneObjectArena.
+        void reserveIn(SceneObjectArena& arena) const
+        {
+            m_shapePacks.reserveIn(arena, SceneObjectArena::Section::Hot);
+            m_materials.reserveIn(arena, SceneObjectArena::Section::Cold);
+            m_shaders.reserveIn(arena, SceneObjectArena::Section::Cold);
+            m_ids.reserveIn(arena, SceneObjectArena::Section::Cold);
+        }
+
+        void moveTo(SceneObjectArena& arena)
+        {
+            m_shapePacks.moveTo(arena, SceneObjectArena::Section::Hot);
+            m_materials.moveTo(arena, SceneObjectArena::Section::Cold);
+            m_shaders.moveTo(arena, SceneObjectArena::Section::Cold);
+            m_ids.moveTo(arena, SceneObjectArena::Section::Cold);
+        }
+
     private:
         ShapeStorageType m_shapePacks;
         MaterialStorageType m_materials;
         SurfaceShaderPtrStorageType m_shaders;
         IdStorageType m_ids;
         int m_size;
+
+        // Tests the shapes of the pack that are in [firstShapeNo, lastShapeNo).
+        [[nodiscard]] bool raycastPack(const Ray& ray, int packNo, int firstShapeNo, int lastShapeNo, ResolvableRaycastHit& hit) const
+        {
+            if constexpr (isPack)
+            {
+                const int firstLane = std::max(firstShapeNo - packNo * numShapesInPack, 0);
+                const int lastLane = std::min(lastShapeNo - packNo * numShapesInPack, numShapesInPack);
+                const std::uint8_t laneMask = static_cast<std::uint8_t>(((1 << lastLane) - 1) & ~((1 << firstLane) - 1));
+                return raycast(ray, m_shapePacks[packNo], laneMask, hit);
+            }
+            else
+            {
+                return raycast(ray, m_shapePacks[packNo], hit);
+            }
+        }
     };
 
     // only the underlying scene object's structure changes
-    template <>
-    struct SceneObjectArray<CsgShape> : detail::PolymorphicSceneObjectArray<CsgShape> {};
-    template <>
-    struct SceneObjectArray<AnyShape<true>> : detail::PolymorphicSceneObjectArray<AnyShape<true>> {};
-    template <>
-    struct SceneObjectArray<AnyShape<false>> : detail::PolymorphicSceneObjectArray<AnyShape<false>> {};
+    template <typename ColumnsT>
+    struct SceneObjectArray<CsgShape, ColumnsT> : detail::PolymorphicSceneObjectArray<CsgShape> {};
+    template <typename ColumnsT>
+    struct SceneObjectArray<AnyShape<true>, ColumnsT> : detail::PolymorphicSceneObjectArray<AnyShape<true>> {};
+    template <typename ColumnsT>
+    struct SceneObjectArray<AnyShape<false>, ColumnsT> : detail::PolymorphicSceneObjectArray<AnyShape<false>> {};
 }
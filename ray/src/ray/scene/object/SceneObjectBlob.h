@@ -4,6 +4,9 @@
 #include "SceneObjectCollection.h"
 #include "SceneObjectStorageProvider.h"
 
+#include <ray/math/Float4.h>
+#include <ray/math/RayPacket4.h>
+
 #include <ray/scene/LightHandle.h>
 #include <ray/scene/SceneRaycastHit.h>
 
@@ -12,12 +15,29 @@
 
 #include <ray/utility/Util.h>
 
+#include <array>
+#include <cstdint>
 #include <optional>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 
 namespace ray
 {
+    namespace detail
+    {
+        template <typename SceneObjectStorageProviderT, typename = void>
+        struct UsesSceneObjectArena : std::false_type {};
+
+        template <typename SceneObjectStorageProviderT>
+        struct UsesSceneObjectArena<
+            SceneObjectStorageProviderT,
+            std::enable_if_t<SceneObjectStorageProviderT::usesArena>
+        > : std::true_type {};
+
+        struct NoSceneObjectArena {};
+    }
+
     template <typename...>
     struct SceneObjectBlob;
 
@@ -32,26 +52,40 @@ namespace ray
         template <typename ShapeT>
         using ObjectStorageType = typename SceneObjectStorageProviderT::template ArrayType<ShapeT>;
 
+        static constexpr bool usesArena = detail::UsesSceneObjectArena<SceneObjectStorageProviderT>::value;
+        using ArenaType = std::conditional_t<usesArena, SceneObjectArena, detail::NoSceneObjectArena>;
+
     public:
+        using IndexArrayType = std::array<int, sizeof...(ShapeTs)>;
+
+        // Specifies a subset of objects as a [begin, end) range for each shape type.
+        struct Range
+        {
+            IndexArrayType begin;
+            IndexArrayType end;
+        };
+
         SceneObjectBlob() :
             m_objects{}
         {
         }
 
-        template <typename... ShapeTs>
-        SceneObjectBlob(const RawSceneObjectBlob<Shapes<ShapeTs...>>& blob)
+        template <typename... OtherShapeTs>
+        SceneObjectBlob(const RawSceneObjectBlob<Shapes<OtherShapeTs...>>& blob)
         {
             blob.forEach([&](auto&& object) {
                 add(object);
             });
+            compact();
         }
 
-        template <typename... ShapeTs>
-        SceneObjectBlob(RawSceneObjectBlob<Shapes<ShapeTs...>>&& blob)
+        template <typename... OtherShapeTs>
+        SceneObjectBlob(RawSceneObjectBlob<Shapes<OtherShapeTs...>>&& blob)
         {
             blob.forEach([&](auto&& object) {
                 add(std::move(object));
                 });
+            compact();
         }
 
         template <typename ShapeT>
@@ -79,6 +113,94 @@ namespace ray
             return anyHit;
         }
 
+        [[nodiscard]] std::uint8_t queryNearest(const RayPacket4& rays, ResolvableRaycastHitPacket4& hits) const
+        {
+            return queryNearest(rays, RayPacket4::allLanes, hits);
+        }
+
+        // Returns the mask of lanes for which the hit was updated.
+        [[nodiscard]] std::uint8_t queryNearest(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const
+        {
+            std::uint8_t anyHitMask = 0;
+            for_each(m_objects, [&](const auto& objects) {
+                if (objects.size() > 0)
+                {
+                    anyHitMask |= objects.queryNearest(rays, activeMask, hits);
+                }
+            });
+
+            return anyHitMask;
+        }
+
+        [[nodiscard]] bool queryNearest(const Ray& ray, const Range& range, ResolvableRaycastHit& hit) const
+        {
+            return queryNearest(ray, range, hit, std::index_sequence_for<ShapeTs...>{});
+        }
+
+        // Whether any object is hit closer than maxDist, stops at the first one found.
+        [[nodiscard]] bool queryAny(const Ray& ray, float maxDist) const
+        {
+            bool anyHit = false;
+            for_each(m_objects, [&](const auto& objects) {
+                if (!anyHit && objects.size() > 0)
+                {
+                    anyHit = objects.queryAny(ray, maxDist);
+                }
+            });
+
+            return anyHit;
+        }
+
+        // Returns the mask of lanes that hit anything closer than maxDists.
+        [[nodiscard]] std::uint8_t queryAny(const RayPacket4& rays, std::uint8_t activeMask, const Float4& maxDists) const
+        {
+            ResolvableRaycastHitPacket4 hits;
+            for (int lane = 0; lane < RayPacket4::numRays; ++lane)
+            {
+                hits[lane].dist = maxDists.v[lane];
+            }
+            return queryAny(rays, activeMask, hits);
+        }
+
+        // hits[lane].dist is the distance up to which objects are searched for the lane.
+        // Returns the mask of lanes that hit anything, the hits of such lanes are not meaningful.
+        [[nodiscard]] std::uint8_t queryAny(const RayPacket4& rays, std::uint8_t activeMask, ResolvableRaycastHitPacket4& hits) const
+        {
+            std::uint8_t anyHitMask = 0;
+            for_each(m_objects, [&](const auto& objects) {
+                if (activeMask != 0 && objects.size() > 0)
+                {
+                    const std::uint8_t mask = objects.queryAny(rays, activeMask, hits);
+                    anyHitMask |= mask;
+                    activeMask &= ~mask;
+                }
+            });
+
+            return anyHitMask;
+        }
+
+        [[nodiscard]] bool queryAny(const Ray& ray, const Range& range, float maxDist) const
+        {
+            return queryAny(ray, range, maxDist, std::index_sequence_for<ShapeTs...>{});
+        }
+
+        [[nodiscard]] int size() const
+        {
+            int size = 0;
+            for_each(m_objects, [&](const auto& objects) {
+                size += objects.size();
+            });
+
+            return size;
+        }
+
+        // Number of objects of each shape type.
+        // Objects added later get consecutive indices, so this can be used to form ranges.
+        [[nodiscard]] IndexArrayType sizes() const
+        {
+            return { objectsOfType<ShapeTs>().size()... };
+        }
+
         void gatherLights(std::vector<LightHandle>& lights) const
         {
             for_each(m_objects, [&](const auto& objects) {
@@ -86,10 +208,55 @@ namespace ray
             });
         }
 
+        // Called when all objects are added.
+        // If the storage provider uses an arena all arrays are moved to a single allocation
+        // and no more objects can be added. Otherwise does nothing.
+        void compact()
+        {
+            if constexpr (usesArena)
+            {
+                if (m_arena.isAllocated()) return;
+
+                for_each(m_objects, [&](const auto& objects) {
+                    objects.reserveIn(m_arena);
+                });
+                m_arena.allocate();
+                for_each(m_objects, [&](auto& objects) {
+                    objects.moveTo(m_arena);
+                });
+            }
+        }
+
     private:
         std::tuple<
             ObjectStorageType<ShapeTs>...
         > m_objects;
+        ArenaType m_arena;
+
+        template <std::size_t... IndicesVs>
+        [[nodiscard]] bool queryNearest(const Ray& ray, const Range& range, ResolvableRaycastHit& hit, std::index_sequence<IndicesVs...>) const
+        {
+            bool anyHit = false;
+            auto query = [&](const auto& objects, int begin, int end) {
+                if (begin != end)
+                {
+                    anyHit |= objects.queryNearest(ray, begin, end, hit);
+                }
+            };
+            (query(std::get<IndicesVs>(m_objects), range.begin[IndicesVs], range.end[IndicesVs]), ...);
+
+            return anyHit;
+        }
+
+        template <std::size_t... IndicesVs>
+        [[nodiscard]] bool queryAny(const Ray& ray, const Range& range, float maxDist, std::index_sequence<IndicesVs...>) const
+        {
+            auto query = [&](const auto& objects, int begin, int end) {
+                return begin != end && objects.queryAny(ray, begin, end, maxDist);
+            };
+
+            return (query(std::get<IndicesVs>(m_objects), range.begin[IndicesVs], range.end[IndicesVs]) || ...);
+        }
 
         template <typename ShapeT>
         [[nodiscard]] ObjectStorageType<ShapeT>& objectsOfType()
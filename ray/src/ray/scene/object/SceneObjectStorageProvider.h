@@ -1,21 +1,38 @@
 #pragma once
 
+#include "SceneObjectArena.h"
 #include "SceneObjectArray.h"
 
+#include <ray/shape/Box3Pack4.h>
 #include <ray/shape/ShapeTraits.h>
+#include <ray/shape/SpherePack4.h>
+#include <ray/shape/Triangle3Pack4.h>
 
 namespace ray
 {
+    namespace detail
+    {
+        template <typename ArrayT, typename ColumnsT>
+        struct WithSceneObjectColumns;
+
+        template <typename ShapeT, typename OldColumnsT, typename ColumnsT>
+        struct WithSceneObjectColumns<SceneObjectArray<ShapeT, OldColumnsT>, ColumnsT>
+        {
+            using Type = SceneObjectArray<ShapeT, ColumnsT>;
+        };
+    }
+
+    // Uses ShapeTraits<ShapeT>::ShapePackType, so shapes that have a SIMD pack are tested 4 at a time.
     struct PackedSceneObjectStorageProvider
     {
-        template <typename ShapeT>
+        template <typename ShapeT, typename = void>
         struct Storage
         {
             using Type = SceneObjectArray<typename ShapeTraits<ShapeT>::ShapePackType>;
         };
 
-        template <>
-        struct Storage<CsgShape>
+        template <typename VoidT>
+        struct Storage<CsgShape, VoidT>
         {
             using Type = SceneObjectArray<CsgShape>;
         };
@@ -35,4 +52,18 @@ namespace ray
         template <typename ShapeT>
         using ArrayType = SceneObjectArray<ShapeT>;
     };
+
+    // Same arrays as PackedSceneObjectStorageProvider, but once a SceneObjectBlob is built
+    // all its arrays are moved to one allocation, see SceneObjectArena and SceneObjectBlob::compact.
+    // Saves the many small allocations of blobs in bvh leaves.
+    struct ArenaSceneObjectStorageProvider
+    {
+        static constexpr bool usesArena = true;
+
+        template <typename ShapeT>
+        using ArrayType = typename detail::WithSceneObjectColumns<
+            PackedSceneObjectStorageProvider::ArrayType<ShapeT>,
+            ArenaSceneObjectColumns
+        >::Type;
+    };
 }
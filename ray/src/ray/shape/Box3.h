@@ -32,6 +32,12 @@ namespace ray
             return max - min;
         }
 
+        [[nodiscard]] float surfaceArea() const
+        {
+            const Vec3f e = extent();
+            return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
         void extend(const Point3f& point)
         {
             min = Point3f::blend(min, point, point < min);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Box3.h"
+
+#include <ray/math/Vec3.h>
+#include <ray/math/Vec3x4.h>
+
+#include <limits>
+
+namespace ray
+{
+    // Four boxes in SoA layout.
+    // Unused lanes hold an empty box placed at +infinity which is never hit by a ray.
+    struct Box3Pack4
+    {
+        static constexpr int numShapes = 4;
+
+        Vec3x4<float> min, max;
+
+        Box3Pack4() noexcept :
+            min(Vec3x4<float>::broadcast(Float4::broadcast(std::numeric_limits<float>::infinity()))),
+            max(Vec3x4<float>::broadcast(Float4::broadcast(std::numeric_limits<float>::infinity())))
+        {
+        }
+
+        void set(int i, const Box3& box)
+        {
+            min.insert(box.min.asVector(), i);
+            max.insert(box.max.asVector(), i);
+        }
+
+        [[nodiscard]] Box3 get(int i) const
+        {
+            return Box3(
+                Point3f(min.x.v[i], min.y.v[i], min.z.v[i]),
+                Point3f(max.x.v[i], max.y.v[i], max.z.v[i])
+            );
+        }
+    };
+}
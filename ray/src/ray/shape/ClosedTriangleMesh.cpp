@@ -2,8 +2,12 @@
 
 namespace ray
 {
-    ClosedTriangleMeshFace::ClosedTriangleMeshFace(const ClosedTriangleMesh& mesh, int i0, int i1, int i2) :
-        m_vertices{ &mesh.vertex(i0), &mesh.vertex(i1), &mesh.vertex(i2) }
+    ClosedTriangleMeshFace::ClosedTriangleMeshFace(const ClosedTriangleMesh& mesh, int faceNo) :
+        m_v0(mesh.faceVertex(faceNo, 0).point),
+        m_e01(mesh.faceVertex(faceNo, 1).point - m_v0),
+        m_e02(mesh.faceVertex(faceNo, 2).point - m_v0),
+        m_faceNo(faceNo),
+        m_mesh(&mesh)
     {
     }
 }
\ No newline at end of file
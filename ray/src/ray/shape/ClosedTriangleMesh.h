@@ -24,23 +24,33 @@ namespace ray
         TexCoords uv;
     };
 
+    // Only the first vertex and the edges, which the intersection test needs, are stored here.
+    // Vertex indices, for normals and uvs, are kept in the mesh and only read for the nearest hit.
     struct ClosedTriangleMeshFace
     {
-        ClosedTriangleMeshFace(const ClosedTriangleMesh& mesh, int i0, int i1, int i2);
+        ClosedTriangleMeshFace(const ClosedTriangleMesh& mesh, int faceNo);
 
-        [[nodiscard]] const ClosedTriangleMeshVertex& vertex(int i) const
+        [[nodiscard]] const ClosedTriangleMeshVertex& vertex(int i) const;
+
+        [[nodiscard]] const Point3f& v0() const
+        {
+            return m_v0;
+        }
+
+        [[nodiscard]] const Vec3f& e01() const
+        {
+            return m_e01;
+        }
+
+        [[nodiscard]] const Vec3f& e02() const
         {
-            return *m_vertices[i];
+            return m_e02;
         }
 
         // only used when calculating uv, not in raycast
-        // don't do precomputation to save space
         [[nodiscard]] BarycentricCoords barycentric(const Point3f& p) const
         {
-            const Point3f v0 = vertex(0).point;
-            const Vec3f v0p = p - v0;
-            const Vec3f m_e01 = vertex(1).point - v0;
-            const Vec3f m_e02 = vertex(2).point - v0;
+            const Vec3f v0p = p - m_v0;
             const float m_d00 = dot(m_e01, m_e01);
             const float m_d01 = dot(m_e01, m_e02);
             const float m_d11 = dot(m_e02, m_e02);
@@ -55,26 +65,28 @@ namespace ray
 
         [[nodiscard]] Point3f center() const
         {
-            return Point3f::origin() + (vertex(0).point.asVector() + vertex(1).point.asVector() + vertex(2).point.asVector()) * 0.333333333333333f;
+            return m_v0 + (m_e01 + m_e02) * 0.333333333333333f;
         }
 
         [[nodiscard]] Box3 aabb() const
         {
-            const Point3f v0 = vertex(0).point;
-            const Point3f v1 = vertex(1).point;
-            const Point3f v2 = vertex(2).point;
-            const Point3f bmin = min(min(v0, v1), v2);
-            const Point3f bmax = max(max(v0, v1), v2);
+            const Point3f v1 = m_v0 + m_e01;
+            const Point3f v2 = m_v0 + m_e02;
+            const Point3f bmin = min(min(m_v0, v1), v2);
+            const Point3f bmax = max(max(m_v0, v1), v2);
             return Box3(bmin, bmax);
         }
 
     private:
-        std::array<const ClosedTriangleMeshVertex*, 3> m_vertices;
+        Point3f m_v0;
+        Vec3f m_e01;
+        Vec3f m_e02;
+        int m_faceNo;
+        const ClosedTriangleMesh* m_mesh;
     };
 
-    // NOTE: currently it requires that no vertices get added after any
-    //       face is added (due to iterator invalidation).
-    //       If that becomes a problem then change do std::deque
+    // NOTE: faces keep a pointer to the mesh so it can't be copied or moved.
+    //       Vertices are referenced by index so they can be added at any time.
     struct ClosedTriangleMesh
     {
         using MaterialStorageType = MaterialPtrStorage<1, 1>;
@@ -85,6 +97,11 @@ namespace ray
         {
         }
 
+        ClosedTriangleMesh(const ClosedTriangleMesh&) = delete;
+        ClosedTriangleMesh(ClosedTriangleMesh&&) = delete;
+        ClosedTriangleMesh& operator=(const ClosedTriangleMesh&) = delete;
+        ClosedTriangleMesh& operator=(ClosedTriangleMesh&&) = delete;
+
         int addVertex(const ClosedTriangleMeshVertex& vertex)
         {
             int idx = static_cast<int>(m_vertexPool.size());
@@ -95,7 +112,8 @@ namespace ray
         int addFace(int a, int b, int c, const SurfaceMaterial* material)
         {
             int idx = static_cast<int>(m_faces.size());
-            m_faces.emplace_back(*this, a, b, c);
+            m_faceVertices.push_back({ a, b, c });
+            m_faces.emplace_back(*this, idx);
             m_materials.emplace_back(MaterialStorageType({ material }, { m_mediumMaterial }));
             return idx;
         }
@@ -105,6 +123,11 @@ namespace ray
             return m_vertexPool[i];
         }
 
+        [[nodiscard]] const ClosedTriangleMeshVertex& faceVertex(int faceNo, int i) const
+        {
+            return m_vertexPool[m_faceVertices[faceNo][i]];
+        }
+
         [[nodiscard]] const ClosedTriangleMeshFace& face(int i) const
         {
             return m_faces[i];
@@ -118,9 +141,9 @@ namespace ray
         // loses volume
         [[nodiscard]] Triangle3 faceAsTriangle(int i) const
         {
-            const auto& v0 = m_faces[i].vertex(0);
-            const auto& v1 = m_faces[i].vertex(1);
-            const auto& v2 = m_faces[i].vertex(2);
+            const auto& v0 = faceVertex(i, 0);
+            const auto& v1 = faceVertex(i, 1);
+            const auto& v2 = faceVertex(i, 2);
             return Triangle3(
                 v0.point, v1.point, v2.point,
                 v0.normal, v1.normal, v2.normal,
@@ -135,7 +158,13 @@ namespace ray
     private:
         std::vector<ClosedTriangleMeshVertex> m_vertexPool;
         std::vector<ClosedTriangleMeshFace> m_faces;
+        std::vector<std::array<int, 3>> m_faceVertices; // indices into the vertex pool
         std::vector<MaterialStorageType> m_materials;
         const MediumMaterial* m_mediumMaterial;
     };
+
+    inline const ClosedTriangleMeshVertex& ClosedTriangleMeshFace::vertex(int i) const
+    {
+        return m_mesh->faceVertex(m_faceNo, i);
+    }
 }
@@ -0,0 +1,305 @@
+#pragma once
+
+#include "Box3.h"
+#include "ClosedTriangleMesh.h"
+#include "TriangleVertexPack8.h"
+
+#include <ray/material/TexCoords.h>
+
+#include <ray/math/BarycentricCoords.h>
+#include <ray/math/Vec3.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+namespace ray
+{
+    // Closed triangle mesh that is a single object in the scene.
+    // Faces index into a shared vertex buffer and have their own bvh,
+    // so the scene's bvh only has to know the bounds of the whole mesh.
+    // Vertex positions, which are read during traversal, are kept apart from normals and uvs.
+    // Each leaf also has a copy of its triangles' positions in a TriangleVertexPack8,
+    // so all of them are tested at once.
+    // Immutable once constructed. Copies share the data, so object storages can hold meshes by value.
+    struct IndexedTriangleMesh
+    {
+        using Face = std::array<int, 3>;
+
+        struct Node
+        {
+            Box3 bounds;
+            int first; // first face for leaves, second child for inner nodes, the first child is right after the node
+            int numFaces; // 0 for inner nodes
+            int firstPack; // first vertex pack for leaves, leaves forced at max depth can have more than one
+        };
+
+        static constexpr int maxFacesPerLeaf = TriangleVertexPack8::numShapes;
+        static constexpr int maxDepth = 64;
+        static constexpr int numSahBins = 16;
+
+        // Faces are reordered so that each leaf of the bvh is a contiguous range.
+        IndexedTriangleMesh(const std::vector<ClosedTriangleMeshVertex>& vertices, const std::vector<Face>& faces)
+        {
+            auto data = std::make_shared<Data>();
+            data->positions.reserve(vertices.size());
+            data->normals.reserve(vertices.size());
+            data->uvs.reserve(vertices.size());
+            for (const ClosedTriangleMeshVertex& vertex : vertices)
+            {
+                data->positions.emplace_back(vertex.point);
+                data->normals.emplace_back(vertex.normal);
+                data->uvs.emplace_back(vertex.uv);
+            }
+
+            std::vector<FaceBounds> bounds;
+            bounds.reserve(faces.size());
+            for (const Face& face : faces)
+            {
+                FaceBounds& b = bounds.emplace_back();
+                b.box = Box3(data->positions[face[0]], data->positions[face[0]]);
+                b.box.extend(data->positions[face[1]]);
+                b.box.extend(data->positions[face[2]]);
+                b.center = b.box.center();
+            }
+
+            std::vector<int> order(faces.size());
+            std::iota(order.begin(), order.end(), 0);
+            if (!faces.empty())
+            {
+                data->nodes.reserve(2 * faces.size() / maxFacesPerLeaf + 1);
+                build(*data, bounds, order, 0, static_cast<int>(order.size()), 0);
+            }
+
+            data->faces.reserve(faces.size());
+            for (int faceNo : order)
+            {
+                data->faces.emplace_back(faces[faceNo]);
+            }
+
+            for (Node& node : data->nodes)
+            {
+                node.firstPack = static_cast<int>(data->packs.size());
+                for (int i = 0; i < node.numFaces; ++i)
+                {
+                    if (i % TriangleVertexPack8::numShapes == 0) data->packs.emplace_back();
+
+                    const Face& face = data->faces[node.first + i];
+                    data->packs.back().set(i % TriangleVertexPack8::numShapes, data->positions[face[0]], data->positions[face[1]], data->positions[face[2]]);
+                }
+            }
+
+            m_data = std::move(data);
+        }
+
+        [[nodiscard]] const Point3f& position(int vertexNo) const
+        {
+            return m_data->positions[vertexNo];
+        }
+
+        [[nodiscard]] const Normal3f& normal(int vertexNo) const
+        {
+            return m_data->normals[vertexNo];
+        }
+
+        [[nodiscard]] const TexCoords& uv(int vertexNo) const
+        {
+            return m_data->uvs[vertexNo];
+        }
+
+        [[nodiscard]] const Face& face(int faceNo) const
+        {
+            return m_data->faces[faceNo];
+        }
+
+        [[nodiscard]] const Node& node(int nodeNo) const
+        {
+            return m_data->nodes[nodeNo];
+        }
+
+        [[nodiscard]] const TriangleVertexPack8& pack(int packNo) const
+        {
+            return m_data->packs[packNo];
+        }
+
+        [[nodiscard]] int numVertices() const
+        {
+            return static_cast<int>(m_data->positions.size());
+        }
+
+        [[nodiscard]] int numFaces() const
+        {
+            return static_cast<int>(m_data->faces.size());
+        }
+
+        [[nodiscard]] int numNodes() const
+        {
+            return static_cast<int>(m_data->nodes.size());
+        }
+
+        // only used when calculating uv, not in raycast
+        [[nodiscard]] BarycentricCoords barycentric(const Face& face, const Point3f& p) const
+        {
+            const Point3f v0 = position(face[0]);
+            const Vec3f v0p = p - v0;
+            const Vec3f e01 = position(face[1]) - v0;
+            const Vec3f e02 = position(face[2]) - v0;
+            const float d00 = dot(e01, e01);
+            const float d01 = dot(e01, e02);
+            const float d11 = dot(e02, e02);
+            const float d20 = dot(v0p, e01);
+            const float d21 = dot(v0p, e02);
+            const float invDet = 1.0f / (d00 * d11 - d01 * d01);
+            const float v = (d11 * d20 - d01 * d21) * invDet;
+            const float w = (d00 * d21 - d01 * d20) * invDet;
+            const float u = 1.0f - v - w;
+            return { u, v, w };
+        }
+
+        [[nodiscard]] Box3 aabb() const
+        {
+            return numNodes() > 0 ? node(0).bounds : Box3{};
+        }
+
+        [[nodiscard]] Point3f center() const
+        {
+            return aabb().center();
+        }
+
+    private:
+        struct Data
+        {
+            std::vector<Point3f> positions;
+            std::vector<Normal3f> normals;
+            std::vector<TexCoords> uvs;
+            std::vector<Face> faces; // in leaf order
+            std::vector<Node> nodes;
+            std::vector<TriangleVertexPack8> packs; // positions of the faces of each leaf
+        };
+
+        struct FaceBounds
+        {
+            Box3 box;
+            Point3f center;
+        };
+
+        struct Bin
+        {
+            Box3 box;
+            int count = 0;
+        };
+
+        std::shared_ptr<const Data> m_data;
+
+        [[nodiscard]] static float component(const Point3f& p, int axis)
+        {
+            return axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+        }
+
+        [[nodiscard]] static float component(const Vec3f& v, int axis)
+        {
+            return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+        }
+
+        static void add(Bin& bin, const Box3& box, int count)
+        {
+            if (bin.count == 0)
+            {
+                bin.box = box;
+            }
+            else
+            {
+                bin.box.extend(box);
+            }
+            bin.count += count;
+        }
+
+        // Binned sah split on the longest axis of the face centers.
+        // Falls back to a median split when the sah doesn't separate the faces.
+        static void build(Data& data, const std::vector<FaceBounds>& bounds, std::vector<int>& order, int begin, int end, int depth)
+        {
+            const int nodeNo = static_cast<int>(data.nodes.size());
+            data.nodes.emplace_back();
+
+            Box3 box = bounds[order[begin]].box;
+            Box3 centers(bounds[order[begin]].center, bounds[order[begin]].center);
+            for (int i = begin; i < end; ++i)
+            {
+                box.extend(bounds[order[i]].box);
+                centers.extend(bounds[order[i]].center);
+            }
+            data.nodes[nodeNo].bounds = box;
+
+            const int numFaces = end - begin;
+            if (numFaces <= maxFacesPerLeaf || depth >= maxDepth - 2)
+            {
+                data.nodes[nodeNo].first = begin;
+                data.nodes[nodeNo].numFaces = numFaces;
+                return;
+            }
+
+            const Vec3f extent = centers.extent();
+            const int axis =
+                extent.x >= extent.y && extent.x >= extent.z ? 0
+                : extent.y >= extent.z ? 1
+                : 2;
+            const float axisMin = component(centers.min, axis);
+            const float axisExtent = component(extent, axis);
+
+            const auto first = order.begin() + begin;
+            const auto last = order.begin() + end;
+            auto mid = first;
+            if (axisExtent > 0.0f)
+            {
+                const float binScale = numSahBins / axisExtent;
+                auto binOf = [&](int faceNo) {
+                    const int binNo = static_cast<int>((component(bounds[faceNo].center, axis) - axisMin) * binScale);
+                    return std::min(binNo, numSahBins - 1);
+                };
+
+                std::array<Bin, numSahBins> bins;
+                for (auto it = first; it != last; ++it)
+                {
+                    add(bins[binOf(*it)], bounds[*it].box, 1);
+                }
+
+                // cost of splitting after bin i is the area times the count of both sides
+                std::array<float, numSahBins - 1> costs;
+                Bin left;
+                for (int i = 0; i < numSahBins - 1; ++i)
+                {
+                    if (bins[i].count > 0) add(left, bins[i].box, bins[i].count);
+                    costs[i] = left.count > 0 ? left.box.surfaceArea() * left.count : 0.0f;
+                }
+                Bin right;
+                for (int i = numSahBins - 1; i > 0; --i)
+                {
+                    if (bins[i].count > 0) add(right, bins[i].box, bins[i].count);
+                    costs[i - 1] += right.count > 0 ? right.box.surfaceArea() * right.count : 0.0f;
+                }
+
+                const int bestSplit = static_cast<int>(std::min_element(costs.begin(), costs.end()) - costs.begin());
+                mid = std::partition(first, last, [&](int faceNo) {
+                    return binOf(faceNo) <= bestSplit;
+                });
+            }
+
+            if (mid == first || mid == last)
+            {
+                mid = first + numFaces / 2;
+                std::nth_element(first, mid, last, [&bounds, axis](int lhs, int rhs) {
+                    return component(bounds[lhs].center, axis) < component(bounds[rhs].center, axis);
+                });
+            }
+
+            const int midNo = static_cast<int>(mid - order.begin());
+            build(data, bounds, order, begin, midNo, depth + 1);
+            const int secondChild = static_cast<int>(data.nodes.size());
+            build(data, bounds, order, midNo, end, depth + 1);
+            data.nodes[nodeNo].first = secondChild;
+            data.nodes[nodeNo].numFaces = 0;
+        }
+    };
+}
@@ -5,16 +5,22 @@
 namespace ray
 {
     struct Box3;
+    struct Box3Pack4;
     struct Plane;
     struct Sphere;
+    struct SpherePack4;
     struct Triangle3;
+    struct Triangle3Pack4;
     struct Disc3;
     struct Capsule;
     struct Cylinder;
     struct OrientedBox3;
     struct ClosedTriangleMeshFace;
+    struct IndexedTriangleMesh;
     template <typename TransformT, typename ShapeT>
     struct TransformedShape3;
+    template <typename ShapeT>
+    struct SharedShape;
     template <typename ClippingShapeT>
     struct ClippedSdf;
 
@@ -24,7 +30,7 @@ namespace ray
     template <>
     struct ShapeTraits<Box3>
     {
-        using ShapePackType = Box3;
+        using ShapePackType = Box3Pack4;
         using BaseShapeType = Box3; // for a pack it should be an underlying shape
         static constexpr int numShapes = 1; // >1 means that it's a pack (and should behave like a pack of BaseShapeType)
         static constexpr int numSurfaceMaterialsPerShape = 1;
@@ -34,6 +40,19 @@ namespace ray
         static constexpr bool isBounded = true;
     };
 
+    template <>
+    struct ShapeTraits<Box3Pack4>
+    {
+        using ShapePackType = Box3Pack4;
+        using BaseShapeType = Box3; // for a pack it should be an underlying shape
+        static constexpr int numShapes = 4; // >1 means that it's a pack (and should behave like a pack of BaseShapeType)
+        static constexpr int numSurfaceMaterialsPerShape = 1;
+        static constexpr int numMediumMaterialsPerShape = 1;
+        static constexpr bool hasVolume = true;
+        static constexpr bool isLocallyContinuable = true;
+        static constexpr bool isBounded = true;
+    };
+
     template <>
     struct ShapeTraits<Plane>
     {
@@ -50,7 +69,7 @@ namespace ray
     template <>
     struct ShapeTraits<Sphere>
     {
-        using ShapePackType = Sphere;
+        using ShapePackType = SpherePack4;
         using BaseShapeType = Sphere; // for a pack it should be an underlying shape
         static constexpr int numShapes = 1; // >1 means that it's a pack (and should behave like a pack of BaseShapeType)
         static constexpr int numSurfaceMaterialsPerShape = 1;
@@ -60,6 +79,19 @@ namespace ray
         static constexpr bool isBounded = true;
     };
 
+    template <>
+    struct ShapeTraits<SpherePack4>
+    {
+        using ShapePackType = SpherePack4;
+        using BaseShapeType = Sphere; // for a pack it should be an underlying shape
+        static constexpr int numShapes = 4; // >1 means that it's a pack (and should behave like a pack of BaseShapeType)
+        static constexpr int numSurfaceMaterialsPerShape = 1;
+        static constexpr int numMediumMaterialsPerShape = 1;
+        static constexpr bool hasVolume = true;
+        static constexpr bool isLocallyContinuable = true;
+        static constexpr bool isBounded = true;
+    };
+
     template <>
     struct ShapeTraits<Cylinder>
     {
@@ -102,7 +134,7 @@ namespace ray
     template <>
     struct ShapeTraits<Triangle3>
     {
-        using ShapePackType = Triangle3;
+        using ShapePackType = Triangle3Pack4;
         using BaseShapeType = Triangle3; // for a pack it should be an underlying shape
         static constexpr int numShapes = 1; // >1 means that it's a pack (and should behave like a pack of BaseShapeType)
         static constexpr int numSurfaceMaterialsPerShape = 1;
@@ -112,6 +144,19 @@ namespace ray
         static constexpr bool isBounded = true;
     };
 
+    template <>
+    struct ShapeTraits<Triangle3Pack4>
+    {
+        using ShapePackType = Triangle3Pack4;
+        using BaseShapeType = Triangle3; // for a pack it should be an underlying shape
+        static constexpr int numShapes = 4; // >1 means that it's a pack (and should behave like a pack of BaseShapeType)
+        static constexpr int numSurfaceMaterialsPerShape = 1;
+        static constexpr int numMediumMaterialsPerShape = 0;
+        static constexpr bool hasVolume = false;
+        static constexpr bool isLocallyContinuable = false;
+        static constexpr bool isBounded = true;
+    };
+
     template <typename TransformT, typename ShapeT>
     struct ShapeTraits<TransformedShape3<TransformT, ShapeT>>
     {
@@ -125,6 +170,21 @@ namespace ray
         static constexpr bool isBounded = ShapeTraits<ShapeT>::isBounded;
     };
 
+    template <typename ShapeT>
+    struct ShapeTraits<SharedShape<ShapeT>>
+    {
+        static_assert(ShapeTraits<ShapeT>::numShapes == 1, "Packs can't be shared.");
+
+        using ShapePackType = SharedShape<ShapeT>;
+        using BaseShapeType = SharedShape<ShapeT>; // for a pack it should be an underlying shape
+        static constexpr int numShapes = 1; // >1 means that it's a pack (and should behave like a pack of BaseShapeType)
+        static constexpr int numSurfaceMaterialsPerShape = ShapeTraits<ShapeT>::numSurfaceMaterialsPerShape;
+        static constexpr int numMediumMaterialsPerShape = ShapeTraits<ShapeT>::numMediumMaterialsPerShape;
+        static constexpr bool hasVolume = ShapeTraits<ShapeT>::hasVolume;
+        static constexpr bool isLocallyContinuable = ShapeTraits<ShapeT>::isLocallyContinuable;
+        static constexpr bool isBounded = ShapeTraits<ShapeT>::isBounded;
+    };
+
     template <>
     struct ShapeTraits<Disc3>
     {
@@ -154,6 +214,20 @@ namespace ray
         static constexpr bool isBounded = true;
     };
 
+    template <>
+    struct ShapeTraits<IndexedTriangleMesh>
+    {
+        using ShapePackType = IndexedTriangleMesh;
+        using BaseShapeType = IndexedTriangleMesh; // for a pack it should be an underlying shape
+        static constexpr int numShapes = 1; // >1 means that it's a pack (and should behave like a pack of BaseShapeType)
+        static constexpr int numSurfaceMaterialsPerShape = 1;
+        static constexpr int numMediumMaterialsPerShape = 1;
+        static constexpr bool hasVolume = true;
+        // the whole mesh is one object so the exit can be found without the scene
+        static constexpr bool isLocallyContinuable = true;
+        static constexpr bool isBounded = true;
+    };
+
     template <typename ClippingShapeT>
     struct ShapeTraits<ClippedSdf<ClippingShapeT>>
     {
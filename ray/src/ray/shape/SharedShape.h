@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+namespace ray
+{
+    // Shape that is stored once and referenced by all copies.
+    // Meant for instancing heavy immutable shapes, like sdf expressions,
+    // with TransformedShape3 - then each instance only holds a transformation and a pointer.
+    // Shapes that already share their data on copy, like IndexedTriangleMesh, don't need this.
+    template <typename ShapeT>
+    struct SharedShape
+    {
+        using ShapeType = ShapeT;
+
+        explicit SharedShape(std::shared_ptr<const ShapeT> shape) :
+            m_shape(std::move(shape))
+        {
+        }
+
+        explicit SharedShape(const ShapeT& shape) :
+            m_shape(std::make_shared<const ShapeT>(shape))
+        {
+        }
+
+        [[nodiscard]] const ShapeT& shape() const
+        {
+            return *m_shape;
+        }
+
+        [[nodiscard]] decltype(auto) center() const
+        {
+            return m_shape->center();
+        }
+
+    private:
+        std::shared_ptr<const ShapeT> m_shape;
+    };
+}
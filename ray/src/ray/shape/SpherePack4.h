@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Sphere.h"
+
+#include <ray/math/Float4.h>
+#include <ray/math/Vec3.h>
+#include <ray/math/Vec3x4.h>
+
+#include <limits>
+
+namespace ray
+{
+    // Four spheres in SoA layout.
+    // Unused lanes have NaN radius so every comparison in raycast fails for them.
+    struct SpherePack4
+    {
+        static constexpr int numShapes = 4;
+
+        Vec3x4<float> center;
+        Float4 radius;
+
+        SpherePack4() noexcept :
+            center{},
+            radius(Float4::broadcast(std::numeric_limits<float>::quiet_NaN()))
+        {
+        }
+
+        void set(int i, const Sphere& sphere)
+        {
+            center.insert(sphere.center().asVector(), i);
+            radius.insert(sphere.radius(), i);
+        }
+
+        [[nodiscard]] Sphere get(int i) const
+        {
+            return Sphere(
+                Point3f(center.x.v[i], center.y.v[i], center.z.v[i]),
+                radius.v[i]
+            );
+        }
+    };
+}
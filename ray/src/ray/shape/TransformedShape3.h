@@ -1,5 +1,8 @@
 #pragma once
 
+#include <ray/math/Transform3.h>
+#include <ray/math/Vec3.h>
+
 #include <type_traits>
 
 namespace ray
@@ -7,28 +10,99 @@ namespace ray
     template <typename T>
     struct Matrix4;
 
+    namespace detail
+    {
+        // Transforms normals from the local space of a TransformedShape3 to the world space.
+        // If the transformation scales then the normal matrix is the transposed linear part of worldToLocal
+        // and it is precomputed, so that hits don't have to invert anything.
+        // Otherwise normals transform like directions and nothing has to be stored.
+        template <typename TransformT, bool HasScaleV = contains(TransformT::mask, AffineTransformationComponentMask::Scale)>
+        struct TransformedShape3Normals
+        {
+            explicit TransformedShape3Normals(const TransformT& worldToLocal) :
+                m_normalToWorld(worldToLocal.withoutTranslation().transposed())
+            {
+            }
+
+            template <typename InverseTransformT>
+            [[nodiscard]] Normal3f normalToWorld(const Normal3f& normal, const InverseTransformT&) const
+            {
+                return Normal3f((m_normalToWorld * Vec3f(normal)).normalized());
+            }
+
+        private:
+            decltype(std::declval<TransformT>().withoutTranslation().transposed()) m_normalToWorld;
+        };
+
+        template <typename TransformT>
+        struct TransformedShape3Normals<TransformT, false>
+        {
+            explicit TransformedShape3Normals(const TransformT&)
+            {
+            }
+
+            template <typename InverseTransformT>
+            [[nodiscard]] Normal3f normalToWorld(const Normal3f& normal, const InverseTransformT& localToWorld) const
+            {
+                return localToWorld * normal;
+            }
+        };
+    }
+
+    // The inverse transformation is cached, so it has to be immutable.
     template <typename TransformT, typename ShapeT>
-    struct TransformedShape3
+    struct TransformedShape3 : private detail::TransformedShape3Normals<TransformT>
     {
-        TransformT worldToLocal;
-        ShapeT shape;
+        using TransformType = TransformT;
+        using InverseTransformType = decltype(std::declval<TransformT>().inverse());
+        using ShapeType = ShapeT;
+
+        // Rigid transformations preserve distances, so rays don't have to be renormalized.
+        static constexpr bool isRigid = !contains(TransformT::mask, AffineTransformationComponentMask::Scale);
 
         TransformedShape3(const TransformT& worldToLocal, const ShapeT& shape) :
-            worldToLocal(worldToLocal),
-            shape(shape)
+            detail::TransformedShape3Normals<TransformT>(worldToLocal),
+            m_worldToLocal(worldToLocal),
+            m_localToWorld(worldToLocal.inverse()),
+            m_shape(shape)
+        {
+        }
+
+        [[nodiscard]] const TransformT& worldToLocal() const
+        {
+            return m_worldToLocal;
+        }
+
+        [[nodiscard]] const InverseTransformType& localToWorld() const
+        {
+            return m_localToWorld;
+        }
+
+        [[nodiscard]] Normal3f normalToWorld(const Normal3f& normal) const
+        {
+            return detail::TransformedShape3Normals<TransformT>::normalToWorld(normal, m_localToWorld);
+        }
+
+        [[nodiscard]] const ShapeT& shape() const
         {
+            return m_shape;
         }
 
         [[nodiscard]] decltype(auto) center() const
         {
-            return worldToLocal.inverse() * shape.center();
+            return m_localToWorld * m_shape.center();
         }
+
+    private:
+        TransformT m_worldToLocal;
+        InverseTransformType m_localToWorld;
+        ShapeT m_shape;
     };
 
     template <typename TransformLhsT, typename TransformRhsT, typename ShapeT>
     auto operator*(const TransformLhsT& lhs, const TransformedShape3<TransformRhsT, ShapeT>& rhs)
     {
-        return TransformedShape3<decltype(std::declval<TransformLhsT>() * std::declval<TransformRhsT>()), ShapeT>(lhs * rhs.worldToLocal, rhs.shape);
+        return TransformedShape3<decltype(std::declval<TransformLhsT>() * std::declval<TransformRhsT>()), ShapeT>(lhs * rhs.worldToLocal(), rhs.shape());
     }
 
     template <typename TransformLhsT, typename ShapeT, typename SFINAE = std::enable_if_t<std::is_base_of_v<Matrix4<float>, TransformLhsT>>>
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Triangle3.h"
+
+#include <ray/material/TexCoords.h>
+
+#include <ray/math/Vec3.h>
+#include <ray/math/Vec3x4.h>
+
+#include <array>
+
+namespace ray
+{
+    // Four triangles. Data needed for the intersection test is in SoA layout,
+    // normals and uvs are only needed for the nearest hit so they are kept per triangle.
+    // Unused lanes are degenerate (all zero) and are rejected by the determinant test.
+    struct Triangle3Pack4
+    {
+        static constexpr int numShapes = 4;
+
+        Vec3x4<float> v0;
+        Vec3x4<float> e01;
+        Vec3x4<float> e02;
+        std::array<std::array<Normal3f, 3>, 4> normals;
+        std::array<std::array<TexCoords, 3>, 4> uvs;
+
+        Triangle3Pack4() noexcept :
+            v0{},
+            e01{},
+            e02{},
+            normals{},
+            uvs{}
+        {
+        }
+
+        void set(int i, const Triangle3& tri)
+        {
+            v0.insert(tri.v0().asVector(), i);
+            e01.insert(tri.e01(), i);
+            e02.insert(tri.e02(), i);
+            normals[i] = { tri.normal(0), tri.normal(1), tri.normal(2) };
+            uvs[i] = { tri.uv(0), tri.uv(1), tri.uv(2) };
+        }
+
+        [[nodiscard]] Triangle3 get(int i) const
+        {
+            const Point3f p0(v0.x.v[i], v0.y.v[i], v0.z.v[i]);
+            const Vec3f d01(e01.x.v[i], e01.y.v[i], e01.z.v[i]);
+            const Vec3f d02(e02.x.v[i], e02.y.v[i], e02.z.v[i]);
+            return Triangle3(
+                p0, p0 + d01, p0 + d02,
+                normals[i][0], normals[i][1], normals[i][2],
+                uvs[i][0], uvs[i][1], uvs[i][2]
+            );
+        }
+    };
+}
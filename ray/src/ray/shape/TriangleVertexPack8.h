@@ -0,0 +1,34 @@
+#pragma once
+
+#include <ray/math/Vec3.h>
+
+namespace ray
+{
+    // Vertex positions of up to eight triangles in SoA layout, for the 8-wide watertight raycast.
+    // Vertices are stored as they are and not as edges, so that triangles sharing an edge
+    // compute exactly the same values for it.
+    // Coordinates are indexed by [vertex][axis][triangle] because the raycast permutes the axes per ray.
+    // Unused lanes are zero.
+    struct alignas(32) TriangleVertexPack8
+    {
+        static constexpr int numShapes = 8;
+
+        float coords[3][3][numShapes];
+
+        TriangleVertexPack8() noexcept :
+            coords{}
+        {
+        }
+
+        void set(int i, const Point3f& v0, const Point3f& v1, const Point3f& v2)
+        {
+            const Point3f vertices[3] = { v0, v1, v2 };
+            for (int v = 0; v < 3; ++v)
+            {
+                coords[v][0][i] = vertices[v].x;
+                coords[v][1][i] = vertices[v].y;
+                coords[v][2][i] = vertices[v].z;
+            }
+        }
+    };
+}
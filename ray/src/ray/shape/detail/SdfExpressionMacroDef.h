@@ -8,7 +8,7 @@
     template <bool IsPolyV> \
     struct TypeName##Impl : PolySdfExpression<TypeName##Impl <IsPolyV>, std::tuple<__VA_ARGS__>> \
     { \
-        using BaseType = PolySdfExpression<TypeName##Impl, std::tuple<__VA_ARGS__>>; \
+        using BaseType = PolySdfExpression<TypeName##Impl <IsPolyV>, std::tuple<__VA_ARGS__>>; \
         using BaseType::BaseType; \
         using BaseType::parts; \
         [[nodiscard]] float signedDistance(const Point3f& p) const override {return TypeName##ImplEval (*this, p);} \
@@ -21,7 +21,7 @@
     template <> \
     struct TypeName##Impl<false> : SdfExpression<TypeName##Impl <false>, std::tuple<__VA_ARGS__>> \
     { \
-        using BaseType = SdfExpression<TypeName##Impl, std::tuple<__VA_ARGS__>>; \
+        using BaseType = SdfExpression<TypeName##Impl <false>, std::tuple<__VA_ARGS__>>; \
         using BaseType::BaseType; \
         using BaseType::parts; \
         [[nodiscard]] float signedDistance(const Point3f& p) const {return TypeName##ImplEval (*this, p);} \
@@ -41,9 +41,9 @@
     template <typename T> \
     [[nodiscard]] float TypeName##ImplEval (T&& self, const Point3f& p); \
     template <typename LhsExprT> \
-    struct Poly##TypeName : PolySdfExpression<Poly##TypeName <LhsExprT>, std::tuple<LhsExprT, __VA_ARGS__>> \
+    struct Poly##TypeName : PolySdfExpression<Poly##TypeName <LhsExprT>, std::tuple<LhsExprT, ##__VA_ARGS__>> \
     { \
-        using BaseType = PolySdfExpression<Poly##TypeName, std::tuple<LhsExprT, __VA_ARGS__>>; \
+        using BaseType = PolySdfExpression<Poly##TypeName, std::tuple<LhsExprT, ##__VA_ARGS__>>; \
         using BaseType::BaseType; \
         using BaseType::parts; \
         [[nodiscard]] float signedDistance(const Point3f& p) const override {return TypeName##ImplEval (*this, p);} \
@@ -58,9 +58,9 @@
         } \
     }; \
     template <typename LhsExprT> \
-    struct TypeName : SdfExpression<TypeName <LhsExprT>, std::tuple<LhsExprT, __VA_ARGS__>> \
+    struct TypeName : SdfExpression<TypeName <LhsExprT>, std::tuple<LhsExprT, ##__VA_ARGS__>> \
     { \
-        using BaseType = SdfExpression<TypeName, std::tuple<LhsExprT, __VA_ARGS__>>; \
+        using BaseType = SdfExpression<TypeName, std::tuple<LhsExprT, ##__VA_ARGS__>>; \
         using BaseType::BaseType; \
         using BaseType::parts; \
         [[nodiscard]] float signedDistance(const Point3f& p) const {return TypeName##ImplEval (*this, p);} \
@@ -75,13 +75,13 @@
         } \
     }; \
     template <typename LhsExprT> \
-    TypeName(LhsExprT, __VA_ARGS__)->TypeName <LhsExprT>; \
+    TypeName(LhsExprT, ##__VA_ARGS__)->TypeName <LhsExprT>; \
     template <typename LhsExprT> \
-    TypeName(std::unique_ptr<LhsExprT>, __VA_ARGS__)->TypeName <CloneableUniquePtr<SdfBase>>; \
+    TypeName(std::unique_ptr<LhsExprT>, ##__VA_ARGS__)->TypeName <CloneableUniquePtr<SdfBase>>; \
     template <typename LhsExprT> \
-    Poly##TypeName(LhsExprT, __VA_ARGS__)->Poly##TypeName <LhsExprT>; \
+    Poly##TypeName(LhsExprT, ##__VA_ARGS__)->Poly##TypeName <LhsExprT>; \
     template <typename LhsExprT> \
-    Poly##TypeName(std::unique_ptr<LhsExprT>, __VA_ARGS__)->Poly##TypeName <CloneableUniquePtr<SdfBase>>; \
+    Poly##TypeName(std::unique_ptr<LhsExprT>, ##__VA_ARGS__)->Poly##TypeName <CloneableUniquePtr<SdfBase>>; \
     template <typename T> \
     [[nodiscard]] float TypeName##ImplEval (T&& self, const Point3f& p) \
     {
@@ -90,9 +90,9 @@
     template <typename T> \
     [[nodiscard]] float TypeName##ImplEval (T&& self, const Point3f& p); \
     template <typename LhsExprT, typename RhsExprT> \
-    struct Poly##TypeName : PolySdfExpression<Poly##TypeName <LhsExprT, RhsExprT>, std::tuple<LhsExprT, RhsExprT, __VA_ARGS__>> \
+    struct Poly##TypeName : PolySdfExpression<Poly##TypeName <LhsExprT, RhsExprT>, std::tuple<LhsExprT, RhsExprT, ##__VA_ARGS__>> \
     { \
-        using BaseType = PolySdfExpression<Poly##TypeName, std::tuple<LhsExprT, RhsExprT, __VA_ARGS__>>; \
+        using BaseType = PolySdfExpression<Poly##TypeName, std::tuple<LhsExprT, RhsExprT, ##__VA_ARGS__>>; \
         using BaseType::BaseType; \
         using BaseType::parts; \
         [[nodiscard]] float signedDistance(const Point3f& p) const override {return TypeName##ImplEval (*this, p);} \
@@ -111,9 +111,9 @@
         } \
     }; \
     template <typename LhsExprT, typename RhsExprT> \
-    struct TypeName : SdfExpression<TypeName <LhsExprT, RhsExprT>, std::tuple<LhsExprT, RhsExprT, __VA_ARGS__>> \
+    struct TypeName : SdfExpression<TypeName <LhsExprT, RhsExprT>, std::tuple<LhsExprT, RhsExprT, ##__VA_ARGS__>> \
     { \
-        using BaseType = SdfExpression<TypeName, std::tuple<LhsExprT, RhsExprT, __VA_ARGS__>>; \
+        using BaseType = SdfExpression<TypeName, std::tuple<LhsExprT, RhsExprT, ##__VA_ARGS__>>; \
         using BaseType::BaseType; \
         using BaseType::parts; \
         [[nodiscard]] float signedDistance(const Point3f& p) const {return TypeName##ImplEval (*this, p);} \
@@ -132,13 +132,13 @@
         } \
     }; \
     template <typename LhsExprT, typename RhsExprT> \
-    Poly##TypeName(LhsExprT, RhsExprT, __VA_ARGS__)->Poly##TypeName<LhsExprT, RhsExprT>; \
+    Poly##TypeName(LhsExprT, RhsExprT, ##__VA_ARGS__)->Poly##TypeName<LhsExprT, RhsExprT>; \
     template <typename LhsExprT, typename RhsExprT> \
-    Poly##TypeName(std::unique_ptr<LhsExprT>, std::unique_ptr<RhsExprT>, __VA_ARGS__)->Poly##TypeName<CloneableUniquePtr<SdfBase>, CloneableUniquePtr<SdfBase>>; \
+    Poly##TypeName(std::unique_ptr<LhsExprT>, std::unique_ptr<RhsExprT>, ##__VA_ARGS__)->Poly##TypeName<CloneableUniquePtr<SdfBase>, CloneableUniquePtr<SdfBase>>; \
     template <typename LhsExprT, typename RhsExprT> \
-    TypeName(LhsExprT, RhsExprT, __VA_ARGS__)->TypeName<LhsExprT, RhsExprT>; \
+    TypeName(LhsExprT, RhsExprT, ##__VA_ARGS__)->TypeName<LhsExprT, RhsExprT>; \
     template <typename LhsExprT, typename RhsExprT> \
-    TypeName(std::unique_ptr<LhsExprT>, std::unique_ptr<RhsExprT>, __VA_ARGS__)->TypeName<CloneableUniquePtr<SdfBase>, CloneableUniquePtr<SdfBase>>; \
+    TypeName(std::unique_ptr<LhsExprT>, std::unique_ptr<RhsExprT>, ##__VA_ARGS__)->TypeName<CloneableUniquePtr<SdfBase>, CloneableUniquePtr<SdfBase>>; \
     template <typename T> \
     [[nodiscard]] float TypeName##ImplEval (T&& self, const Point3f& p) \
     {
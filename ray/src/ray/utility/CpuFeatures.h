@@ -0,0 +1,86 @@
+#pragma once
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+#include <cstdint>
+
+namespace ray
+{
+    // Instruction sets detected at runtime, so that code using them
+    // can be compiled in without requiring them from every cpu.
+    struct CpuFeatures
+    {
+        bool hasAvx2;
+
+        [[nodiscard]] static const CpuFeatures& get()
+        {
+            static const CpuFeatures features = detect();
+            return features;
+        }
+
+    private:
+        [[nodiscard]] static CpuFeatures detect() noexcept
+        {
+#if defined(_MSC_VER) || defined(__GNUC__)
+            unsigned regs[4];
+            cpuid(0, regs);
+            const unsigned maxLeaf = regs[0];
+
+            cpuid(1, regs);
+            const bool hasOsxsave = (regs[2] & (1u << 27)) != 0;
+            const bool hasAvx = (regs[2] & (1u << 28)) != 0;
+            // the os also has to save the ymm registers on context switches
+            const bool isYmmEnabled = hasOsxsave && hasAvx && (xgetbv0() & 0b110) == 0b110;
+
+            bool hasAvx2 = false;
+            if (isYmmEnabled && maxLeaf >= 7)
+            {
+                cpuid(7, regs);
+                hasAvx2 = (regs[1] & (1u << 5)) != 0;
+            }
+            return { hasAvx2 };
+#else
+            return { false };
+#endif
+        }
+
+#if defined(_MSC_VER)
+        // eax, ebx, ecx, edx of the leaf, with subleaf 0
+        static void cpuid(unsigned leaf, unsigned (&regs)[4]) noexcept
+        {
+            int r[4];
+            __cpuidex(r, static_cast<int>(leaf), 0);
+            for (int i = 0; i < 4; ++i)
+            {
+                regs[i] = static_cast<unsigned>(r[i]);
+            }
+        }
+
+        // Only valid when the cpu reports osxsave.
+        [[nodiscard]] static std::uint64_t xgetbv0() noexcept
+        {
+            return _xgetbv(0);
+        }
+#elif defined(__GNUC__)
+        // eax, ebx, ecx, edx of the leaf, with subleaf 0
+        static void cpuid(unsigned leaf, unsigned (&regs)[4]) noexcept
+        {
+            __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+        }
+
+        // Only valid when the cpu reports osxsave.
+        // Inline asm because the _xgetbv intrinsic requires compiling with -mxsave.
+        [[nodiscard]] static std::uint64_t xgetbv0() noexcept
+        {
+            std::uint32_t eax;
+            std::uint32_t edx;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (static_cast<std::uint64_t>(edx) << 32) | eax;
+        }
+#endif
+    };
+}
@@ -116,7 +116,7 @@ namespace ray
 
         [[nodiscard]] value_type operator[](difference_type n) const
         {
-            return m_coords + n;
+            return *(*this + n);
         }
         [[nodiscard]] value_type operator*() const
         {
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ray
+{
+    // Counts tasks that were started with ThreadPool::run and not yet finished.
+    struct ThreadPoolTaskGroup
+    {
+        ThreadPoolTaskGroup() noexcept :
+            m_numPending(0)
+        {
+        }
+
+        ThreadPoolTaskGroup(const ThreadPoolTaskGroup&) = delete;
+        ThreadPoolTaskGroup& operator=(const ThreadPoolTaskGroup&) = delete;
+
+        [[nodiscard]] bool done() const
+        {
+            return m_numPending.load(std::memory_order_acquire) == 0;
+        }
+
+    private:
+        friend struct ThreadPool;
+
+        std::atomic<int> m_numPending;
+    };
+
+    // Work stealing thread pool.
+    // Each worker has its own deque, it takes the newest tasks from it's own deque
+    // and steals the oldest ones from others when it runs out of work.
+    // Tasks may spawn other tasks and wait for them, waiting threads execute pending tasks
+    // in the meantime so nested fork-join parallelism doesn't deadlock.
+    struct ThreadPool
+    {
+        explicit ThreadPool(int numThreads = static_cast<int>(std::thread::hardware_concurrency())) :
+            m_numQueued(0),
+            m_stop(false)
+        {
+            numThreads = std::max(numThreads, 1);
+
+            // The last queue is shared by threads from outside of the pool.
+            for (int i = 0; i <= numThreads; ++i)
+            {
+                m_queues.emplace_back(std::make_unique<TaskQueue>());
+            }
+
+            for (int i = 0; i < numThreads; ++i)
+            {
+                m_threads.emplace_back([this, i]() { workerLoop(i); });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ThreadPool& operator=(ThreadPool&&) = delete;
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_sleepMutex);
+                m_stop = true;
+            }
+            m_wakeUp.notify_all();
+
+            for (auto& thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+        [[nodiscard]] int numThreads() const
+        {
+            return static_cast<int>(m_threads.size());
+        }
+
+        template <typename FuncT>
+        void run(ThreadPoolTaskGroup& group, FuncT&& func)
+        {
+            group.m_numPending.fetch_add(1, std::memory_order_relaxed);
+
+            // Counted before the task is visible so the thread that takes it can't make the count negative.
+            m_numQueued.fetch_add(1, std::memory_order_release);
+
+            TaskQueue& queue = *m_queues[currentQueueIndex()];
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.emplace_back(Task{ std::function<void()>(std::forward<FuncT>(func)), &group });
+            }
+
+            {
+                // Prevents a lost wake up between the check and the wait of a worker.
+                std::lock_guard<std::mutex> lock(m_sleepMutex);
+            }
+            m_wakeUp.notify_one();
+        }
+
+        // Executes other tasks while waiting.
+        // Sleeps when there is nothing to run until either new tasks are queued or the group is done.
+        void wait(ThreadPoolTaskGroup& group)
+        {
+            const int self = currentQueueIndex();
+            while (!group.done())
+            {
+                if (tryRunOne(self)) continue;
+
+                std::unique_lock<std::mutex> lock(m_sleepMutex);
+                m_wakeUp.wait(lock, [this, &group]() {
+                    return group.done() || m_numQueued.load(std::memory_order_acquire) > 0;
+                });
+            }
+        }
+
+        // Calls func(i) for each i in [begin, end) and waits for completion.
+        // The range is split into at most `numChunks` contiguous chunks.
+        template <typename FuncT>
+        void parallelFor(int begin, int end, int numChunks, FuncT&& func)
+        {
+            const int size = end - begin;
+            if (size <= 0) return;
+
+            numChunks = std::clamp(numChunks, 1, size);
+            ThreadPoolTaskGroup group;
+            for (int c = 0; c < numChunks; ++c)
+            {
+                const int chunkBegin = begin + static_cast<int>(static_cast<long long>(size) * c / numChunks);
+                const int chunkEnd = begin + static_cast<int>(static_cast<long long>(size) * (c + 1) / numChunks);
+                run(group, [&func, chunkBegin, chunkEnd]() {
+                    for (int i = chunkBegin; i < chunkEnd; ++i)
+                    {
+                        func(i);
+                    }
+                });
+            }
+            wait(group);
+        }
+
+    private:
+        struct Task
+        {
+            std::function<void()> func;
+            ThreadPoolTaskGroup* group;
+        };
+
+        struct TaskQueue
+        {
+            std::deque<Task> tasks;
+            std::mutex mutex;
+        };
+
+        std::vector<std::unique_ptr<TaskQueue>> m_queues;
+        std::vector<std::thread> m_threads;
+        std::atomic<int> m_numQueued;
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wakeUp;
+        bool m_stop;
+
+        [[nodiscard]] static const ThreadPool*& currentPool()
+        {
+            thread_local const ThreadPool* pool = nullptr;
+            return pool;
+        }
+
+        [[nodiscard]] static int& currentWorkerIndex()
+        {
+            thread_local int index = -1;
+            return index;
+        }
+
+        [[nodiscard]] int currentQueueIndex() const
+        {
+            if (currentPool() == this)
+            {
+                return currentWorkerIndex();
+            }
+
+            return static_cast<int>(m_queues.size()) - 1;
+        }
+
+        [[nodiscard]] bool tryPopBack(int queueIndex, Task& task)
+        {
+            TaskQueue& queue = *m_queues[queueIndex];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) return false;
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            return true;
+        }
+
+        [[nodiscard]] bool tryPopFront(int queueIndex, Task& task)
+        {
+            TaskQueue& queue = *m_queues[queueIndex];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) return false;
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+
+        [[nodiscard]] bool tryRunOne(int self)
+        {
+            if (m_numQueued.load(std::memory_order_acquire) == 0) return false;
+
+            Task task;
+            bool found = tryPopBack(self, task);
+
+            const int numQueues = static_cast<int>(m_queues.size());
+            for (int i = 1; i < numQueues && !found; ++i)
+            {
+                found = tryPopFront((self + i) % numQueues, task);
+            }
+
+            if (!found) return false;
+
+            m_numQueued.fetch_sub(1, std::memory_order_relaxed);
+            task.func();
+            if (task.group->m_numPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                // The group may be destroyed by its waiter as soon as it's done, so it's not touched past this point.
+                {
+                    std::lock_guard<std::mutex> lock(m_sleepMutex);
+                }
+                m_wakeUp.notify_all();
+            }
+            return true;
+        }
+
+        void workerLoop(int index)
+        {
+            currentPool() = this;
+            currentWorkerIndex() = index;
+
+            for (;;)
+            {
+                if (tryRunOne(index)) continue;
+
+                std::unique_lock<std::mutex> lock(m_sleepMutex);
+                m_wakeUp.wait(lock, [this]() {
+                    return m_stop || m_numQueued.load(std::memory_order_acquire) > 0;
+                });
+                if (m_stop) return;
+            }
+        }
+    };
+}
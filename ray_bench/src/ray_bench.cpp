@@ -0,0 +1,925 @@
+#if defined(RAY_GATHER_PERF_STATS)
+#include <ray/perf/PerformanceStats.h>
+#endif
+
+#include <ray/material/MaterialDatabase.h>
+#include <ray/material/Patterns.h>
+#include <ray/material/TextureDatabase.h>
+
+#include <ray/math/Angle2.h>
+#include <ray/math/Basis3.h>
+#include <ray/math/Transform3.h>
+#include <ray/math/Vec3.h>
+
+#include <ray/scene/StaticScene.h>
+#include <ray/scene/bvh/StaticBvh.h>
+#include <ray/scene/bvh/StaticBvhObjectMeanPartitioner.h>
+#include <ray/scene/bvh/StaticBvhObjectMedianPartitioner.h>
+#include <ray/scene/bvh/StaticBvhObjectSahPartitioner.h>
+#include <ray/scene/object/RawSceneObjectBlob.h>
+#include <ray/scene/object/SceneObject.h>
+
+#include <ray/sampler/AdaptiveMultisampler.h>
+#include <ray/sampler/JitteredMultisampler.h>
+#include <ray/sampler/QuincunxMultisampler.h>
+#include <ray/sampler/UniformGridMultisampler.h>
+#include <ray/sampler/Sampler.h>
+
+#include <ray/shape/Box3.h>
+#include <ray/shape/Box3Pack4.h>
+#include <ray/shape/Capsule.h>
+#include <ray/shape/ClosedTriangleMesh.h>
+#include <ray/shape/Cylinder.h>
+#include <ray/shape/Disc3.h>
+#include <ray/shape/IndexedTriangleMesh.h>
+#include <ray/shape/Sdf.h>
+#include <ray/shape/Shapes.h>
+#include <ray/shape/Sphere.h>
+#include <ray/shape/TransformedShape3.h>
+
+#include <ray/Camera.h>
+#include <ray/Image.h>
+#include <ray/Raytracer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Headless benchmark of the standard scenes.
+// Every scene is rendered with every partitioner and sampler, results are written as JSON.
+// Wavefront renders compare the orderings of secondary rays.
+// Scene dispatch renders compare virtual scene queries with ones resolved at compile time.
+// Object storage renders compare bvh leaves with vectors to leaves in a single allocation.
+// Light culling renders compare images with and without Options::cullDimLights.
+// With --check-wavefront nothing is benchmarked, instead every scene is rendered with capture
+// and with captureWavefront, and the exit code is 1 if the images differ by more than rounding.
+// Throughput is reported as pixelsPerSecond by every build. Counting rays needs the trace counters,
+// so raysPerSecond, of primary, secondary and shadow rays, is only reported with RAY_GATHER_PERF_STATS.
+// Usage: ray_bench [output.json] [width height]
+//        ray_bench --check-wavefront [width height]
+
+using namespace ray;
+
+using MeshInstance = TransformedShape3<AffineTransformation4f, IndexedTriangleMesh>;
+using BenchShapes = Shapes<Sphere, Disc3, ClosedTriangleMeshFace, IndexedTriangleMesh, MeshInstance, CsgShape, ClippedSdf<Sphere>, Capsule, Cylinder>;
+
+struct BenchMaterials
+{
+    const SurfaceMaterial* floorSurface;
+    const SurfaceMaterial* diffuseSurface;
+    const SurfaceMaterial* glossySurface;
+    const SurfaceMaterial* glassSurface;
+    const SurfaceMaterial* lightSurface;
+    const SurfaceMaterial* dimLightSurface;
+    const MediumMaterial* opaqueMedium;
+    const MediumMaterial* glassMedium;
+    const MediumMaterial* airMedium;
+};
+
+struct BenchScene
+{
+    std::string name;
+    RawSceneObjectBlob<BenchShapes> shapes;
+
+    // mesh faces reference their meshes
+    std::vector<std::unique_ptr<ClosedTriangleMesh>> meshes;
+};
+
+struct BenchSettings
+{
+    int width = 640;
+    int height = 360;
+};
+
+BenchMaterials createMaterials(MaterialDatabase& matDb, TextureDatabase& texDb)
+{
+    const Texture& pattern = texDb.emplace<SquarePattern>("square-pattern", ColorRGBf(0.8f, 0.8f, 0.8f), ColorRGBf(0.6f, 0.6f, 0.6f), 0.25f);
+
+    BenchMaterials materials;
+    materials.floorSurface = &matDb.emplaceSurface("floor", ColorRGBf(0.2f, 0.2f, 0.2f), ColorRGBf(0, 0, 0), 0.0f, 0.3f, 0.4f, &pattern);
+    materials.diffuseSurface = &matDb.emplaceSurface("diffuse", ColorRGBf(1.00f, 0.32f, 0.36f), ColorRGBf(0, 0, 0), 0.5f, 0.4f, 0.0f);
+    materials.glossySurface = &matDb.emplaceSurface("glossy", ColorRGBf(0.65f, 0.77f, 0.97f), ColorRGBf(0, 0, 0), 0.1f, 0.8f, 0.0f);
+    materials.glassSurface = &matDb.emplaceSurface("glass", ColorRGBf(1, 1, 1), ColorRGBf(0, 0, 0), 0.95f, 0.05f, 0.0f);
+    materials.lightSurface = &matDb.emplaceSurface("light", ColorRGBf(0, 0, 0), ColorRGBf(3, 3, 3), 0.0f, 0.0f, 0.0f);
+    materials.dimLightSurface = &matDb.emplaceSurface("dim light", ColorRGBf(0, 0, 0), ColorRGBf(0.02f, 0.02f, 0.02f), 0.0f, 0.0f, 0.0f);
+    materials.opaqueMedium = &matDb.emplaceMedium("opaque", ColorRGBf(0, 0, 0), 1.1f);
+    materials.glassMedium = &matDb.emplaceMedium("glass", ColorRGBf(0.5f, 0.5f, 0.2f), 1.13f);
+    materials.airMedium = &matDb.emplaceMedium("air", ColorRGBf(0.0001f, 0.0001f, 0.0001f), 1.00027717f);
+    return materials;
+}
+
+// Floor and a single light, shared by all scenes.
+void addEnvironment(RawSceneObjectBlob<BenchShapes>& shapes, const BenchMaterials& materials)
+{
+    shapes.add(SceneObject<Disc3>(Disc3(Point3f(0, -4, 0), Normal3f(0.0, -1.0, 0.0), 100), { { materials.floorSurface } }));
+    shapes.add(SceneObject<Sphere>(Sphere(Point3f(0.0, 20, -30), 3), { { materials.lightSurface }, { materials.opaqueMedium } }));
+}
+
+BenchScene createSphereFieldScene(const BenchMaterials& materials, int count)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dx(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> dy(-4.0f, 40.0f);
+    std::uniform_real_distribution<float> dz(-150.0f, -10.0f);
+    std::uniform_real_distribution<float> dr(0.05f, 0.5f);
+
+    BenchScene scene;
+    scene.name = "sphere-field-" + std::to_string(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const SurfaceMaterial* surface = i % 2 ? materials.diffuseSurface : materials.glossySurface;
+        scene.shapes.add(SceneObject<Sphere>(Sphere(Point3f(dx(rng), dy(rng), dz(rng)), dr(rng)), { { surface }, { materials.opaqueMedium } }));
+    }
+    addEnvironment(scene.shapes, materials);
+    return scene;
+}
+
+std::unique_ptr<ClosedTriangleMesh> createIcosahedron(const Vec3f& offset, float radius, bool isSmooth, const SurfaceMaterial* surface, const MediumMaterial* medium)
+{
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f * radius;
+    const Point3f vertices[] = {
+        { -radius, t, 0.0f }, { radius, t, 0.0f }, { -radius, -t, 0.0f }, { radius, -t, 0.0f },
+        { 0.0f, -radius, t }, { 0.0f, radius, t }, { 0.0f, -radius, -t }, { 0.0f, radius, -t },
+        { t, 0.0f, -radius }, { t, 0.0f, radius }, { -t, 0.0f, -radius }, { -t, 0.0f, radius }
+    };
+    const int faces[][3] = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+    };
+
+    auto mesh = std::make_unique<ClosedTriangleMesh>(medium);
+    if (isSmooth)
+    {
+        for (const Point3f& vertex : vertices)
+        {
+            mesh->addVertex(ClosedTriangleMeshVertex{ vertex + offset, Normal3f(Vec3f(vertex).normalized()), {} });
+        }
+
+        for (const auto& face : faces)
+        {
+            mesh->addFace(face[0], face[1], face[2], surface);
+        }
+    }
+    else
+    {
+        for (const auto& face : faces)
+        {
+            const Vec3f centerOffset = (vertices[face[0]].asVector() + vertices[face[1]].asVector() + vertices[face[2]].asVector()) * 0.333333333333f;
+            const Normal3f normal(centerOffset.normalized());
+            for (int v : face)
+            {
+                mesh->addVertex(ClosedTriangleMeshVertex{ vertices[v] + offset, normal, {} });
+            }
+        }
+
+        // faces point into the vertex pool so they can only be added after all vertices
+        for (int i = 0; i < static_cast<int>(std::size(faces)); ++i)
+        {
+            mesh->addFace(i * 3, i * 3 + 1, i * 3 + 2, surface);
+        }
+    }
+
+    return mesh;
+}
+
+BenchScene createIcosahedraScene(const BenchMaterials& materials, int gridSize)
+{
+    BenchScene scene;
+    scene.name = "icosahedra-" + std::to_string(gridSize * gridSize);
+    for (int x = 0; x < gridSize; ++x)
+    {
+        for (int z = 0; z < gridSize; ++z)
+        {
+            const bool isGlass = (x + z) % 3 == 0;
+            const Vec3f offset(static_cast<float>(x - gridSize / 2) * 2.5f, -2.0f + static_cast<float>(z % 3), -8.0f - static_cast<float>(z) * 2.5f);
+            scene.meshes.emplace_back(createIcosahedron(
+                offset,
+                0.8f,
+                (x + z) % 2 == 0,
+                isGlass ? materials.glassSurface : materials.glossySurface,
+                isGlass ? materials.glassMedium : materials.opaqueMedium
+            ));
+        }
+    }
+
+    for (const auto& mesh : scene.meshes)
+    {
+        for (int i = 0; i < mesh->numFaces(); ++i)
+        {
+            scene.shapes.add(SceneObject<ClosedTriangleMeshFace>(mesh->face(i), mesh->material(i)));
+        }
+    }
+    addEnvironment(scene.shapes, materials);
+    return scene;
+}
+
+// Icosahedron with each face subdivided into 4, repeatedly, projected onto a sphere.
+void createIcosphere(int subdivisions, std::vector<ClosedTriangleMeshVertex>& vertices, std::vector<IndexedTriangleMesh::Face>& faces)
+{
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+    const Vec3f corners[] = {
+        { -1.0f, t, 0.0f }, { 1.0f, t, 0.0f }, { -1.0f, -t, 0.0f }, { 1.0f, -t, 0.0f },
+        { 0.0f, -1.0f, t }, { 0.0f, 1.0f, t }, { 0.0f, -1.0f, -t }, { 0.0f, 1.0f, -t },
+        { t, 0.0f, -1.0f }, { t, 0.0f, 1.0f }, { -t, 0.0f, -1.0f }, { -t, 0.0f, 1.0f }
+    };
+    faces = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+    };
+
+    std::vector<Vec3f> directions;
+    for (const Vec3f& corner : corners)
+    {
+        directions.emplace_back(corner.normalized());
+    }
+
+    for (int i = 0; i < subdivisions; ++i)
+    {
+        // midpoints are shared by the two faces of an edge
+        std::map<std::pair<int, int>, int> midpoints;
+        auto midpoint = [&](int a, int b) {
+            const auto key = std::minmax(a, b);
+            auto [it, isNew] = midpoints.try_emplace(key, static_cast<int>(directions.size()));
+            if (isNew)
+            {
+                directions.emplace_back((directions[a] + directions[b]).normalized());
+            }
+            return it->second;
+        };
+
+        std::vector<IndexedTriangleMesh::Face> subdivided;
+        subdivided.reserve(faces.size() * 4);
+        for (const auto& face : faces)
+        {
+            const int ab = midpoint(face[0], face[1]);
+            const int bc = midpoint(face[1], face[2]);
+            const int ca = midpoint(face[2], face[0]);
+            subdivided.push_back({ face[0], ab, ca });
+            subdivided.push_back({ face[1], bc, ab });
+            subdivided.push_back({ face[2], ca, bc });
+            subdivided.push_back({ ab, bc, ca });
+        }
+        faces = std::move(subdivided);
+    }
+
+    vertices.clear();
+    for (const Vec3f& direction : directions)
+    {
+        vertices.push_back(ClosedTriangleMeshVertex{ Point3f::origin() + direction, Normal3f(direction.normalized()), {} });
+    }
+}
+
+// High poly meshes, either as one scene object per face or as one object each.
+BenchScene createIcospheresScene(const BenchMaterials& materials, int count, int subdivisions, bool isIndexed)
+{
+    std::vector<ClosedTriangleMeshVertex> unitVertices;
+    std::vector<IndexedTriangleMesh::Face> faces;
+    createIcosphere(subdivisions, unitVertices, faces);
+
+    BenchScene scene;
+    scene.name = std::string(isIndexed ? "icospheres-indexed-" : "icospheres-faces-") + std::to_string(count) + "x" + std::to_string(faces.size());
+    for (int i = 0; i < count; ++i)
+    {
+        const bool isGlass = i % 3 == 0;
+        const SurfaceMaterial* surface = isGlass ? materials.glassSurface : materials.glossySurface;
+        const MediumMaterial* medium = isGlass ? materials.glassMedium : materials.opaqueMedium;
+        const Vec3f offset(static_cast<float>(i - count / 2) * 2.5f, -2.5f + static_cast<float>(i % 2), -10.0f - static_cast<float>(i % 3) * 3.0f);
+
+        std::vector<ClosedTriangleMeshVertex> vertices = unitVertices;
+        for (ClosedTriangleMeshVertex& vertex : vertices)
+        {
+            vertex.point = Point3f::origin() + vertex.point.asVector() * 1.2f + offset;
+        }
+
+        if (isIndexed)
+        {
+            scene.shapes.add(SceneObject<IndexedTriangleMesh>(IndexedTriangleMesh(vertices, faces), { { surface }, { medium } }));
+        }
+        else
+        {
+            auto& mesh = scene.meshes.emplace_back(std::make_unique<ClosedTriangleMesh>(medium));
+            for (const ClosedTriangleMeshVertex& vertex : vertices)
+            {
+                mesh->addVertex(vertex);
+            }
+            for (const auto& face : faces)
+            {
+                mesh->addFace(face[0], face[1], face[2], surface);
+            }
+        }
+    }
+
+    for (const auto& mesh : scene.meshes)
+    {
+        for (int i = 0; i < mesh->numFaces(); ++i)
+        {
+            scene.shapes.add(SceneObject<ClosedTriangleMeshFace>(mesh->face(i), mesh->material(i)));
+        }
+    }
+    addEnvironment(scene.shapes, materials);
+    return scene;
+}
+
+// Many randomly placed, rotated and scaled copies of one mesh.
+// All instances share the mesh and its bvh.
+BenchScene createMeshInstancesScene(const BenchMaterials& materials, int count, int subdivisions)
+{
+    std::vector<ClosedTriangleMeshVertex> vertices;
+    std::vector<IndexedTriangleMesh::Face> faces;
+    createIcosphere(subdivisions, vertices, faces);
+    // squash it so that rotations are visible
+    for (ClosedTriangleMeshVertex& vertex : vertices)
+    {
+        vertex.point.y *= 0.5f;
+    }
+    const IndexedTriangleMesh mesh(vertices, faces);
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dx(-30.0f, 30.0f);
+    std::uniform_real_distribution<float> dy(-3.0f, 10.0f);
+    std::uniform_real_distribution<float> dz(-80.0f, -10.0f);
+    std::uniform_real_distribution<float> ds(0.3f, 1.0f);
+    std::uniform_real_distribution<float> da(-1.0f, 1.0f);
+
+    BenchScene scene;
+    scene.name = "mesh-instances-" + std::to_string(count) + "x" + std::to_string(faces.size());
+    for (int i = 0; i < count; ++i)
+    {
+        const Vec3f x = Vec3f(da(rng), da(rng), da(rng) + 2.0f).normalized();
+        const Vec3f y = cross(x, Vec3f(0.0f, 0.0f, 1.0f)).normalized();
+        const Vec3f z = cross(x, y);
+        const float scale = ds(rng);
+        const AffineTransformation4f localToWorld(Basis3f(x * scale, y * scale, z * scale), Vec3f(dx(rng), dy(rng), dz(rng)));
+
+        const SurfaceMaterial* surface = i % 2 ? materials.diffuseSurface : materials.glossySurface;
+        scene.shapes.add(SceneObject<MeshInstance>(MeshInstance(localToWorld.inverse(), mesh), { { surface }, { materials.opaqueMedium } }));
+    }
+    addEnvironment(scene.shapes, materials);
+    return scene;
+}
+
+// The CSG shape from the demo.
+BenchScene createCsgScene(const BenchMaterials& materials)
+{
+    const SurfaceMaterial* glass = materials.glassSurface;
+    const MediumMaterial* glassMedium = materials.glassMedium;
+
+    auto sumPart1 = SceneObject<CsgShape>(Sphere(Point3f(-1.5, 0, -7), 3.5), { { glass }, { glassMedium } });
+    auto sumPart2 = SceneObject<CsgShape>(Sphere(Point3f(1.5, 0, -7), 3.5), { { glass }, { glassMedium } });
+    auto subPart3 = SceneObject<CsgShape>(Box3(Point3f(-1.5, -2, -7), Point3f(1.5, 2, -3.5)), { { glass }, { glassMedium } });
+    auto subPart4 = SceneObject<CsgShape>(Box3(Point3f(-0.5, -1, -7), Point3f(0.5, 1, -5)), { { materials.floorSurface }, { materials.opaqueMedium } });
+    auto mulPart5 = SceneObject<CsgShape>(Sphere(Point3f(0, -7.5, -7), 8.5), { { glass }, { glassMedium } });
+    auto sumPart6 = SceneObject<CsgShape>(Sphere(Point3f(-2, 0, -7), 1.5), { { materials.glossySurface }, { materials.opaqueMedium } });
+    auto sumPart7 = SceneObject<CsgShape>(Sphere(Point3f(2, 0, -7), 1.5), { { materials.glossySurface }, { materials.opaqueMedium } });
+    auto subPart8 = SceneObject<CsgShape>(Sphere(Point3f(0, 2.4, -7), 2.5), { { glass }, { glassMedium } });
+    auto subPart9 = SceneObject<CsgShape>(Sphere(Point3f(0, 2.4, -7), 2.4), { { glass }, { glassMedium } });
+    auto subPart10 = SceneObject<CsgShape>(Sphere(Point3f(-1.8, -0.9, -4.1), 0.8), { { glass }, { glassMedium } });
+    auto subPart11 = SceneObject<CsgShape>(Sphere(Point3f(-1.5, 0, -3.5), 0.5), { { glass }, { glassMedium } });
+    auto subPart12 = SceneObject<CsgShape>(Sphere(Point3f(1.8, -0.9, -4.1), 0.8), { { glass }, { glassMedium } });
+    auto subPart13 = SceneObject<CsgShape>(Sphere(Point3f(1.5, 0, -3.5), 0.5), { { glass }, { glassMedium } });
+
+    BenchScene scene;
+    scene.name = "csg";
+    scene.shapes.add(
+        (
+            (
+                (
+                    (sumPart1 | sumPart2)
+                    - (subPart3 - subPart4)
+                )
+                & mulPart5
+            )
+            | (sumPart6 | sumPart7)
+            | (subPart8 - subPart9)
+        )
+        - (subPart10 | subPart11 | subPart12 | subPart13)
+    );
+    addEnvironment(scene.shapes, materials);
+    return scene;
+}
+
+// A row of copies of the sdf from the demo.
+BenchScene createSdfScene(const BenchMaterials& materials, int count)
+{
+    BenchScene scene;
+    scene.name = "sdf-" + std::to_string(count);
+    for (int i = 0; i < count; ++i)
+    {
+        const auto sdfSphere = Sphere(Point3f(static_cast<float>(i - count / 2) * 7.5f, 0, -12), 3.5);
+        scene.shapes.add(
+            SceneObject<ClippedSdf<Sphere>>(
+                ClippedSdf<Sphere>(
+                    sdfSphere,
+                    SdfOnion(
+                        SdfSmoothUnion(
+                            SdfTranslation(SdfRoundedCone(SdfRoundedConeParams(1.0f, 2.0f, 3.0f)), Vec3f(sdfSphere.center())),
+                            SdfTranslation(SdfSphere(2.2f), Vec3f(sdfSphere.center())),
+                            0.25f
+                        ),
+                        0.2f
+                    )
+                ),
+                { { materials.glassSurface }, { materials.glassMedium } }
+            )
+        );
+    }
+    addEnvironment(scene.shapes, materials);
+    return scene;
+}
+
+BenchScene createCapsulesAndCylindersScene(const BenchMaterials& materials, int gridSize)
+{
+    BenchScene scene;
+    scene.name = "capsules-cylinders-" + std::to_string(gridSize * gridSize);
+    for (int x = 0; x < gridSize; ++x)
+    {
+        for (int z = 0; z < gridSize; ++z)
+        {
+            const Point3f begin(static_cast<float>(x - gridSize / 2) * 3.0f, -3.0f, -6.0f - static_cast<float>(z) * 3.0f);
+            const Point3f end = begin + Vec3f(1.0f, 2.0f + static_cast<float>((x * 7 + z) % 3), -1.0f);
+            if ((x + z) % 2 == 0)
+            {
+                scene.shapes.add(SceneObject<Capsule>(Capsule(begin, end, 0.5f), { { materials.glassSurface, materials.glossySurface }, { materials.glassMedium } }));
+            }
+            else
+            {
+                scene.shapes.add(SceneObject<Cylinder>(Cylinder(begin, end, 0.5f), { { materials.diffuseSurface, materials.glossySurface }, { materials.opaqueMedium } }));
+            }
+        }
+    }
+    addEnvironment(scene.shapes, materials);
+    return scene;
+}
+
+// A grid of lights too dim to reach Options::contributionThreshold on their own,
+// but together they light the scene about as much as the main light.
+BenchScene createDimLightsScene(const BenchMaterials& materials, int gridSize)
+{
+    BenchScene scene;
+    scene.name = "dim-lights-" + std::to_string(gridSize * gridSize);
+    for (int x = 0; x < gridSize; ++x)
+    {
+        for (int z = 0; z < gridSize; ++z)
+        {
+            const Point3f center(static_cast<float>(x - gridSize / 2) * 2.0f, 8.0f, -4.0f - static_cast<float>(z) * 2.0f);
+            scene.shapes.add(SceneObject<Sphere>(Sphere(center, 0.2f), { { materials.dimLightSurface }, { materials.opaqueMedium } }));
+        }
+    }
+    for (int i = 0; i < 5; ++i)
+    {
+        const Point3f center(static_cast<float>(i - 2) * 3.0f, -2.5f, -12.0f);
+        scene.shapes.add(SceneObject<Sphere>(Sphere(center, 1.5f), { { materials.diffuseSurface }, { materials.opaqueMedium } }));
+    }
+    addEnvironment(scene.shapes, materials);
+    return scene;
+}
+
+// FNV-1a of the image, changes when the output changes.
+std::uint64_t imageHash(const Image& img)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::uint8_t byte : img.rawRGBAi())
+    {
+        hash = (hash ^ byte) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+struct ImageDifference
+{
+    int max; // of a single color channel
+    double mean; // over all color channels
+};
+
+ImageDifference imageDifference(const Image& img, const Image& reference)
+{
+    const std::vector<std::uint8_t> pixels = img.rawRGBAi();
+    const std::vector<std::uint8_t> referencePixels = reference.rawRGBAi();
+
+    int maxDifference = 0;
+    double totalDifference = 0.0;
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+    {
+        if (i % 4 == 3) continue; // alpha
+
+        const int difference = std::abs(static_cast<int>(pixels[i]) - static_cast<int>(referencePixels[i]));
+        maxDifference = std::max(maxDifference, difference);
+        totalDifference += difference;
+    }
+
+    return { maxDifference, totalDifference / (pixels.size() / 4 * 3) };
+}
+
+std::string jsonString(const std::string& str)
+{
+    return "\"" + str + "\"";
+}
+
+template <typename FuncT>
+void forEachBenchSampler(FuncT&& func)
+{
+    func("single", Sampler{});
+    func("uniform-grid-2", UniformGridMultisampler(2));
+    func("jittered-2", JitteredMultisampler(2, 256, 0.66f));
+    func("quincunx", QuincunxMultisampler{});
+    func("adaptive-uniform-grid-3", AdaptiveMultisampler(0.05f, UniformGridMultisampler(3)));
+}
+
+template <typename PartitionerT, typename StorageProviderT = PackedSceneObjectStorageProvider>
+using BenchStaticScene = StaticScene<StaticBvh<BvhParams<BenchShapes, Box3, StorageProviderT>, PartitionerT>>;
+
+// Builds the bvh over the scene's shapes and sets the background and air all benchmarks use.
+// Perf stats are reset before, so that the construction stats are of this scene.
+// On the heap because lights reference the objects stored in the scene.
+template <typename StaticSceneT, typename... PartitionerArgTs>
+std::unique_ptr<StaticSceneT> makeBenchScene(const BenchScene& scene, const BenchMaterials& materials, PartitionerArgTs&&... partitionerArgs)
+{
+
+#if defined(RAY_GATHER_PERF_STATS)
+    perf::gGlobalPerfStats.reset();
+#endif
+
+    auto staticScene = std::make_unique<StaticSceneT>(scene.shapes, std::forward<PartitionerArgTs>(partitionerArgs)...);
+    staticScene->setBackgroundColor(ColorRGBf(0.57f, 0.88f, 0.98f));
+    staticScene->setBackgroundDistance(1000.0f);
+    staticScene->setMediumMaterial(materials.airMedium);
+    return staticScene;
+}
+
+// The sah bvh used by the benchmarks that don't compare partitioners.
+template <typename StorageProviderT = PackedSceneObjectStorageProvider>
+std::unique_ptr<BenchStaticScene<StaticBvhObjectSahPartitioner, StorageProviderT>> makeSahBenchScene(const BenchScene& scene, const BenchMaterials& materials)
+{
+    return makeBenchScene<BenchStaticScene<StaticBvhObjectSahPartitioner, StorageProviderT>>(scene, materials, 2, 16);
+}
+
+Camera benchCamera(const BenchSettings& settings)
+{
+    return Camera({ 0, 0.5f, 0 }, UnitVec3f(0, 0, -1), UnitVec3f(0, 1, 0), settings.width, settings.height, Angle2f::degrees(45));
+}
+
+// Opens the JSON object of a result with the fields every result has.
+// The caller adds the fields specific to the benchmark and closes it.
+std::string resultHeader(const BenchScene& scene, const std::string& partitionerName, const std::string& samplerName)
+{
+    std::string result = "{";
+    result += "\"scene\":" + jsonString(scene.name);
+    result += ",\"partitioner\":" + jsonString(partitionerName);
+    result += ",\"sampler\":" + jsonString(samplerName);
+    return result;
+}
+
+struct BenchRender
+{
+    Image image;
+    double time; // in seconds
+};
+
+// Times the render done by func, which returns the image.
+// Render perf stats are reset before, so that they only cover this render.
+// Construction stats are kept, they belong to the scene being rendered.
+template <typename FuncT>
+BenchRender timeRender(FuncT&& func)
+{
+
+#if defined(RAY_GATHER_PERF_STATS)
+    perf::gGlobalPerfStats.resetRenderStats();
+#endif
+
+    auto t0 = std::chrono::high_resolution_clock().now();
+    Image img = func();
+    auto t1 = std::chrono::high_resolution_clock().now();
+
+#if defined(RAY_GATHER_PERF_STATS)
+    perf::gGlobalPerfStats.collect(); // threads are in a pool, may not have ended
+#endif
+
+    return { std::move(img), static_cast<double>((t1 - t0).count()) / 1e9 };
+}
+
+// Fields describing the render's time and output.
+// Ray throughput is only known with the perf stats, pixel throughput always.
+std::string renderFields(const BenchRender& render, const BenchSettings& settings)
+{
+    const double numPixels = static_cast<double>(settings.width) * settings.height;
+
+    std::string fields;
+    fields += ",\"renderTime\":" + std::to_string(render.time);
+    fields += ",\"pixelsPerSecond\":" + std::to_string(numPixels / render.time);
+    fields += ",\"imageHash\":" + jsonString(std::to_string(imageHash(render.image)));
+
+#if defined(RAY_GATHER_PERF_STATS)
+    const double numRays = static_cast<double>(perf::gGlobalPerfStats.totalTraces().all);
+    fields += ",\"raysPerSecond\":" + std::to_string(numRays / render.time);
+#endif
+
+    return fields;
+}
+
+template <typename PartitionerT, typename... PartitionerArgTs>
+void benchmarkPartitioner(
+    std::vector<std::string>& results,
+    const BenchScene& scene,
+    const BenchMaterials& materials,
+    const BenchSettings& settings,
+    const std::string& partitionerName,
+    PartitionerArgTs&&... partitionerArgs)
+{
+    auto t0 = std::chrono::high_resolution_clock().now();
+    const auto staticScene = makeBenchScene<BenchStaticScene<PartitionerT>>(scene, materials, std::forward<PartitionerArgTs>(partitionerArgs)...);
+    auto t1 = std::chrono::high_resolution_clock().now();
+    const double buildTime = static_cast<double>((t1 - t0).count()) / 1e9;
+
+    Raytracer raytracer(*staticScene);
+    const Camera camera = benchCamera(settings);
+
+    forEachBenchSampler([&](const std::string& samplerName, const auto& sampler) {
+        const BenchRender render = timeRender([&] { return raytracer.capture(camera, sampler); });
+
+        std::string result = resultHeader(scene, partitionerName, samplerName);
+        result += ",\"buildTime\":" + std::to_string(buildTime);
+        result += renderFields(render, settings);
+
+#if defined(RAY_GATHER_PERF_STATS)
+        result += ",\"perf\":" + perf::gGlobalPerfStats.json();
+#endif
+
+        result += "}";
+
+        std::cerr << scene.name << ", " << partitionerName << ", " << samplerName << ": " << render.time << "s\n";
+        results.emplace_back(std::move(result));
+    });
+}
+
+const std::pair<const char*, RaySorting> benchRaySortings[] = {
+    { "none", RaySorting::None },
+    { "octant", RaySorting::Octant },
+    { "octant-morton", RaySorting::OctantMorton }
+};
+
+// Wavefront rendering of the scene with each secondary ray ordering.
+// maxDifference is against the image from capture.
+// With perf stats the number of bounding volume tests, roughly bvh node visits, is reported.
+void benchmarkRaySorting(
+    std::vector<std::string>& results,
+    const BenchScene& scene,
+    const BenchMaterials& materials,
+    const BenchSettings& settings)
+{
+    const auto staticScene = makeSahBenchScene(scene, materials);
+    const Camera camera = benchCamera(settings);
+    const Image reference = Raytracer(*staticScene).capture(camera, Sampler{});
+
+    for (const auto& [sortingName, sorting] : benchRaySortings)
+    {
+        Raytracer::Options options;
+        options.secondaryRaySorting = sorting;
+        Raytracer raytracer(*staticScene, options);
+
+        const BenchRender render = timeRender([&] { return raytracer.captureWavefront(camera, Sampler{}, std::execution::par_unseq); });
+        const ImageDifference difference = imageDifference(render.image, reference);
+
+        std::string result = resultHeader(scene, "sah", "single");
+        result += ",\"wavefront\":true";
+        result += ",\"raySorting\":" + jsonString(sortingName);
+        result += renderFields(render, settings);
+        result += ",\"maxDifference\":" + std::to_string(difference.max);
+
+#if defined(RAY_GATHER_PERF_STATS)
+        const perf::AtomicPerformanceStats& stats = perf::gGlobalPerfStats;
+        const std::uint64_t bvRaycasts = stats.bvRaycasts<Box3>().all.load() + stats.bvRaycasts<Box3Pack4>().all.load();
+        result += ",\"bvRaycasts\":" + std::to_string(bvRaycasts);
+#endif
+
+        result += "}";
+
+        std::cerr << scene.name << ", wavefront, " << sortingName << ": " << render.time << "s, max difference " << difference.max << "\n";
+        results.emplace_back(std::move(result));
+    }
+}
+
+// Renders the scene through the type erased Raytracer and through one specialized
+// for the concrete scene type, in which the scene queries are not virtual.
+void benchmarkSceneDispatch(
+    std::vector<std::string>& results,
+    const BenchScene& scene,
+    const BenchMaterials& materials,
+    const BenchSettings& settings)
+{
+    const auto staticScene = makeSahBenchScene(scene, materials);
+    const Camera camera = benchCamera(settings);
+
+    auto bench = [&](const char* dispatchName, const auto& raytracer) {
+        const BenchRender render = timeRender([&] { return raytracer.capture(camera, Sampler{}); });
+
+        std::string result = resultHeader(scene, "sah", "single");
+        result += ",\"sceneDispatch\":" + jsonString(dispatchName);
+        result += renderFields(render, settings);
+        result += "}";
+
+        std::cerr << scene.name << ", " << dispatchName << " scene: " << render.time << "s\n";
+        results.emplace_back(std::move(result));
+    };
+
+    bench("virtual", Raytracer(*staticScene));
+    bench("static", BasicRaytracer<BenchStaticScene<StaticBvhObjectSahPartitioner>>(*staticScene));
+}
+
+// Builds and renders the scene with objects in bvh leaves stored in vectors
+// and with each leaf's objects moved to a single allocation.
+// Cache misses are not measured, only the times.
+void benchmarkObjectStorage(
+    std::vector<std::string>& results,
+    const BenchScene& scene,
+    const BenchMaterials& materials,
+    const BenchSettings& settings)
+{
+    const Camera camera = benchCamera(settings);
+
+    auto bench = [&](const char* storageName, auto storageProvider) {
+        using StorageProviderType = decltype(storageProvider);
+
+        auto t0 = std::chrono::high_resolution_clock().now();
+        const auto staticScene = makeSahBenchScene<StorageProviderType>(scene, materials);
+        auto t1 = std::chrono::high_resolution_clock().now();
+        const double buildTime = static_cast<double>((t1 - t0).count()) / 1e9;
+
+        BasicRaytracer<BenchStaticScene<StaticBvhObjectSahPartitioner, StorageProviderType>> raytracer(*staticScene);
+        const BenchRender render = timeRender([&] { return raytracer.capture(camera, Sampler{}); });
+
+        std::string result = resultHeader(scene, "sah", "single");
+        result += ",\"objectStorage\":" + jsonString(storageName);
+        result += ",\"buildTime\":" + std::to_string(buildTime);
+        result += renderFields(render, settings);
+        result += "}";
+
+        std::cerr << scene.name << ", " << storageName << " storage: " << render.time << "s\n";
+        results.emplace_back(std::move(result));
+    };
+
+    bench("packed", PackedSceneObjectStorageProvider{});
+    bench("arena", ArenaSceneObjectStorageProvider{});
+}
+
+// Renders the scene with and without Options::cullDimLights.
+// The culled image is compared to the unculled one, the difference is in 8 bit color steps.
+void benchmarkLightCulling(
+    std::vector<std::string>& results,
+    const BenchScene& scene,
+    const BenchMaterials& materials,
+    const BenchSettings& settings)
+{
+    const auto staticScene = makeSahBenchScene(scene, materials);
+    const Camera camera = benchCamera(settings);
+
+    std::optional<Image> reference;
+    for (const bool cullDimLights : { false, true })
+    {
+        Raytracer::Options options;
+        options.cullDimLights = cullDimLights;
+        Raytracer raytracer(*staticScene, options);
+
+        BenchRender render = timeRender([&] { return raytracer.capture(camera, Sampler{}); });
+        const ImageDifference difference = reference ? imageDifference(render.image, *reference) : ImageDifference{ 0, 0.0 };
+
+        std::string result = resultHeader(scene, "sah", "single");
+        result += ",\"cullDimLights\":" + std::string(cullDimLights ? "true" : "false");
+        result += renderFields(render, settings);
+        result += ",\"maxDifference\":" + std::to_string(difference.max);
+        result += ",\"meanDifference\":" + std::to_string(difference.mean);
+        result += "}";
+
+        std::cerr << scene.name << ", " << (cullDimLights ? "culled" : "unculled") << " lights: " << render.time << "s, max difference " << difference.max << "\n";
+        results.emplace_back(std::move(result));
+
+        if (!reference)
+        {
+            reference.emplace(std::move(render.image));
+        }
+    }
+}
+
+// Rounding can't make captureWavefront differ from capture by more than this many 8 bit color steps.
+// The colors along a path are summed in a different order.
+constexpr int maxWavefrontDifference = 2;
+
+// Renders the scene with capture and with captureWavefront, for each secondary ray ordering.
+// Returns whether all wavefront images match the one from capture.
+bool checkWavefront(const BenchScene& scene, const BenchMaterials& materials, const BenchSettings& settings)
+{
+    const auto staticScene = makeSahBenchScene(scene, materials);
+    const Camera camera = benchCamera(settings);
+    const Image reference = Raytracer(*staticScene).capture(camera, Sampler{});
+
+    bool matches = true;
+    for (const auto& [sortingName, sorting] : benchRaySortings)
+    {
+        Raytracer::Options options;
+        options.secondaryRaySorting = sorting;
+        const Image img = Raytracer(*staticScene, options).captureWavefront(camera, Sampler{}, std::execution::par_unseq);
+        const ImageDifference difference = imageDifference(img, reference);
+
+        const bool isMatch = difference.max <= maxWavefrontDifference;
+        std::cerr << scene.name << ", wavefront, " << sortingName << ": max difference " << difference.max << (isMatch ? "\n" : ", too large\n");
+        matches = matches && isMatch;
+    }
+
+    return matches;
+}
+
+std::vector<BenchScene> createBenchScenes(const BenchMaterials& materials)
+{
+    std::vector<BenchScene> scenes;
+    scenes.emplace_back(createSphereFieldScene(materials, 20000));
+    scenes.emplace_back(createIcosahedraScene(materials, 8));
+    scenes.emplace_back(createIcospheresScene(materials, 5, 4, false));
+    scenes.emplace_back(createIcospheresScene(materials, 5, 4, true));
+    scenes.emplace_back(createMeshInstancesScene(materials, 500, 4));
+    scenes.emplace_back(createCsgScene(materials));
+    scenes.emplace_back(createSdfScene(materials, 3));
+    scenes.emplace_back(createCapsulesAndCylindersScene(materials, 10));
+    scenes.emplace_back(createDimLightsScene(materials, 12));
+    return scenes;
+}
+
+int main(int argc, char** argv)
+{
+    const bool isWavefrontCheck = argc > 1 && std::string(argv[1]) == "--check-wavefront";
+    const std::string outputPath = argc > 1 && !isWavefrontCheck ? argv[1] : "";
+    BenchSettings settings;
+    if (argc > 3)
+    {
+        settings.width = std::stoi(argv[2]);
+        settings.height = std::stoi(argv[3]);
+    }
+
+    TextureDatabase texDb;
+    MaterialDatabase matDb;
+    const BenchMaterials materials = createMaterials(matDb, texDb);
+
+    const std::vector<BenchScene> scenes = createBenchScenes(materials);
+
+    if (isWavefrontCheck)
+    {
+        bool matches = true;
+        for (const BenchScene& scene : scenes)
+        {
+            matches = checkWavefront(scene, materials, settings) && matches;
+        }
+        return matches ? 0 : 1;
+    }
+
+    std::vector<std::string> results;
+    for (const BenchScene& scene : scenes)
+    {
+        benchmarkPartitioner<StaticBvhObjectMeanPartitioner>(results, scene, materials, settings, "mean", 2);
+        benchmarkPartitioner<StaticBvhObjectMedianPartitioner>(results, scene, materials, settings, "median", 2);
+        benchmarkPartitioner<StaticBvhObjectSahPartitioner>(results, scene, materials, settings, "sah", 2, 16);
+        benchmarkRaySorting(results, scene, materials, settings);
+        benchmarkSceneDispatch(results, scene, materials, settings);
+        benchmarkObjectStorage(results, scene, materials, settings);
+        benchmarkLightCulling(results, scene, materials, settings);
+    }
+
+    std::string out = "{";
+    out += "\"width\":" + std::to_string(settings.width);
+    out += ",\"height\":" + std::to_string(settings.height);
+#if defined(RAY_GATHER_PERF_STATS)
+    out += ",\"perfStats\":true";
+#else
+    out += ",\"perfStats\":false";
+#endif
+    out += ",\"results\":[\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        out += results[i];
+        out += i + 1 < results.size() ? ",\n" : "\n";
+    }
+    out += "]}\n";
+
+    if (outputPath.empty())
+    {
+        std::cout << out;
+    }
+    else
+    {
+        std::ofstream file(outputPath);
+        file << out;
+    }
+
+    return 0;
+}
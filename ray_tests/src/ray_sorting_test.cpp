@@ -0,0 +1,96 @@
+#include <ray/math/Ray.h>
+#include <ray/math/Vec3.h>
+
+#include <ray/RayQueue.h>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Sorts a queue with rays in all 8 direction octants, from origins spread over a box.
+// Afterwards the rays of each octant have to be in a single run, in the order of the octants,
+// and every ray has to still be there.
+// Usage: ray_sorting_test
+
+using namespace ray;
+
+std::vector<QueuedShadowRay> createRays(int count)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> coord(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+
+    std::vector<QueuedShadowRay> rays;
+    for (int i = 0; i < count; ++i)
+    {
+        const Point3f origin(coord(rng), coord(rng), coord(rng));
+        const UnitVec3f direction(component(rng), component(rng), component(rng));
+        rays.push_back(QueuedShadowRay{ Ray(origin, direction), ColorRGBf(1.0f, 1.0f, 1.0f), nullptr, i, 0 });
+    }
+    return rays;
+}
+
+// Number of errors, printed with the sorting's name.
+int checkSorted(const std::vector<QueuedShadowRay>& rays, int count, const char* sortingName)
+{
+    int numErrors = 0;
+
+    std::vector<int> octantRuns(8, 0);
+    for (std::size_t i = 0; i < rays.size(); ++i)
+    {
+        const int octant = directionOctant(rays[i].ray.direction());
+        if (i == 0 || directionOctant(rays[i - 1].ray.direction()) != octant)
+        {
+            ++octantRuns[octant];
+        }
+        if (i > 0 && directionOctant(rays[i - 1].ray.direction()) > octant)
+        {
+            ++numErrors;
+        }
+    }
+
+    for (int octant = 0; octant < 8; ++octant)
+    {
+        if (octantRuns[octant] != 1)
+        {
+            std::cout << sortingName << ": octant " << octant << " in " << octantRuns[octant] << " runs\n";
+            ++numErrors;
+        }
+    }
+
+    std::vector<int> ids;
+    for (const QueuedShadowRay& ray : rays)
+    {
+        ids.push_back(ray.pixelNo);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (int i = 0; i < count; ++i)
+    {
+        if (i >= static_cast<int>(ids.size()) || ids[i] != i)
+        {
+            std::cout << sortingName << ": rays lost\n";
+            ++numErrors;
+            break;
+        }
+    }
+
+    std::cout << sortingName << ": " << numErrors << " errors\n";
+    return numErrors;
+}
+
+int main()
+{
+    constexpr int numRays = 4096;
+
+    int numErrors = 0;
+    for (const auto& [sortingName, sorting] : { std::pair{ "octant", RaySorting::Octant }, std::pair{ "octant-morton", RaySorting::OctantMorton } })
+    {
+        std::vector<QueuedShadowRay> rays = createRays(numRays);
+        sortForCoherence(rays, sorting);
+        numErrors += checkSorted(rays, numRays, sortingName);
+    }
+
+    return numErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+#include <ray/math/Raycast.h>
+#include <ray/math/Vec3.h>
+#include <ray/math/WatertightRaycast.h>
+
+#include <ray/shape/ClosedTriangleMesh.h>
+#include <ray/shape/IndexedTriangleMesh.h>
+#include <ray/shape/TriangleVertexPack8.h>
+
+#include <ray/utility/CpuFeatures.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Fires rays exactly through the vertices and along the shared edges of a closed mesh.
+// Each of them has to hit at least one face, with every kernel, or a ray slipped between the faces.
+// Usage: watertight_mesh_test
+
+using namespace ray;
+
+struct TestMesh
+{
+    std::vector<ClosedTriangleMeshVertex> vertices;
+    std::vector<IndexedTriangleMesh::Face> faces;
+    Point3f center;
+};
+
+// Subdivided octahedron, moved off the origin and scaled so that the coordinates aren't exact.
+TestMesh createTestMesh(int subdivisions)
+{
+    std::vector<Vec3f> directions = {
+        { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+        { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+    };
+    std::vector<IndexedTriangleMesh::Face> faces = {
+        { 0, 2, 4 }, { 2, 1, 4 }, { 1, 3, 4 }, { 3, 0, 4 },
+        { 2, 0, 5 }, { 1, 2, 5 }, { 3, 1, 5 }, { 0, 3, 5 }
+    };
+
+    for (int i = 0; i < subdivisions; ++i)
+    {
+        std::map<std::pair<int, int>, int> midpoints;
+        auto midpoint = [&](int a, int b) {
+            const auto key = std::minmax(a, b);
+            auto [it, isNew] = midpoints.try_emplace(key, static_cast<int>(directions.size()));
+            if (isNew)
+            {
+                directions.emplace_back((directions[a] + directions[b]).normalized());
+            }
+            return it->second;
+        };
+
+        std::vector<IndexedTriangleMesh::Face> subdivided;
+        subdivided.reserve(faces.size() * 4);
+        for (const auto& face : faces)
+        {
+            const int ab = midpoint(face[0], face[1]);
+            const int bc = midpoint(face[1], face[2]);
+            const int ca = midpoint(face[2], face[0]);
+            subdivided.push_back({ face[0], ab, ca });
+            subdivided.push_back({ face[1], bc, ab });
+            subdivided.push_back({ face[2], ca, bc });
+            subdivided.push_back({ ab, bc, ca });
+        }
+        faces = std::move(subdivided);
+    }
+
+    TestMesh mesh;
+    mesh.center = Point3f(0.3f, -0.7f, 5.1f);
+    mesh.faces = std::move(faces);
+    for (const Vec3f& direction : directions)
+    {
+        mesh.vertices.push_back(ClosedTriangleMeshVertex{ mesh.center + direction * 1.37f, Normal3f(direction.normalized()), {} });
+    }
+    return mesh;
+}
+
+// Targets on the surface: every vertex and a few points along every edge.
+std::vector<Point3f> createTargets(const TestMesh& mesh)
+{
+    std::vector<Point3f> targets;
+    for (const ClosedTriangleMeshVertex& vertex : mesh.vertices)
+    {
+        targets.emplace_back(vertex.point);
+    }
+
+    std::map<std::pair<int, int>, int> edges;
+    for (const auto& face : mesh.faces)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            edges.try_emplace(std::minmax(face[i], face[(i + 1) % 3]), 0);
+        }
+    }
+
+    for (const auto& [edge, unused] : edges)
+    {
+        const Point3f& a = mesh.vertices[edge.first].point;
+        const Point3f& b = mesh.vertices[edge.second].point;
+        for (float t : { 0.5f, 0.25f, 0.333333333f, 0.9f })
+        {
+            targets.emplace_back(a + (b - a) * t);
+        }
+    }
+
+    return targets;
+}
+
+// Number of faces of the mesh the ray hits, by testing all packs of the mesh with the given kernel.
+template <typename KernelT>
+int countPackHits(const Ray& ray, const IndexedTriangleMesh& mesh, KernelT&& kernel)
+{
+    const WatertightRay wray(ray);
+    int numHits = 0;
+    for (int nodeNo = 0; nodeNo < mesh.numNodes(); ++nodeNo)
+    {
+        const IndexedTriangleMesh::Node& node = mesh.node(nodeNo);
+        for (int i = 0; i < node.numFaces; i += TriangleVertexPack8::numShapes)
+        {
+            const int numTriangles = std::min(node.numFaces - i, TriangleVertexPack8::numShapes);
+            const std::uint32_t usedMask = (1u << numTriangles) - 1u;
+            const TriangleVertexPack8& pack = mesh.pack(node.firstPack + i / TriangleVertexPack8::numShapes);
+            const std::uint32_t mask = kernel(wray, pack, usedMask) & usedMask;
+            for (int lane = 0; lane < numTriangles; ++lane)
+            {
+                if (mask & (1u << lane)) ++numHits;
+            }
+        }
+    }
+    return numHits;
+}
+
+int main()
+{
+    constexpr float tMax = std::numeric_limits<float>::max();
+
+    const TestMesh testMesh = createTestMesh(3);
+    const IndexedTriangleMesh mesh(testMesh.vertices, testMesh.faces);
+    const std::vector<Point3f> targets = createTargets(testMesh);
+
+    // Origins are inside so that every ray has to leave through the surface.
+    // From the outside rays can graze the silhouette, and miss it because of rounding.
+    std::vector<Point3f> origins = { testMesh.center };
+    for (const Vec3f& offset : {
+        Vec3f(0.5f, 0.0f, 0.0f), Vec3f(0.0f, -0.5f, 0.0f), Vec3f(0.0f, 0.0f, 0.5f),
+        Vec3f(0.31f, 0.27f, -0.13f), Vec3f(-0.42f, 0.06f, 0.22f), Vec3f(-0.11f, -0.33f, -0.39f) })
+    {
+        origins.emplace_back(testMesh.center + offset);
+    }
+
+    float t[TriangleVertexPack8::numShapes];
+    float u[TriangleVertexPack8::numShapes];
+    float v[TriangleVertexPack8::numShapes];
+    float w[TriangleVertexPack8::numShapes];
+    float det[TriangleVertexPack8::numShapes];
+    auto sseKernel = [&](const WatertightRay& wray, const TriangleVertexPack8& pack, std::uint32_t usedMask) {
+        return detail::raycastWatertightSse(wray, pack, 0, usedMask, tMax, t, u, v, w, det)
+            | detail::raycastWatertightSse(wray, pack, 4, usedMask, tMax, t, u, v, w, det);
+    };
+    auto avx2Kernel = [&](const WatertightRay& wray, const TriangleVertexPack8& pack, std::uint32_t usedMask) {
+        return detail::raycastWatertightAvx2(wray, pack, usedMask, tMax, t, u, v, w, det);
+    };
+    const bool hasAvx2 = CpuFeatures::get().hasAvx2;
+
+    int numRays = 0;
+    int numSseMisses = 0;
+    int numAvx2Misses = 0;
+    int numMeshMisses = 0;
+    for (const Point3f& origin : origins)
+    {
+        for (const Point3f& target : targets)
+        {
+            const Ray ray = Ray::between(origin, target);
+            ++numRays;
+
+            if (countPackHits(ray, mesh, sseKernel) == 0) ++numSseMisses;
+            if (hasAvx2 && countPackHits(ray, mesh, avx2Kernel) == 0) ++numAvx2Misses;
+
+            RaycastHit hit;
+            hit.dist = tMax;
+            if (!raycast(ray, mesh, hit)) ++numMeshMisses;
+        }
+    }
+
+    std::cout << numRays << " rays, misses: sse " << numSseMisses;
+    if (hasAvx2)
+    {
+        std::cout << ", avx2 " << numAvx2Misses;
+    }
+    std::cout << ", mesh " << numMeshMisses << '\n';
+
+    return numSseMisses == 0 && numAvx2Misses == 0 && numMeshMisses == 0 ? 0 : 1;
+}